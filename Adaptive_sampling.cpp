@@ -0,0 +1,206 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Adaptive_sampling.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Adaptive sampling of tiles, see Adaptive_sampling.h
+*/
+#include "Adaptive_sampling.h"
+#include "Biome.h"
+#include "Tile_address.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/** Coarser lattices miss too much between their points to pay off */
+static constexpr int max_spacing = 8;
+/** Finer lattices cost more than evaluating every pixel saves */
+static constexpr int min_spacing = 4;
+
+int adaptive_spacing(const Noise_settings& s)
+{
+    if (s.adaptive_tolerance <= 0.0 || s.graph || whole_map_engine(s.engine)
+        || s.octaves < 1 || s.frequency <= 0.0)
+        return 0;
+
+    /* Heights are noise/2 + 0.5, so the first octave has amplitude 0.5 */
+    int finest = s.octaves - 1;
+    double amplitude = 0.5 * std::pow(s.persistence, finest);
+    double tail = 0.0;
+    while (finest > 0 && tail + amplitude <= s.adaptive_tolerance) {
+        tail += amplitude;
+        amplitude /= s.persistence;
+        finest--;
+    }
+
+    double wavelength = 1.0 / (s.frequency * std::pow(s.lacunarity, finest));
+    /* The triangles of simplex noise are smaller than the cubes of
+       gradient noise, and its peaks are sharper */
+    if (s.engine == NOISE_ENGINE::simplex)
+        wavelength /= 2.0;
+    int spacing = max_spacing;
+    while (spacing >= min_spacing && spacing > wavelength / 2.0)
+        spacing /= 2;
+    return (spacing < min_spacing ? 0 : spacing);
+}
+
+/**
+ * Catmull-Rom interpolation between p1 (t = 0) and p2 (t = 1)
+ */
+static inline double catmull_rom(double p0, double p1, double p2, double p3,
+    double t)
+{
+    return p1 + 0.5 * t * (p2 - p0 + t * (2.0*p0 - 5.0*p1 + 4.0*p2 - p3
+        + t * (3.0 * (p1 - p2) + p3 - p0)));
+}
+
+/**
+ * \return true if a biome threshold is in [lo, hi].
+ */
+static inline bool threshold_between(double lo, double hi)
+{
+    for (int i=0; i<num_biome_thresholds; i++)
+        if (biome_thresholds[i] >= lo && biome_thresholds[i] <= hi)
+            return true;
+    return false;
+}
+
+std::size_t sample_adaptive(const Height_sampler& exact, int x0, int y0,
+    int spacing, double tolerance, double* heights)
+{
+    const int cells = tile_size / spacing;
+    /* One lattice point past each edge of the tile, for the bicubic */
+    const int side = cells + 3;
+    std::vector<double> xs, ys, values;
+    std::vector<int> where;
+
+    auto evaluate = [&]() {
+        values.resize(xs.size());
+        if (!xs.empty())
+            exact(xs.data(), ys.data(), xs.size(), values.data());
+    };
+
+    /* The lattice */
+    for (int j=0; j<side; j++) {
+        for (int i=0; i<side; i++) {
+            xs.push_back(x0 + (i - 1) * spacing);
+            ys.push_back(y0 + (j - 1) * spacing);
+        }
+    }
+    evaluate();
+    const std::vector<double> lattice{values};
+    std::size_t evaluated = lattice.size();
+
+    /* Interpolate down the columns of the lattice, then along the row */
+    std::vector<double> column(side);
+    for (int ly=0; ly<tile_size; ly++) {
+        const int cy = ly / spacing;
+        const double t = static_cast<double>(ly % spacing) / spacing;
+        for (int i=0; i<side; i++) {
+            column[i] = catmull_rom(lattice[cy*side + i],
+                lattice[(cy + 1)*side + i], lattice[(cy + 2)*side + i],
+                lattice[(cy + 3)*side + i], t);
+        }
+        double* row = heights + static_cast<std::size_t>(ly) * tile_size;
+        for (int lx=0; lx<tile_size; lx++) {
+            const int cx = lx / spacing;
+            const double u = static_cast<double>(lx % spacing) / spacing;
+            row[lx] = catmull_rom(column[cx], column[cx + 1],
+                column[cx + 2], column[cx + 3], u);
+        }
+    }
+
+    /* Measure the error of each cell at its centre */
+    const int centre = spacing / 2;
+    xs.clear();
+    ys.clear();
+    for (int cy=0; cy<cells; cy++) {
+        for (int cx=0; cx<cells; cx++) {
+            xs.push_back(x0 + cx*spacing + centre);
+            ys.push_back(y0 + cy*spacing + centre);
+        }
+    }
+    evaluate();
+    evaluated += values.size();
+
+    /* A cell is evaluated in full if its error is over the tolerance, or
+       if a biome threshold is within reach of its heights: between the
+       lowest and highest of them, widened by the error the interpolation
+       might make. That error can be larger than at the centre, so half of
+       the measured error is allowed for on top, and it includes the
+       octaves adaptive_spacing() left out, which add up to no more than
+       the tolerance. */
+    xs.clear();
+    ys.clear();
+    for (int cy=0; cy<cells; cy++) {
+        for (int cx=0; cx<cells; cx++) {
+            const int c = cy*cells + cx;
+            const std::size_t mid = static_cast<std::size_t>(
+                cy*spacing + centre) * tile_size + cx*spacing + centre;
+            const double bound = 1.5 * std::fabs(values[c] - heights[mid]);
+            heights[mid] = values[c];
+            if (bound <= tolerance) {
+                /* The far corners may be past the tile, so the corners
+                   come from the lattice */
+                const std::size_t corner = static_cast<std::size_t>(
+                    cy + 1) * side + cx + 1;
+                double lo = std::min(std::min(lattice[corner],
+                    lattice[corner + 1]), std::min(lattice[corner + side],
+                    lattice[corner + side + 1]));
+                double hi = std::max(std::max(lattice[corner],
+                    lattice[corner + 1]), std::max(lattice[corner + side],
+                    lattice[corner + side + 1]));
+                for (int ly=cy*spacing; ly<(cy + 1)*spacing; ly++) {
+                    const double* row = heights
+                        + static_cast<std::size_t>(ly) * tile_size;
+                    for (int lx=cx*spacing; lx<(cx + 1)*spacing; lx++) {
+                        lo = std::min(lo, row[lx]);
+                        hi = std::max(hi, row[lx]);
+                    }
+                }
+                const double reach = bound + tolerance + adaptive_margin;
+                if (!threshold_between(lo - reach, hi + reach))
+                    continue;
+            }
+
+            for (int ly=cy*spacing; ly<(cy + 1)*spacing; ly++) {
+                for (int lx=cx*spacing; lx<(cx + 1)*spacing; lx++) {
+                    const std::size_t i =
+                        static_cast<std::size_t>(ly) * tile_size + lx;
+                    /* Lattice points and the centre are already exact */
+                    if (i == mid || (ly % spacing == 0 && lx % spacing == 0))
+                        continue;
+                    xs.push_back(x0 + lx);
+                    ys.push_back(y0 + ly);
+                    where.push_back(static_cast<int>(i));
+                }
+            }
+        }
+    }
+    evaluate();
+    evaluated += values.size();
+    for (std::size_t k=0; k<where.size(); k++)
+        heights[where[k]] = values[k];
+    return evaluated;
+}
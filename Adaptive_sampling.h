@@ -0,0 +1,92 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Adaptive_sampling.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Sampling of low frequency noise on a coarse lattice.
+    Heights between lattice points are interpolated bicubically, and the
+    cells where that could be wrong are evaluated exactly: those whose
+    measured error is over a tolerance, and those whose heights come close
+    enough to a biome threshold that the error could change a biome. The
+    error is measured, not bounded, so heights are approximate and biomes
+    can in principle still differ from a full evaluation.
+*/
+#ifndef ADAPTIVE_SAMPLING_H
+#define ADAPTIVE_SAMPLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "Perlin_noise_generator.h"
+
+/**
+ * Tolerance used when adaptive sampling is turned on without giving one
+ */
+constexpr double default_adaptive_tolerance = 1.0 / 64;
+
+/**
+ * Bump this whenever sample_adaptive() gives different heights, so tiles
+ * cached by older versions are never used.
+ */
+constexpr std::uint32_t adaptive_sampling_version = 2;
+
+/**
+ * Added to the measured error of a cell when deciding if it is close to
+ * a biome threshold. Covers the rounding of heights stored as half and
+ * error the single check of a cell misses.
+ */
+constexpr double adaptive_margin = 0.002;
+
+/**
+ * Evaluates exact heights (noise/2 + 0.5) at n points.
+ * \param x, y The points in pixel coordinates.
+ * \param out Where to put the n heights.
+ */
+typedef std::function<void(const double* x, const double* y, std::size_t n,
+    double* out)> Height_sampler;
+
+/**
+ * Choose the spacing of the lattice for s.adaptive_tolerance. Trailing
+ * octaves whose amplitudes add up to no more than the tolerance are left
+ * to the error checks, and the lattice is half the wavelength of the
+ * finest octave left.
+ * \return The spacing in pixels, or 0 if s shouldn't be sampled
+ * adaptively: it isn't turned on, s has a graph or a whole map engine, or
+ * the lattice would be too fine to save any work.
+ */
+int adaptive_spacing(const Noise_settings& s);
+
+/**
+ * Sample the heights of a tile adaptively.
+ * \param exact Gives the exact heights of the noise.
+ * \param x0, y0 The pixel coordinates of the top left of the tile.
+ * \param spacing The lattice spacing from adaptive_spacing().
+ * \param tolerance Cells with a larger error are evaluated exactly, and
+ * it is allowed for on top of the error of the rest.
+ * \param heights Where to put the tile_area heights, row major.
+ * \return The number of points evaluated exactly.
+ */
+std::size_t sample_adaptive(const Height_sampler& exact, int x0, int y0,
+    int spacing, double tolerance, double* heights);
+#endif
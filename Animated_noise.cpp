@@ -0,0 +1,341 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Animated_noise.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Gradient noise animated in z, see Animated_noise.h
+*/
+#include "Animated_noise.h"
+#include "Biome.h"
+#include "Gradient_noise.h"
+#include "Parallel_for.h"
+#include <algorithm>
+#include <cmath>
+
+constexpr std::int32_t Animated_noise::none_z;
+
+/** Rows of a frame or plane given to each thread at least */
+static constexpr std::size_t rows_per_chunk = 8;
+
+/** Samples of a row worked on at once. The runs are in arrays on the
+    stack so the compiler knows they don't overlap, and always this long so
+    it vectorizes them without a scalar tail */
+static constexpr int run_size = 64;
+
+/**
+ * Evaluate p and c of rows [begin, end) of the plane at lattice z of one
+ * octave. Like fbm_row_f32() the sums are in float, measured from the
+ * lattice cell of the first sample so large coordinates keep precision.
+ */
+template<NOISE_QUALITY Q>
+static void plane_rows(double x0, double y0, double step_x, double step_y,
+    int stride, double frequency, std::int32_t seed, std::int32_t z,
+    int begin, int end, float* p, float* c)
+{
+    const std::uint32_t hz = static_cast<std::uint32_t>(z) * lattice_z_prime
+        ^ static_cast<std::uint32_t>(seed) * lattice_seed_prime;
+    const double xs = frequency * x0;
+    const std::int32_t xb = noise_floor(xs);
+    const float fx0 = static_cast<float>(xs - xb);
+    const float fstep = static_cast<float>(frequency * step_x);
+    auto lerp = [](float a, float b, float t) {return a + t * (b - a);};
+    float pv[run_size], cv[run_size];
+
+    for (int j=begin; j<end; j++) {
+        const double y = frequency * (y0 + j * step_y);
+        const std::int32_t yi = noise_floor(y);
+        const float fy = static_cast<float>(y - yi);
+        const float v = noise_curve<Q>(fy);
+        const std::uint32_t hy0 = static_cast<std::uint32_t>(yi)
+            * lattice_y_prime ^ hz;
+        const std::uint32_t hy1 = static_cast<std::uint32_t>(yi + 1)
+            * lattice_y_prime ^ hz;
+        float* prow = p + static_cast<std::size_t>(j) * stride;
+        float* crow = c + static_cast<std::size_t>(j) * stride;
+
+        for (int r=0; r<stride; r+=run_size) {
+            for (int i=0; i<run_size; i++) {
+                const float local = fx0 + fstep * static_cast<float>(r + i);
+                const std::int32_t k = noise_floor(local);
+                const float fx = local - static_cast<float>(k);
+                const float u = noise_curve<Q>(fx);
+                const std::uint32_t hx0 = static_cast<std::uint32_t>(xb + k)
+                    * lattice_x_prime;
+                const std::uint32_t hx1 = hx0 + lattice_x_prime;
+                const std::uint32_t h00 = lattice_mix(hx0 ^ hy0);
+                const std::uint32_t h01 = lattice_mix(hx1 ^ hy0);
+                const std::uint32_t h10 = lattice_mix(hx0 ^ hy1);
+                const std::uint32_t h11 = lattice_mix(hx1 ^ hy1);
+
+                /* The gradient at each corner splits into its part in the
+                   plane and its z component */
+                pv[i] = lerp(
+                    lerp(lattice_gradient(h00, fx, fy, 0.0f),
+                        lattice_gradient(h01, fx - 1.0f, fy, 0.0f), u),
+                    lerp(lattice_gradient(h10, fx, fy - 1.0f, 0.0f),
+                        lattice_gradient(h11, fx - 1.0f, fy - 1.0f, 0.0f), u),
+                    v);
+                cv[i] = lerp(
+                    lerp(lattice_gradient(h00, 0.0f, 0.0f, 1.0f),
+                        lattice_gradient(h01, 0.0f, 0.0f, 1.0f), u),
+                    lerp(lattice_gradient(h10, 0.0f, 0.0f, 1.0f),
+                        lattice_gradient(h11, 0.0f, 0.0f, 1.0f), u),
+                    v);
+            }
+            std::copy(pv, pv + run_size, prow + r);
+            std::copy(cv, cv + run_size, crow + r);
+        }
+    }
+}
+
+/**
+ * \return The s-curve of quality q at t.
+ */
+static double depth_curve(NOISE_QUALITY q, double t)
+{
+    switch (q) {
+    case NOISE_QUALITY::fast:     return noise_curve<NOISE_QUALITY::fast>(t);
+    case NOISE_QUALITY::standard:
+        return noise_curve<NOISE_QUALITY::standard>(t);
+    case NOISE_QUALITY::best:     return noise_curve<NOISE_QUALITY::best>(t);
+    }
+    return t;
+}
+
+Animated_noise::Animated_noise()
+    :view_x{0.0}, view_y{0.0}, view_step_x{1.0}, view_step_y{1.0}, w{0},
+    h{0}, stride{0}, last_z{0.0}, have_last_z{false}, last_rows{0}
+{
+}
+
+void Animated_noise::set_noise(const Noise_settings& s)
+{
+    if (s.frequency == noise.frequency && s.seed == noise.seed
+        && s.octaves == noise.octaves && s.persistence == noise.persistence
+        && s.lacunarity == noise.lacunarity && s.quality == noise.quality
+        && !octaves.empty())
+        return;
+    noise = s;
+    reset();
+}
+
+void Animated_noise::set_view(double x0, double y0, double step_x,
+    double step_y, int width, int height)
+{
+    if (x0 == view_x && y0 == view_y && step_x == view_step_x
+        && step_y == view_step_y && width == w && height == h
+        && !octaves.empty())
+        return;
+    view_x = x0;
+    view_y = y0;
+    view_step_x = step_x;
+    view_step_y = step_y;
+    w = std::max(width, 0);
+    h = std::max(height, 0);
+    reset();
+}
+
+void Animated_noise::reset()
+{
+    stride = (w + run_size - 1) / run_size * run_size;
+    const std::size_t n = static_cast<std::size_t>(stride) * h;
+    octaves.resize(std::max(noise.octaves, 1));
+    double frequency = noise.frequency;
+    double depth_scale = 1.0;
+    double amplitude = 1.0;
+    for (std::size_t k=0; k<octaves.size(); k++) {
+        Octave& o = octaves[k];
+        o.frequency = frequency;
+        o.depth_scale = depth_scale;
+        o.amplitude = amplitude;
+        o.seed = noise.seed + static_cast<std::int32_t>(k);
+        for (Plane& plane : o.planes) {
+            plane.z = none_z;
+            plane.rows_done = 0;
+            plane.p.resize(n);
+            plane.c.resize(n);
+        }
+        frequency *= noise.lacunarity;
+        depth_scale *= noise.lacunarity;
+        amplitude *= noise.persistence;
+    }
+    frame.resize(static_cast<std::size_t>(w) * h);
+    have_last_z = false;
+}
+
+void Animated_noise::evaluate_rows(const Octave& o, Plane& plane, int begin,
+    int end)
+{
+    if (end <= begin)
+        return;
+    /* noise::NoiseQuality and NOISE_QUALITY are in the same order */
+    const NOISE_QUALITY q = static_cast<NOISE_QUALITY>(noise.quality);
+    parallel_for(begin, end, [&](std::size_t first, std::size_t last) {
+        const int b = static_cast<int>(first);
+        const int e = static_cast<int>(last);
+        switch (q) {
+        case NOISE_QUALITY::fast:
+            plane_rows<NOISE_QUALITY::fast>(view_x, view_y, view_step_x,
+                view_step_y, stride, o.frequency, o.seed, plane.z, b, e,
+                plane.p.data(), plane.c.data());
+            break;
+        case NOISE_QUALITY::standard:
+            plane_rows<NOISE_QUALITY::standard>(view_x, view_y, view_step_x,
+                view_step_y, stride, o.frequency, o.seed, plane.z, b, e,
+                plane.p.data(), plane.c.data());
+            break;
+        case NOISE_QUALITY::best:
+            plane_rows<NOISE_QUALITY::best>(view_x, view_y, view_step_x,
+                view_step_y, stride, o.frequency, o.seed, plane.z, b, e,
+                plane.p.data(), plane.c.data());
+            break;
+        }
+    }, rows_per_chunk);
+    plane.rows_done = std::max(plane.rows_done, end);
+    last_rows += end - begin;
+}
+
+Animated_noise::Plane& Animated_noise::ready_plane(Octave& o, std::int32_t z,
+    std::int32_t keep)
+{
+    Plane* found = NULL;
+    for (Plane& plane : o.planes)
+        if (plane.z == z)
+            found = &plane;
+    if (found == NULL) {
+        /* Reuse the plane furthest from z that isn't needed */
+        for (Plane& plane : o.planes) {
+            if (plane.z == keep)
+                continue;
+            if (found == NULL || plane.z == none_z
+                || (found->z != none_z && std::llabs(
+                    static_cast<long long>(plane.z) - z) > std::llabs(
+                    static_cast<long long>(found->z) - z)))
+                found = &plane;
+        }
+        found->z = z;
+        found->rows_done = 0;
+    }
+    evaluate_rows(o, *found, found->rows_done, h);
+    return *found;
+}
+
+void Animated_noise::advance(double z)
+{
+    last_rows = 0;
+    if (w == 0 || h == 0)
+        return;
+
+    const double moved = (have_last_z ? z - last_z : 0.0);
+    const NOISE_QUALITY q = static_cast<NOISE_QUALITY>(noise.quality);
+
+    /* The weights of each plane in this frame: the blend of the two
+       planes, times p + c * (z - plane) */
+    const std::size_t num = octaves.size();
+    std::vector<const float*> p0(num), c0(num), p1(num), c1(num);
+    std::vector<float> wp0(num), wc0(num), wp1(num), wc1(num);
+    for (std::size_t k=0; k<num; k++) {
+        Octave& o = octaves[k];
+        const double depth = z * o.depth_scale;
+        const std::int32_t below = noise_floor(depth);
+        const double t = depth - below;
+
+        Plane& a = ready_plane(o, below, below + 1);
+        Plane& b = ready_plane(o, below + 1, below);
+
+        /* Evaluate the plane after the next a share of its rows each
+           frame, so it is done by the time z gets there */
+        const bool forward = moved >= 0.0;
+        const std::int32_t next = (forward ? below + 2 : below - 1);
+        Plane* spare = NULL;
+        for (Plane& plane : o.planes)
+            if (&plane != &a && &plane != &b)
+                spare = &plane;
+        if (spare->z != next) {
+            spare->z = next;
+            spare->rows_done = 0;
+        }
+        const double step = std::fabs(moved) * o.depth_scale;
+        if (step > 0.0 && spare->rows_done < h) {
+            const double left = (forward ? 1.0 - t : t);
+            const double frames = std::max(1.0, std::floor(left / step));
+            const int rows = static_cast<int>(std::ceil(
+                (h - spare->rows_done) / frames));
+            evaluate_rows(o, *spare, spare->rows_done,
+                std::min(h, spare->rows_done + rows));
+        }
+
+        const double blend = depth_curve(q, t);
+        p0[k] = a.p.data();
+        c0[k] = a.c.data();
+        p1[k] = b.p.data();
+        c1[k] = b.c.data();
+        wp0[k] = static_cast<float>(o.amplitude * (1.0 - blend));
+        wc0[k] = static_cast<float>(o.amplitude * (1.0 - blend) * t);
+        wp1[k] = static_cast<float>(o.amplitude * blend);
+        wc1[k] = static_cast<float>(o.amplitude * blend * (t - 1.0));
+    }
+    last_z = z;
+    have_last_z = true;
+
+    /* Thresholds as floats, a sample's biome is one more than the number
+       it is at or above, which vectorizes where classify_height() doesn't */
+    float thresholds[num_biome_thresholds];
+    for (int i=0; i<num_biome_thresholds; i++)
+        thresholds[i] = static_cast<float>(biome_thresholds[i]);
+
+    parallel_for(0, h, [&](std::size_t first, std::size_t last) {
+        float sum[run_size];
+        int biomes[run_size];
+        for (std::size_t j=first; j<last; j++) {
+            for (int r=0; r<w; r+=run_size) {
+                const std::size_t at = j * stride + r;
+                for (int i=0; i<run_size; i++)
+                    sum[i] = 0.0f;
+                for (std::size_t k=0; k<num; k++) {
+                    const float* a = p0[k] + at;
+                    const float* b = c0[k] + at;
+                    const float* c = p1[k] + at;
+                    const float* d = c1[k] + at;
+                    const float ka = wp0[k], kb = wc0[k];
+                    const float kc = wp1[k], kd = wc1[k];
+                    for (int i=0; i<run_size; i++)
+                        sum[i] += ka * a[i] + kb * b[i] + kc * c[i]
+                            + kd * d[i];
+                }
+                for (int i=0; i<run_size; i++) {
+                    const float height = sum[i] * 0.5f + 0.5f;
+                    int biome = 1;
+                    for (int t=0; t<num_biome_thresholds; t++)
+                        biome += (height >= thresholds[t]);
+                    biomes[i] = biome;
+                }
+                std::uint8_t* out = frame.data() + j * w + r;
+                const int m = std::min(run_size, w - r);
+                for (int i=0; i<m; i++)
+                    out[i] = static_cast<std::uint8_t>(biomes[i]);
+            }
+        }
+    }, rows_per_chunk);
+}
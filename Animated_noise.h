@@ -0,0 +1,138 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Animated_noise.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Gradient noise animated by moving through its third
+    dimension, for maps that change over time such as weather or shifting
+    sands. Only the visible part of the map is evaluated, a sample per
+    screen pixel, and most of the work of each frame is kept for the next.
+*/
+#ifndef ANIMATED_NOISE_H
+#define ANIMATED_NOISE_H
+
+#include <cstdint>
+#include <vector>
+#include "Perlin_noise_generator.h"
+
+/**
+ * Octaves of fbm noise over a grid of samples at a depth z that can
+ * change every frame.
+ *
+ * Within one lattice cell in z, an octave of gradient noise is a blend of
+ * the two lattice planes either side of z, and each plane contributes
+ * p + c * (z - plane) at every sample, where p and c only depend on x and
+ * y. Those are kept for each octave, so a frame costs four multiply-adds
+ * per sample per octave. A plane is only evaluated when z moves into a
+ * new cell, and the plane after that is evaluated a few rows a frame
+ * ahead of time, so no single frame has to evaluate a whole plane.
+ */
+class Animated_noise {
+public:
+    Animated_noise();
+
+    /**
+     * Set the noise to animate, the frequency, seed, octaves, persistence,
+     * lacunarity and quality are used as the gradient engine uses them.
+     * Every plane is thrown away if they changed.
+     */
+    void set_noise(const Noise_settings& s);
+
+    /**
+     * Set the samples of a frame, every plane is thrown away if they
+     * changed.
+     * \param x0, y0 The map pixel of the top left sample.
+     * \param step_x, step_y The map pixels between samples.
+     * \param w, h The number of samples across and down.
+     */
+    void set_view(double x0, double y0, double step_x, double step_y,
+        int w, int h);
+
+    /**
+     * Make the frame at depth z. At z = 0.5 the frame is the gradient
+     * engine's map, to float precision.
+     */
+    void advance(double z);
+
+    int width() const {return w;}
+    int height() const {return h;}
+
+    /**
+     * \return The BIOME of every sample of the last frame, row major.
+     */
+    const std::vector<std::uint8_t>& biomes() const {return frame;}
+
+    /**
+     * \return The number of plane rows evaluated by the last advance().
+     */
+    long rows_evaluated() const {return last_rows;}
+
+private:
+    /**
+     * p and c of every sample at one lattice plane of an octave
+     */
+    struct Plane {
+        std::int32_t z;         /**< Which plane, none_z if unused */
+        int rows_done;          /**< Rows of p and c evaluated so far */
+        std::vector<float> p;
+        std::vector<float> c;
+    };
+
+    struct Octave {
+        double frequency;       /**< Of x and y */
+        double depth_scale;     /**< z is multiplied by this */
+        double amplitude;
+        std::int32_t seed;
+        Plane planes[3];        /**< Either side of z, and the next */
+    };
+
+    static constexpr std::int32_t none_z = INT32_MIN;
+
+    Noise_settings noise;
+    double view_x, view_y, view_step_x, view_step_y;
+    int w, h;
+    int stride;             /**< Samples a row of a plane, w rounded up */
+    std::vector<Octave> octaves;
+    std::vector<std::uint8_t> frame;
+    double last_z;
+    bool have_last_z;
+    long last_rows;
+
+    /**
+     * Throw away every plane and size them for the view.
+     */
+    void reset();
+
+    /**
+     * Evaluate rows [begin, end) of a plane, in parallel.
+     */
+    void evaluate_rows(const Octave& o, Plane& plane, int begin, int end);
+
+    /**
+     * \return The plane at z of octave o, finished. If none has it, a
+     * plane that isn't at keep is evaluated.
+     */
+    Plane& ready_plane(Octave& o, std::int32_t z, std::int32_t keep);
+};
+#endif
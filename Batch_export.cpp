@@ -0,0 +1,290 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Batch_export.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Generating many maps in one run, see Batch_export.h
+*/
+#include "Batch_export.h"
+#include "Logger.h"
+#include "Noise_graph.h"
+#include "Tile_buffer_pool.h"
+#include "Tile_data.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+/**
+ * \return value read as a T. Throws if it isn't one, or if anything
+ * follows it.
+ */
+template<typename T>
+static T parse_value(const std::string& name, const std::string& value)
+{
+    std::istringstream in{value};
+    T v;
+    if (!(in >> v) || !in.eof())
+        throw std::invalid_argument("Bad value for " + name + ": " + value);
+    return v;
+}
+
+/**
+ * Apply one name=value setting of a job
+ * \param first_seed, last_seed Set to the range of seeds to generate.
+ */
+static void apply_setting(Batch_job& job, const std::string& name,
+    const std::string& value, int& first_seed, int& last_seed)
+{
+    if (name == "seed") {
+        const std::size_t dots = value.find("..");
+        first_seed = parse_value<int>(name, value.substr(0, dots));
+        last_seed = (dots == std::string::npos ? first_seed
+            : parse_value<int>(name, value.substr(dots + 2)));
+        if (last_seed < first_seed)
+            throw std::invalid_argument("Empty seed range: " + value);
+        if (static_cast<long long>(last_seed) - first_seed >= max_batch_seeds)
+            throw std::invalid_argument("More than "
+                + std::to_string(max_batch_seeds) + " seeds: " + value);
+    }
+    else if (name == "size") {
+        const std::size_t x = value.find('x');
+        if (x == std::string::npos)
+            throw std::invalid_argument("Size must be WxH: " + value);
+        job.settings.width = parse_value<int>(name, value.substr(0, x));
+        job.settings.height = parse_value<int>(name, value.substr(x + 1));
+    }
+    else if (name == "frequency") {
+        job.noise.frequency = parse_value<double>(name, value);
+        if (!(job.noise.frequency > 0.0))
+            throw std::invalid_argument("Frequency must be above 0: "
+                + value);
+    }
+    else if (name == "octaves") {
+        job.noise.octaves = parse_value<int>(name, value);
+    }
+    else if (name == "persistence") {
+        job.noise.persistence = parse_value<double>(name, value);
+        if (!(job.noise.persistence > 0.0))
+            throw std::invalid_argument("Persistence must be above 0: "
+                + value);
+    }
+    else if (name == "lacunarity") {
+        job.noise.lacunarity = parse_value<double>(name, value);
+        if (!(job.noise.lacunarity > 0.0))
+            throw std::invalid_argument("Lacunarity must be above 0: "
+                + value);
+    }
+    else if (name == "adaptive") {
+        job.noise.adaptive_tolerance = parse_value<double>(name,
+            value);
+    }
+    else if (name == "engine") {
+        bool found = false;
+        for (int e=0; e<num_noise_engines; e++) {
+            if (value == noise_engine_name(static_cast<NOISE_ENGINE>(e))) {
+                job.noise.engine = static_cast<NOISE_ENGINE>(e);
+                found = true;
+            }
+        }
+        if (!found)
+            throw std::invalid_argument("Unknown engine: " + value);
+    }
+    else if (name == "format") {
+        bool found = false;
+        for (int f=0; f<4; f++) {
+            if (value == height_format_name(static_cast<HEIGHT_FORMAT>(f))) {
+                job.settings.format = static_cast<HEIGHT_FORMAT>(f);
+                found = true;
+            }
+        }
+        if (!found)
+            throw std::invalid_argument("Unknown format: " + value);
+    }
+    else if (name == "graph") {
+        std::ifstream in{value};
+        std::ostringstream text;
+        if (!(text << in.rdbuf()))
+            throw std::invalid_argument("Can't read graph: " + value);
+        job.noise.graph = std::make_shared<const Noise_kernel>(
+            Noise_graph::parse(text.str()));
+    }
+    else {
+        throw std::invalid_argument("Unknown setting: " + name);
+    }
+}
+
+std::vector<Batch_job> read_batch_jobs(const std::string& filename,
+    const Noise_settings& noise, const Stream_settings& settings)
+{
+    std::ifstream in{filename};
+    if (!in)
+        throw std::runtime_error("Failed to open job list: " + filename);
+
+    std::vector<Batch_job> jobs;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)) {
+        line_number++;
+        std::istringstream words{line};
+        Batch_job job;
+        if (!(words >> job.output) || job.output[0] == '#')
+            continue;
+        job.noise = noise;
+        job.settings = settings;
+
+        int first_seed = noise.seed;
+        int last_seed = noise.seed;
+        std::string word;
+        try {
+            while (words >> word) {
+                const std::size_t equals = word.find('=');
+                if (equals == std::string::npos)
+                    throw std::invalid_argument("Expected name=value: "
+                        + word);
+                apply_setting(job, word.substr(0, equals),
+                    word.substr(equals + 1), first_seed, last_seed);
+            }
+        }
+        catch (std::logic_error& e) {
+            throw std::runtime_error(filename + ":"
+                + std::to_string(line_number) + ": " + e.what());
+        }
+
+        const std::size_t mark = job.output.find("{seed}");
+        if (last_seed != first_seed && mark == std::string::npos) {
+            throw std::runtime_error(filename + ":"
+                + std::to_string(line_number)
+                + ": A range of seeds needs {seed} in the file name");
+        }
+        /* Stopped at last_seed rather than past it, which may be
+           INT_MAX */
+        for (int seed=first_seed; ; seed++) {
+            Batch_job j = job;
+            j.noise.seed = seed;
+            if (mark != std::string::npos)
+                j.output.replace(mark, 6, std::to_string(seed));
+            jobs.push_back(j);
+            if (seed == last_seed)
+                break;
+        }
+    }
+    return jobs;
+}
+
+std::vector<Batch_result> run_batch(const std::vector<Batch_job>& jobs,
+    const Batch_settings& s)
+{
+    std::vector<Batch_result> results(jobs.size());
+    unsigned maps = (s.maps_at_once > 0 ? s.maps_at_once
+        : std::max(1u, std::thread::hardware_concurrency()));
+    maps = static_cast<unsigned>(std::min<std::size_t>(maps,
+        std::max<std::size_t>(jobs.size(), 1)));
+
+    /* Each map gets an even share of the budget, and the pool holds what
+       they can use between them */
+    const std::size_t per_map = s.memory_budget / maps;
+    Tile_buffer_pool buffers{s.memory_budget
+        / (Tile_data{HEIGHT_FORMAT::float64}.bytes() + sizeof(Tile_data))};
+    if (s.progress != NULL)
+        s.progress->start(jobs.size());
+
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]() {
+        for (std::size_t i=next++; i<jobs.size(); i=next++) {
+            const Batch_job& job = jobs[i];
+            Stream_settings settings = job.settings;
+            settings.memory_budget = per_map;
+            settings.buffers = &buffers;
+            settings.threads = 0;
+            settings.progress = NULL;
+
+            auto start = std::chrono::steady_clock::now();
+            try {
+                stream_export(job.noise, settings, job.output);
+            }
+            catch (std::exception& e) {
+                results[i].error = e.what();
+                LOG("Failed " + job.output + ": " + e.what());
+            }
+            std::chrono::duration<double> taken =
+                std::chrono::steady_clock::now() - start;
+            results[i].seconds = taken.count();
+            if (s.progress != NULL) {
+                s.progress->add(1, static_cast<std::uint64_t>(
+                    job.settings.width) * job.settings.height);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned m=1; m<maps; m++)
+        workers.emplace_back(worker);
+    worker();
+    for (auto& w : workers)
+        w.join();
+    return results;
+}
+
+void write_manifest(const std::string& filename,
+    const std::vector<Batch_job>& jobs,
+    const std::vector<Batch_result>& results, double seconds)
+{
+    std::ofstream out{filename, std::ofstream::out|std::ofstream::trunc};
+    if (!out)
+        throw std::runtime_error("Failed to open manifest: " + filename);
+
+    std::size_t failed = 0;
+    double pixels = 0.0;
+    for (std::size_t i=0; i<jobs.size(); i++) {
+        if (results[i].error.empty())
+            pixels += static_cast<double>(jobs[i].settings.width)
+                * jobs[i].settings.height;
+        else
+            failed++;
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "# " << jobs.size() << " maps, " << failed << " failed, "
+        << seconds << "s, " << pixels / 1e6 / std::max(seconds, 1e-9)
+        << " Mpx/s\n";
+    out << "# output seed width height engine frequency octaves seconds"
+        << " status\n";
+    for (std::size_t i=0; i<jobs.size(); i++) {
+        const Batch_job& j = jobs[i];
+        out << j.output << ' ' << j.noise.seed << ' ' << j.settings.width
+            << ' ' << j.settings.height << ' '
+            << (j.noise.graph ? "graph" : noise_engine_name(j.noise.engine))
+            << ' ' << std::setprecision(6) << j.noise.frequency << ' '
+            << j.noise.octaves << ' ' << std::setprecision(3)
+            << results[i].seconds << ' '
+            << (results[i].error.empty() ? "ok" : "failed") << '\n';
+    }
+    if (!out)
+        throw std::runtime_error("Failed to write manifest: " + filename);
+}
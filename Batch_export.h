@@ -0,0 +1,105 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Batch_export.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Generating many maps in one run from a list of jobs, a
+    few maps at a time. The maps share the thread pool and a bounded pool
+    of tile buffers, and a manifest records how long each one took.
+*/
+#ifndef BATCH_EXPORT_H
+#define BATCH_EXPORT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Perlin_noise_generator.h"
+#include "Progress.h"
+#include "Stream_export.h"
+
+/**
+ * One map to generate
+ */
+struct Batch_job {
+    std::string output;         /**< The file to write */
+    Noise_settings noise;
+    Stream_settings settings;   /**< Size and format of the map */
+};
+
+/**
+ * Seeds one line of a job list can range over, each is a job held in
+ * memory until the list is run
+ */
+constexpr long max_batch_seeds = 100000;
+
+/**
+ * Read a job list. Each line is the file to write followed by settings
+ * that differ from the defaults, blank lines and lines starting with #
+ * are skipped:
+ *
+ *     maps/island_{seed}.bmp seed=0..99 size=1024x1024 octaves=4
+ *
+ * The settings are seed, size (WxH), frequency, octaves, persistence,
+ * lacunarity, engine, format, adaptive and graph (a file). A seed of
+ * first..last is a job per seed, with {seed} in the file replaced, and
+ * spans at most max_batch_seeds.
+ * Throws naming the line of the first bad setting.
+ * \param filename The job list.
+ * \param noise, settings The defaults of every job.
+ */
+std::vector<Batch_job> read_batch_jobs(const std::string& filename,
+    const Noise_settings& noise, const Stream_settings& settings);
+
+struct Batch_settings {
+    std::size_t memory_budget = 256u << 20; /**< Bytes of tile buffers
+                                                shared by every map */
+    unsigned maps_at_once = 0;  /**< 0 for one per hardware thread */
+    Progress* progress = NULL;  /**< If not NULL, started and counted in
+                                    maps */
+};
+
+/**
+ * How one map went
+ */
+struct Batch_result {
+    double seconds = 0.0;       /**< Time taken to generate and write it */
+    std::string error;          /**< Empty if the map was written */
+};
+
+/**
+ * Generate every job. A map that fails doesn't stop the others.
+ * \return The result of each job, in the order of jobs.
+ */
+std::vector<Batch_result> run_batch(const std::vector<Batch_job>& jobs,
+    const Batch_settings& s);
+
+/**
+ * Write a line per map, with its settings, time taken and whether it
+ * failed, after a summary of the whole run.
+ * \param seconds The time the whole run took.
+ */
+void write_manifest(const std::string& filename,
+    const std::vector<Batch_job>& jobs,
+    const std::vector<Batch_result>& results, double seconds);
+#endif
@@ -25,10 +25,86 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef BIOME_H
 #define BIOME_H
 
+#include <cstdint>
+
 /**
  * Different biomes that can be in our map
  */
 enum class BIOME {
     empty, deep_sea, shore, beach, grassland, woodland, mountain, snow
 };
+
+constexpr int num_biomes = 8;   /**< Number of values in BIOME */
+
+/**
+ * The colour a biome is drawn with
+ */
+struct Biome_color {
+    std::uint8_t r;
+    std::uint8_t g;
+    std::uint8_t b;
+};
+
+/**
+ * \return The colour biome b is drawn with by default.
+ */
+inline Biome_color default_biome_color(BIOME b)
+{
+    switch (b) {
+    case BIOME::deep_sea:   return Biome_color{0, 0, 130};
+    case BIOME::shore:      return Biome_color{0, 0, 227};
+    case BIOME::beach:      return Biome_color{240, 255, 140};
+    case BIOME::grassland:  return Biome_color{0, 175, 0};
+    case BIOME::woodland:   return Biome_color{0, 145, 0};
+    case BIOME::mountain:   return Biome_color{140, 140, 140};
+    case BIOME::snow:       return Biome_color{240, 240, 240};
+    default:                return Biome_color{0, 0, 0};
+    }
+}
+
+/**
+ * \return A printable name for the biome b.
+ */
+inline const char* biome_name(BIOME b)
+{
+    switch (b) {
+    case BIOME::empty:      return "empty";
+    case BIOME::deep_sea:   return "deep_sea";
+    case BIOME::shore:      return "shore";
+    case BIOME::beach:      return "beach";
+    case BIOME::grassland:  return "grassland";
+    case BIOME::woodland:   return "woodland";
+    case BIOME::mountain:   return "mountain";
+    case BIOME::snow:       return "snow";
+    }
+    return "unknown";
+}
+
+constexpr int num_biome_thresholds = 6;
+
+/**
+ * Heights below biome_thresholds[i] (and above the previous threshold) are
+ * the biome BIOME(i + 1), heights above the last threshold are snow.
+ */
+constexpr double biome_thresholds[num_biome_thresholds] = {
+    0.55,       //Deep sea
+    0.57,       //If under water table
+    0.59,       //sand beaches
+    0.8,        //grass
+    0.9,        //darker grass
+    0.99999     //rock, snow caps above
+};
+
+/**
+ * \param h A height in [0, 1].
+ * \return The biome found at height h.
+ */
+inline BIOME classify_height(double h)
+{
+    for (int i=0; i<num_biome_thresholds; i++) {
+        if (h < biome_thresholds[i])
+            return static_cast<BIOME>(i + 1);
+    }
+    return BIOME::snow;
+}
 #endif
@@ -0,0 +1,148 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Export_journal.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A journal of the finished tiles of an export, see
+    Export_journal.h
+*/
+#include "Export_journal.h"
+#include "File_util.h"
+#include "Logger.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+/* Version 2 gave bands of rows their own records */
+const std::string journal_magic = "bmg-journal 2 ";
+const std::string band_record = "band";
+
+}
+
+Export_journal::Export_journal(const std::string& output,
+    const std::string& sig)
+    :path{path_for(output)}, signature{sig}, file{NULL}
+{
+    std::ifstream in{path};
+    std::string line;
+    if (!std::getline(in, line) || line != journal_magic + signature
+        || in.eof()) {
+        if (in.is_open())
+            LOG("Journal " + path + " is for another export, starting again");
+        in.close();
+        open_new();
+        return;
+    }
+
+    /* A line without a newline was cut short when the last run was
+       killed, so it and anything after it is ignored */
+    while (std::getline(in, line) && !in.eof()) {
+        std::istringstream fields{line};
+        if (line.compare(0, band_record.size(), band_record) == 0) {
+            std::string name;
+            int band;
+            if (!(fields >> name >> band))
+                break;
+            bands.push_back(band);
+            continue;
+        }
+        Region_tile r;
+        if (!(fields >> r.id.tx >> r.id.ty >> r.entry.offset >> r.entry.size
+            >> r.entry.checksum))
+            break;
+        records.push_back(r);
+    }
+    in.close();
+
+    file = std::fopen(path.c_str(), "ab");
+    if (file == NULL)
+        throw std::runtime_error("Failed to open journal: " + path);
+}
+
+Export_journal::~Export_journal()
+{
+    if (file != NULL)
+        std::fclose(file);
+}
+
+void Export_journal::restart()
+{
+    if (file != NULL)
+        std::fclose(file);
+    file = NULL;
+    records.clear();
+    bands.clear();
+    open_new();
+}
+
+void Export_journal::open_new()
+{
+    file = std::fopen(path.c_str(), "wb");
+    if (file == NULL)
+        throw std::runtime_error("Failed to open journal: " + path);
+    if (std::fprintf(file, "%s%s\n", journal_magic.c_str(),
+        signature.c_str()) < 0)
+        throw std::runtime_error("Failed to write journal: " + path);
+    sync();
+}
+
+void Export_journal::sync()
+{
+    if (!sync_file(file))
+        throw std::runtime_error("Failed to write journal: " + path);
+}
+
+void Export_journal::append(const std::vector<Region_tile>& tiles)
+{
+    if (file == NULL)
+        throw std::runtime_error("Journal already removed: " + path);
+
+    for (const Region_tile& r : tiles) {
+        if (std::fprintf(file, "%d %d %llu %lu %lu\n", r.id.tx, r.id.ty,
+            static_cast<unsigned long long>(r.entry.offset),
+            static_cast<unsigned long>(r.entry.size),
+            static_cast<unsigned long>(r.entry.checksum)) < 0)
+            throw std::runtime_error("Failed to write journal: " + path);
+    }
+    sync();
+}
+
+void Export_journal::append_band(int band)
+{
+    if (file == NULL)
+        throw std::runtime_error("Journal already removed: " + path);
+    if (std::fprintf(file, "%s %d\n", band_record.c_str(), band) < 0)
+        throw std::runtime_error("Failed to write journal: " + path);
+    sync();
+}
+
+void Export_journal::remove()
+{
+    if (file != NULL)
+        std::fclose(file);
+    file = NULL;
+    std::remove(path.c_str());
+}
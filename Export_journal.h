@@ -0,0 +1,113 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Export_journal.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A journal of the tiles or bands of rows of an export that
+    are safely in the output file, kept next to it. If an export is killed
+    the journal tells the next run which it can skip.
+*/
+#ifndef EXPORT_JOURNAL_H
+#define EXPORT_JOURNAL_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Region_file.h"
+
+class Export_journal {
+public:
+    /**
+     * Constructor, opens the journal of an output file. If there is a
+     * journal with the same signature its records are loaded and new ones
+     * are added after them, otherwise a new journal is started.
+     * \param output The file being exported, the journal is output
+     * followed by ".journal".
+     * \param signature One line naming everything that changes the output,
+     * a journal of a different export is never resumed.
+     */
+    Export_journal(const std::string& output, const std::string& signature);
+
+    /**
+     * Closes the journal, it is kept so the export can be resumed.
+     */
+    ~Export_journal();
+
+    Export_journal(const Export_journal&) = delete;
+    Export_journal& operator=(const Export_journal&) = delete;
+
+    /**
+     * \return The tiles recorded by earlier runs.
+     */
+    const std::vector<Region_tile>& completed() const {return records;}
+
+    /**
+     * \return The bands of rows recorded by earlier runs.
+     */
+    const std::vector<int>& completed_bands() const {return bands;}
+
+    /**
+     * Forget the tiles of earlier runs and start the journal again, for
+     * when the output they were written to is gone.
+     */
+    void restart();
+
+    /**
+     * Record tiles as done and sync the journal to disk. Only call once
+     * the tiles themselves have been synced to the output, or the journal
+     * can outlive them when the machine stops.
+     */
+    void append(const std::vector<Region_tile>& tiles);
+
+    /**
+     * Record a band of rows as done, see append().
+     * \param band Which band, counted in tiles from the top.
+     */
+    void append_band(int band);
+
+    /**
+     * Close and delete the journal, once the output is finished.
+     */
+    void remove();
+
+    static std::string path_for(const std::string& output)
+    {
+        return output + ".journal";
+    }
+
+private:
+    std::string path;
+    std::string signature;
+    FILE* file;
+    std::vector<Region_tile> records;
+    std::vector<int> bands;
+
+    void open_new();
+
+    /**
+     * Sync the journal to disk, throws on failure.
+     */
+    void sync();
+};
+#endif
@@ -0,0 +1,105 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: File_util.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Seeking in files larger than 4GB, which std::fseek can not
+    do where long is 32 bits, replacing files in one step and making
+    sure written data is on disk.
+*/
+#ifndef FILE_UTIL_H
+#define FILE_UTIL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Seek to an offset from the start of a file.
+ * \return true on success.
+ */
+inline bool seek_to(FILE* f, std::uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(f, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(f, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+/**
+ * Seek to the end of a file.
+ * \return The size of the file, 0 on failure.
+ */
+inline std::uint64_t seek_to_end(FILE* f)
+{
+#ifdef _WIN32
+    if (_fseeki64(f, 0, SEEK_END) != 0)
+        return 0;
+    return static_cast<std::uint64_t>(_ftelli64(f));
+#else
+    if (fseeko(f, 0, SEEK_END) != 0)
+        return 0;
+    return static_cast<std::uint64_t>(ftello(f));
+#endif
+}
+
+/**
+ * Rename from over to, replacing to if it exists. Readers of to see either
+ * the old file or the new one, never no file.
+ * \return true on success.
+ */
+inline bool replace_file(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(),
+        MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+/**
+ * Flush a file and wait until what was written to it is on disk, so it
+ * survives the machine stopping as well as the program.
+ * \return true on success.
+ */
+inline bool sync_file(FILE* f)
+{
+    if (std::fflush(f) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+#endif
@@ -0,0 +1,371 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Flythrough.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Raw video of a camera flying over a map, see Flythrough.h
+*/
+#include "Flythrough.h"
+#include "Biome.h"
+#include "Generation_job.h"
+#include "Heightfield.h"
+#include "Thread_pool.h"
+#include "Tile_address.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+/**
+ * The map pixels a frame shows, and the tiles under them
+ */
+struct Frame_view {
+    double x0;      /**< Map pixel at the left edge of the frame */
+    double y0;
+    double step;    /**< Map pixels across a frame pixel */
+    int tx0, ty0;   /**< Tiles under the frame, inclusive, empty if */
+    int tx1, ty1;   /**< tx1 < tx0 */
+};
+
+/**
+ * A tile the path needs and the first frame that needs it
+ */
+struct Path_tile {
+    Tile_id id;
+    long frame;
+};
+
+/**
+ * \return The start of a view of length view along a map of length map,
+ * kept inside the map like update_screen_location() does, or centred on
+ * it if the view is longer.
+ */
+static double clamp_view(double centre, double view, int map)
+{
+    if (view >= map)
+        return (map - view) / 2.0;
+    return std::min(std::max(centre - view / 2.0, 0.0), map - view);
+}
+
+static Frame_view view_at(const std::vector<Camera_key>& path, double t,
+    const Flythrough_settings& s)
+{
+    const Camera_key c = camera_at(path, t);
+    Frame_view v;
+    v.step = c.zoom;
+    v.x0 = clamp_view(c.x, s.frame_width * v.step, s.width);
+    v.y0 = clamp_view(c.y, s.frame_height * v.step, s.height);
+
+    const double x1 = std::min(v.x0 + s.frame_width * v.step,
+        static_cast<double>(s.width));
+    const double y1 = std::min(v.y0 + s.frame_height * v.step,
+        static_cast<double>(s.height));
+    v.tx0 = static_cast<int>(std::max(v.x0, 0.0)) >> tile_shift;
+    v.ty0 = static_cast<int>(std::max(v.y0, 0.0)) >> tile_shift;
+    v.tx1 = (static_cast<int>(std::ceil(x1)) - 1) >> tile_shift;
+    v.ty1 = (static_cast<int>(std::ceil(y1)) - 1) >> tile_shift;
+    return v;
+}
+
+/**
+ * Queues the tiles of a path on the thread pool a little ahead of the
+ * frames. The destructor abandons the tiles not yet generated and waits
+ * for those being generated, so none outlive the cache.
+ */
+class Tile_prefetcher {
+public:
+    Tile_prefetcher(Tile_cache& c, std::shared_ptr<const Noise_settings> n,
+        HEIGHT_FORMAT f, std::vector<Path_tile> t)
+        :cache(c), noise{n}, format{f}, tiles(std::move(t)), next{0},
+        job{std::make_shared<Generation_job>(tiles.size())}
+    {
+    }
+
+    ~Tile_prefetcher()
+    {
+        job->cancel();
+        for (; next<tiles.size(); next++)
+            job->tile_skipped();
+        job->wait();
+    }
+
+    Tile_prefetcher(const Tile_prefetcher&) = delete;
+    Tile_prefetcher& operator=(const Tile_prefetcher&) = delete;
+
+    /**
+     * Queue every tile first needed by frame last or earlier.
+     */
+    void queue_until(long last)
+    {
+        std::vector<Thread_pool::Task> tasks;
+        for (; next<tiles.size() && tiles[next].frame<=last; next++) {
+            Tile_cache* c = &cache;
+            std::shared_ptr<const Noise_settings> n = noise;
+            std::shared_ptr<Generation_job> j = job;
+            const HEIGHT_FORMAT f = format;
+            const Tile_id t = tiles[next].id;
+            tasks.push_back([c, n, j, f, t] {
+                /* Every tile must be counted, or the destructor never
+                   returns. A frame that needs a failed tile makes it
+                   itself, and gets the error. */
+                try {
+                    if (!j->cancelled() && c->get(*n, f, t, j.get())) {
+                        j->tile_done(t);
+                        return;
+                    }
+                }
+                catch (std::exception& e) {
+                    j->tile_failed(e.what());
+                    return;
+                }
+                catch (...) {
+                    j->tile_failed("Unknown error");
+                    return;
+                }
+                j->tile_skipped();
+            });
+        }
+        if (!tasks.empty())
+            default_pool().submit(tasks);
+    }
+
+private:
+    Tile_cache& cache;
+    std::shared_ptr<const Noise_settings> noise;
+    HEIGHT_FORMAT format;
+    std::vector<Path_tile> tiles;   /**< In the order they are needed */
+    std::size_t next;               /**< First tile not yet queued */
+    std::shared_ptr<Generation_job> job;
+};
+
+std::vector<Camera_key> read_camera_path(const std::string& filename)
+{
+    std::ifstream in{filename};
+    if (!in)
+        throw std::runtime_error("Failed to open camera path: " + filename);
+
+    std::vector<Camera_key> path;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)) {
+        line_number++;
+        std::istringstream words{line};
+        std::string first;
+        if (!(words >> first) || first[0] == '#')
+            continue;
+
+        auto fail = [&](const std::string& msg) {
+            return std::runtime_error(filename + ":"
+                + std::to_string(line_number) + ": " + msg);
+        };
+        Camera_key k;
+        try {
+            k.time = std::stod(first);
+        }
+        catch (std::logic_error&) {
+            throw fail("Expected seconds, x, y and zoom");
+        }
+        std::string rest;
+        if (!(words >> k.x >> k.y >> k.zoom) || (words >> rest))
+            throw fail("Expected seconds, x, y and zoom");
+        if (!(k.zoom > 0.0))
+            throw fail("Zoom must be above 0");
+        if (!path.empty() && k.time < path.back().time)
+            throw fail("Keys must be in order of time");
+        path.push_back(k);
+    }
+    if (path.empty())
+        throw std::runtime_error("No camera keys in " + filename);
+    return path;
+}
+
+Camera_key camera_at(const std::vector<Camera_key>& path, double t)
+{
+    if (t <= path.front().time)
+        return path.front();
+    if (t >= path.back().time)
+        return path.back();
+
+    std::size_t i = 1;
+    while (path[i].time < t)
+        i++;
+    const Camera_key& a = path[i - 1];
+    const Camera_key& b = path[i];
+    const double span = b.time - a.time;
+    const double w = (span > 0.0 ? (t - a.time) / span : 1.0);
+    auto lerp = [w](double p, double q) {return p + w * (q - p);};
+    return Camera_key{t, lerp(a.x, b.x), lerp(a.y, b.y),
+        lerp(a.zoom, b.zoom)};
+}
+
+Flythrough_stats flythrough(const Noise_settings& noise,
+    const std::vector<Camera_key>& path, const Flythrough_settings& s,
+    Tile_cache& cache, FILE* out)
+{
+    if (path.empty())
+        throw std::runtime_error("A flythrough needs a camera path");
+    if (s.frame_width <= 0 || s.frame_height <= 0 || !(s.fps > 0.0))
+        throw std::runtime_error("Bad frame size or rate");
+
+    std::shared_ptr<Noise_settings> settings =
+        std::make_shared<Noise_settings>(noise);
+    if (whole_map_engine(noise.engine) && !noise.graph)
+        settings->field = make_heightfield(noise, s.width, s.height);
+    const std::uint64_t key = tile_key(*settings, s.format);
+
+    const double duration = path.back().time - path.front().time;
+    const long frames = static_cast<long>(std::floor(duration * s.fps)) + 1;
+    auto frame_time = [&](long f) {return path.front().time + f / s.fps;};
+
+    /* Every tile of the path in the order the camera reaches them, tiles
+       of a frame from its centre out */
+    std::vector<Path_tile> needed;
+    std::unordered_set<std::uint64_t> seen;
+    for (long f=0; f<frames; f++) {
+        const Frame_view v = view_at(path, frame_time(f), s);
+        const double cx = (v.tx0 + v.tx1) / 2.0;
+        const double cy = (v.ty0 + v.ty1) / 2.0;
+        const std::size_t first = needed.size();
+        for (int ty=v.ty0; ty<=v.ty1; ty++) {
+            for (int tx=v.tx0; tx<=v.tx1; tx++) {
+                const std::uint64_t id = (static_cast<std::uint64_t>(
+                    static_cast<std::uint32_t>(tx)) << 32)
+                    | static_cast<std::uint32_t>(ty);
+                if (seen.insert(id).second)
+                    needed.push_back(Path_tile{Tile_id{tx, ty}, f});
+            }
+        }
+        std::sort(needed.begin() + first, needed.end(),
+            [cx, cy](const Path_tile& a, const Path_tile& b) {
+                return std::hypot(a.id.tx - cx, a.id.ty - cy)
+                    < std::hypot(b.id.tx - cx, b.id.ty - cy);
+            });
+    }
+    const long ahead = static_cast<long>(std::ceil(s.lookahead * s.fps));
+    Tile_prefetcher prefetch{cache, settings, s.format, std::move(needed)};
+
+    std::uint8_t rgba[256][4];
+    for (int i=0; i<256; i++) {
+        const Biome_color c = (i < num_biomes ?
+            default_biome_color(static_cast<BIOME>(i)) : Biome_color{0, 0, 0});
+        rgba[i][0] = c.r;
+        rgba[i][1] = c.g;
+        rgba[i][2] = c.b;
+        rgba[i][3] = 255;
+    }
+
+    const std::size_t row_bytes = static_cast<std::size_t>(s.frame_width) * 4;
+    std::vector<std::uint8_t> image(row_bytes * s.frame_height);
+    std::vector<int> map_x(s.frame_width);
+    std::vector<std::shared_ptr<const Tile_data>> tiles;
+    Flythrough_stats stats{0, 0.0, 0.0, 0};
+    if (s.progress != NULL)
+        s.progress->start(static_cast<std::uint64_t>(frames));
+    const auto start = std::chrono::steady_clock::now();
+
+    for (long f=0; f<frames; f++) {
+        const auto frame_start = std::chrono::steady_clock::now();
+        prefetch.queue_until(f + ahead);
+        const Frame_view v = view_at(path, frame_time(f), s);
+
+        /* Tiles the prefetch hasn't finished are generated here */
+        const int across = std::max(v.tx1 - v.tx0 + 1, 0);
+        const int down = std::max(v.ty1 - v.ty0 + 1, 0);
+        tiles.clear();
+        tiles.resize(static_cast<std::size_t>(across) * down);
+        std::atomic<long> waited{0};
+        pool_for(default_pool(), 0, tiles.size(),
+            [&](std::size_t b, std::size_t e) {
+                for (std::size_t i=b; i<e; i++) {
+                    const Tile_id t{v.tx0 + static_cast<int>(i) % across,
+                        v.ty0 + static_cast<int>(i) / across};
+                    tiles[i] = cache.find(key, t);
+                    if (!tiles[i]) {
+                        waited++;
+                        tiles[i] = cache.get(*settings, s.format, t);
+                    }
+                }
+            });
+        stats.tiles_waited += waited;
+
+        /* Nearest map pixel to the centre of each frame pixel, -1 if off
+           the map */
+        for (int i=0; i<s.frame_width; i++) {
+            const double x = std::floor(v.x0 + (i + 0.5) * v.step);
+            map_x[i] = (x >= 0.0 && x < s.width ? static_cast<int>(x) : -1);
+        }
+        pool_for(default_pool(), 0, s.frame_height,
+            [&](std::size_t b, std::size_t e) {
+                for (std::size_t j=b; j<e; j++) {
+                    std::uint8_t* dst = &image[j * row_bytes];
+                    const double y = std::floor(v.y0 + (j + 0.5) * v.step);
+                    if (y < 0.0 || y >= s.height) {
+                        for (int i=0; i<s.frame_width; i++)
+                            std::memcpy(dst + 4 * i, rgba[0], 4);
+                        continue;
+                    }
+                    const int my = static_cast<int>(y);
+                    const std::size_t row = static_cast<std::size_t>(
+                        (my >> tile_shift) - v.ty0) * across;
+                    const std::size_t ly = static_cast<std::size_t>(
+                        my & tile_mask) * tile_size;
+                    for (int i=0; i<s.frame_width; i++) {
+                        const int mx = map_x[i];
+                        std::uint8_t biome = 0;
+                        if (mx >= 0) {
+                            const Tile_data& t = *tiles[row
+                                + (mx >> tile_shift) - v.tx0];
+                            biome = t.biomes[ly + (mx & tile_mask)];
+                        }
+                        std::memcpy(dst + 4 * i, rgba[biome], 4);
+                    }
+                }
+            }, 16);
+
+        if (std::fwrite(image.data(), 1, image.size(), out) != image.size())
+            throw std::runtime_error("Failed to write frame "
+                + std::to_string(f));
+
+        std::chrono::duration<double> taken =
+            std::chrono::steady_clock::now() - frame_start;
+        stats.slowest_frame = std::max(stats.slowest_frame, taken.count());
+        stats.frames++;
+        if (s.progress != NULL)
+            s.progress->add(1, static_cast<std::uint64_t>(s.frame_width)
+                * s.frame_height);
+    }
+    if (std::fflush(out) != 0)
+        throw std::runtime_error("Failed to write frames");
+
+    std::chrono::duration<double> total =
+        std::chrono::steady_clock::now() - start;
+    stats.seconds = total.count();
+    return stats;
+}
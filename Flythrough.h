@@ -0,0 +1,118 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Flythrough.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Renders a camera flying over a map to raw video frames
+    without opening a window, for encoders reading from a pipe. Tiles are
+    generated ahead of the camera along its path so frames come out at a
+    steady rate.
+*/
+#ifndef FLYTHROUGH_H
+#define FLYTHROUGH_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Height_layer.h"
+#include "Perlin_noise_generator.h"
+#include "Progress.h"
+#include "Tile_cache.h"
+
+/**
+ * Where the camera is at one time of a flythrough. Between keys it moves
+ * and zooms in a straight line, as dragging and scrolling the map does.
+ */
+struct Camera_key {
+    double time;    /**< Seconds from the start */
+    double x;       /**< Map pixel at the centre of the frame */
+    double y;
+    double zoom;    /**< Map pixels across a frame pixel, as
+                        Pixel_map::zoom(), > 0 */
+};
+
+/**
+ * Read a camera path. Each line is a key of time, x, y and zoom, in order
+ * of time, blank lines and lines starting with # are skipped:
+ *
+ *     # seconds   x       y       zoom
+ *     0           1000    1000    4
+ *     10          400     700     1
+ *
+ * Throws naming the line of the first bad key.
+ */
+std::vector<Camera_key> read_camera_path(const std::string& filename);
+
+/**
+ * \return The camera at time t of a path, clamped to its first and last
+ * keys.
+ */
+Camera_key camera_at(const std::vector<Camera_key>& path, double t);
+
+struct Flythrough_settings {
+    int width = 2000;           /**< Of the map in pixels */
+    int height = 2000;
+    int frame_width = 1280;     /**< Of each frame in pixels */
+    int frame_height = 720;
+    double fps = 30.0;
+    double lookahead = 1.0;     /**< Seconds of the path ahead of the frame
+                                    being drawn whose tiles are queued */
+    HEIGHT_FORMAT format = HEIGHT_FORMAT::float32;  /**< Of cached tiles */
+    Progress* progress = NULL;  /**< If not NULL, started and counted in
+                                    frames */
+};
+
+/**
+ * Timings of a finished flythrough
+ */
+struct Flythrough_stats {
+    long frames;
+    double seconds;         /**< To draw and write every frame */
+    double slowest_frame;   /**< Seconds */
+    long tiles_waited;      /**< Tiles a frame had to generate itself */
+};
+
+/**
+ * Draw every frame of a camera path and write them to out. Each frame is
+ * frame_width by frame_height pixels of 4 bytes, red, green, blue and
+ * alpha, rows top first, with nothing between frames. The view is kept
+ * inside the map like dragging it is, a view larger than the map is
+ * centred on it, and pixels off the map are black.
+ *
+ * Tiles come from the cache. Those the path needs within the next
+ * lookahead seconds are queued on default_pool() in the order the camera
+ * reaches them, so with enough threads and a cache larger than the
+ * lookahead's tiles the frames never wait for the noise. A whole map
+ * engine first makes the heights of the whole map.
+ * \param noise The noise to generate from.
+ * \param path The camera path, at least one key.
+ * \param s The size of the map and of the frames.
+ * \param cache Where tiles are found and kept.
+ * \param out Where frames are written, such as stdout.
+ * Throws if a frame can not be written.
+ */
+Flythrough_stats flythrough(const Noise_settings& noise,
+    const std::vector<Camera_key>& path, const Flythrough_settings& s,
+    Tile_cache& cache, FILE* out);
+#endif
@@ -0,0 +1,230 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Frame_timer.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Per-frame timing of the main loop, see Frame_timer.h
+*/
+#include "Frame_timer.h"
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+/** Colour of each phase when drawn in the overlay */
+static const SDL_Color phase_colors[] = {
+    {255, 255, 0, 255},     // input
+    {255, 0, 0, 255},       // generation
+    {255, 128, 0, 255},     // render
+    {0, 200, 255, 255},     // show
+    {0, 255, 0, 255},       // present
+    {80, 80, 80, 255}       // idle
+};
+
+const char* phase_name(FRAME_PHASE p)
+{
+    switch (p) {
+    case FRAME_PHASE::input:      return "input";
+    case FRAME_PHASE::generation: return "generation";
+    case FRAME_PHASE::render:     return "render";
+    case FRAME_PHASE::show:       return "show";
+    case FRAME_PHASE::present:    return "present";
+    case FRAME_PHASE::idle:       return "idle";
+    default:                      return "unknown";
+    }
+}
+
+Frame_histogram::Frame_histogram()
+{
+    clear();
+}
+
+void Frame_histogram::add(double ms)
+{
+    if (ms < 0)
+        ms = 0;
+
+    int bucket = static_cast<int>(ms / bucket_width_ms);
+    if (bucket > num_buckets)
+        bucket = num_buckets;
+
+    buckets[bucket]++;
+    samples++;
+    total_ms += ms;
+    if (ms > max_ms)
+        max_ms = ms;
+}
+
+double Frame_histogram::percentile(double p) const
+{
+    if (samples == 0)
+        return 0.0;
+
+    /* The nearest rank: the smallest with at least p% of the samples at
+       or below it, so p100 is the last. The slack stops 0.9 * 10 landing
+       just above 9 and rounding up to 10. */
+    long rank = static_cast<long>(std::ceil(p / 100.0 * samples - 1e-9));
+    if (rank < 1)
+        rank = 1;
+    if (rank > samples)
+        rank = samples;
+
+    long seen = 0;
+    for (int i=0; i<num_buckets; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            double upper = (i + 1) * bucket_width_ms;
+            return (upper < max_ms ? upper : max_ms);
+        }
+    }
+    return max_ms;
+}
+
+void Frame_histogram::clear()
+{
+    for (int i=0; i<=num_buckets; i++)
+        buckets[i] = 0;
+    samples = 0;
+    total_ms = 0.0;
+    max_ms = 0.0;
+}
+
+Frame_timer::Frame_timer()
+    :frame_start{0}, last_mark{0}, history_next{0}
+{
+    ticks_to_ms = 1000.0 / SDL_GetPerformanceFrequency();
+    for (int i=0; i<num_phases; i++)
+        current[i] = 0.0;
+    for (int f=0; f<history_length; f++)
+        for (int i=0; i<num_phases; i++)
+            history[f][i] = 0.0;
+}
+
+void Frame_timer::begin_frame()
+{
+    frame_start = SDL_GetPerformanceCounter();
+    last_mark = frame_start;
+    for (int i=0; i<num_phases; i++)
+        current[i] = 0.0;
+}
+
+void Frame_timer::mark(FRAME_PHASE p)
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    current[static_cast<int>(p)] += (now - last_mark) * ticks_to_ms;
+    last_mark = now;
+}
+
+void Frame_timer::end_frame()
+{
+    double total = 0.0;
+    for (int i=0; i<num_phases; i++) {
+        phases[i].add(current[i]);
+        history[history_next][i] = current[i];
+        if (i != static_cast<int>(FRAME_PHASE::idle))
+            total += current[i];
+    }
+    frames.add(total);
+    history_next = (history_next + 1) % history_length;
+}
+
+void Frame_timer::draw_overlay(SDL_Renderer* r, const SDL_Rect& area) const
+{
+    /* Full height of the overlay is two 60Hz frames */
+    constexpr double scale_ms = 2000.0 / 60.0;
+    const int bar_width = (area.w / history_length > 0 ?
+        area.w / history_length : 1);
+
+    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(r, 0, 0, 0, 160);
+    SDL_RenderFillRect(r, &area);
+
+    for (int f=0; f<history_length; f++) {
+        /* Oldest frame on the left */
+        const double* frame = history[(history_next + f) % history_length];
+        int bottom = area.y + area.h;
+
+        for (int i=0; i<num_phases; i++) {
+            if (i == static_cast<int>(FRAME_PHASE::idle))
+                continue;
+            int h = static_cast<int>(frame[i] / scale_ms * area.h + 0.5);
+            if (h <= 0)
+                continue;
+            if (bottom - h < area.y)
+                h = bottom - area.y;
+
+            SDL_Rect bar{area.x + f*bar_width, bottom - h, bar_width, h};
+            SDL_SetRenderDrawColor(r, phase_colors[i].r, phase_colors[i].g,
+                phase_colors[i].b, phase_colors[i].a);
+            SDL_RenderFillRect(r, &bar);
+            bottom -= h;
+        }
+    }
+
+    /* Guide lines at 60Hz and 30Hz frame times */
+    SDL_SetRenderDrawColor(r, 255, 255, 255, 200);
+    int line_60 = area.y + area.h - area.h / 2;
+    SDL_RenderDrawLine(r, area.x, line_60, area.x + area.w, line_60);
+    SDL_RenderDrawLine(r, area.x, area.y, area.x + area.w, area.y);
+    SDL_SetRenderDrawBlendMode(r, SDL_BLENDMODE_NONE);
+}
+
+void Frame_timer::write_report(const std::string& filename) const
+{
+    std::ofstream out{filename, std::ofstream::out|std::ofstream::trunc};
+    if (!out) {
+        throw std::runtime_error("Failed to open frame report: " + filename);
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "# Frame times in ms, " << frames.count() << " frames\n";
+    out << std::left << std::setw(12) << "phase"
+        << std::right << std::setw(10) << "mean"
+        << std::setw(10) << "p50" << std::setw(10) << "p95"
+        << std::setw(10) << "p99" << std::setw(10) << "max" << '\n';
+
+    auto row = [&out](const char* name, const Frame_histogram& h) {
+        out << std::left << std::setw(12) << name
+            << std::right << std::setw(10) << h.mean()
+            << std::setw(10) << h.percentile(50)
+            << std::setw(10) << h.percentile(95)
+            << std::setw(10) << h.percentile(99)
+            << std::setw(10) << h.max() << '\n';
+    };
+
+    for (int i=0; i<num_phases; i++)
+        row(phase_name(static_cast<FRAME_PHASE>(i)), phases[i]);
+    row("frame", frames);
+}
+
+std::string Frame_timer::summary() const
+{
+    std::ostringstream msg;
+    msg << std::fixed << std::setprecision(1)
+        << "p50: " << frames.percentile(50)
+        << "ms p95: " << frames.percentile(95)
+        << "ms p99: " << frames.percentile(99) << "ms";
+    return msg.str();
+}
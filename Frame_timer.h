@@ -0,0 +1,143 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Frame_timer.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Per-frame timing of the main loop. Each phase of a frame
+    is accumulated into a fixed-size histogram so percentiles can be
+    reported, and the most recent frames can be drawn as an overlay.
+*/
+#ifndef FRAME_TIMER_H
+#define FRAME_TIMER_H
+
+#include <string>
+#include <SDL2/SDL.h>
+
+/**
+ * The phases of a single pass through the main loop.
+ */
+enum class FRAME_PHASE {
+    input, generation, render, show, present, idle, count
+};
+
+/**
+ * \return A printable name for the phase p.
+ */
+const char* phase_name(FRAME_PHASE p);
+
+/**
+ * A histogram of durations with fixed-width buckets. Durations past the
+ * last bucket are counted in an overflow bucket.
+ */
+class Frame_histogram {
+public:
+    static constexpr int num_buckets = 400;         /**< Number of buckets */
+    static constexpr double bucket_width_ms = 0.25; /**< Width of a bucket */
+
+    Frame_histogram();
+
+    /**
+     * Add a sample to the histogram.
+     * \param ms The duration in milliseconds, must be >= 0.
+     */
+    void add(double ms);
+
+    /**
+     * \param p The percentile to find, in [0, 100].
+     * \return The upper edge of the bucket containing the pth percentile, or
+     * the largest sample seen if it falls in the overflow bucket.
+     */
+    double percentile(double p) const;
+
+    long count() const {return samples;}
+    double max() const {return max_ms;}
+    double mean() const {return samples ? total_ms / samples : 0.0;}
+
+    void clear();
+
+private:
+    long buckets[num_buckets + 1];  /**< Last bucket is the overflow */
+    long samples;
+    double total_ms;
+    double max_ms;
+};
+
+class Frame_timer {
+public:
+    static constexpr int history_length = 128; /**< Frames kept for overlay */
+
+    Frame_timer();
+
+    /**
+     * Start timing a new frame.
+     */
+    void begin_frame();
+
+    /**
+     * Attribute the time since the last call to mark() (or begin_frame())
+     * to the phase p.
+     */
+    void mark(FRAME_PHASE p);
+
+    /**
+     * Finish the current frame and add it to the histograms. Time spent in
+     * FRAME_PHASE::idle is recorded but not counted in the frame time.
+     */
+    void end_frame();
+
+    /**
+     * Draw the recent frame times as stacked bars, one colour per phase.
+     * \param r The renderer to draw with, the target must already be set.
+     * \param area The region of the render target to draw in.
+     */
+    void draw_overlay(SDL_Renderer* r, const SDL_Rect& area) const;
+
+    /**
+     * Write p50/p95/p99 for each phase and for whole frames to a file.
+     * \param filename The file to write to, it is truncated.
+     */
+    void write_report(const std::string& filename) const;
+
+    /**
+     * \return A one line summary of the frame time percentiles.
+     */
+    std::string summary() const;
+
+    const Frame_histogram& frame_histogram() const {return frames;}
+
+private:
+    static constexpr int num_phases = static_cast<int>(FRAME_PHASE::count);
+
+    Uint64 frame_start;
+    Uint64 last_mark;
+    double ticks_to_ms;
+
+    double current[num_phases];     /**< Phase times of the current frame */
+    Frame_histogram phases[num_phases];
+    Frame_histogram frames;
+
+    double history[history_length][num_phases]; /**< Ring of recent frames */
+    int history_next;
+};
+#endif
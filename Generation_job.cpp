@@ -0,0 +1,86 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Generation_job.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Tracks tiles of a map being generated, see
+    Generation_job.h
+*/
+#include "Generation_job.h"
+#include "Tile_address.h"
+
+Generation_job::Generation_job(std::size_t tiles)
+    :total{tiles}, completed{0}, skipped{0}, cancel_flag{false}
+{
+    work.start(tiles);
+}
+
+void Generation_job::tile_done(Tile_id t)
+{
+    work.add(1, tile_area);
+    std::lock_guard<std::mutex> guard{lock};
+    finished.push_back(t);
+    if (++completed == total)
+        all_done.notify_all();
+}
+
+void Generation_job::tile_skipped()
+{
+    skipped++;
+    work.add(1, 0);
+    std::lock_guard<std::mutex> guard{lock};
+    if (++completed == total)
+        all_done.notify_all();
+}
+
+void Generation_job::tile_failed(const std::string& what)
+{
+    skipped++;
+    work.add(1, 0);
+    std::lock_guard<std::mutex> guard{lock};
+    if (first_error.empty())
+        first_error = what;
+    if (++completed == total)
+        all_done.notify_all();
+}
+
+std::string Generation_job::error() const
+{
+    std::lock_guard<std::mutex> guard{lock};
+    return first_error;
+}
+
+std::vector<Tile_id> Generation_job::take_finished()
+{
+    std::vector<Tile_id> tiles;
+    std::lock_guard<std::mutex> guard{lock};
+    tiles.swap(finished);
+    return tiles;
+}
+
+void Generation_job::wait()
+{
+    std::unique_lock<std::mutex> guard{lock};
+    all_done.wait(guard, [this] {return completed.load() == total;});
+}
@@ -0,0 +1,132 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Generation_job.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Tracks the tiles of a map being generated on the thread
+    pool, so finished tiles can be picked up and uploaded while the rest
+    are still being worked on. A job can be cancelled, after which its
+    tiles stop as soon as they next check.
+*/
+#ifndef GENERATION_JOB_H
+#define GENERATION_JOB_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Progress.h"
+
+/**
+ * A tile of the map, by column and row
+ */
+struct Tile_id {
+    int tx;
+    int ty;
+};
+
+class Generation_job {
+public:
+    /**
+     * Constructor
+     * \param tiles The number of tiles that will be generated.
+     */
+    explicit Generation_job(std::size_t tiles);
+
+    /**
+     * Record that a tile has been generated, called by the worker that
+     * generated it.
+     */
+    void tile_done(Tile_id t);
+
+    /**
+     * Record that a tile was abandoned because the job was cancelled. It
+     * counts towards completion but is never reported as finished.
+     */
+    void tile_skipped();
+
+    /**
+     * Record that generating a tile threw. It counts towards completion
+     * like a skipped tile, so wait() still returns, and the first error is
+     * kept for error().
+     * \param what What went wrong.
+     */
+    void tile_failed(const std::string& what);
+
+    /**
+     * \return The error the first failed tile gave, empty if none failed.
+     */
+    std::string error() const;
+
+    /**
+     * Ask every tile of the job to stop. Tiles not yet started are
+     * skipped, tiles in progress stop at their next check.
+     */
+    void cancel() {cancel_flag.store(true);}
+
+    /**
+     * \return true once cancel() has been called, checked by workers
+     * between rows of a tile.
+     */
+    bool cancelled() const
+    {
+        return cancel_flag.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * \return Every tile finished since the last call, in the order they
+     * finished.
+     */
+    std::vector<Tile_id> take_finished();
+
+    /**
+     * Block until every tile has been generated.
+     */
+    void wait();
+
+    /**
+     * \return Progress of the job in tiles.
+     */
+    const Progress& progress() const {return work;}
+
+    bool done() const {return completed.load() == total;}
+    std::size_t num_completed() const {return completed.load();}
+    std::size_t num_tiles() const {return total;}
+    std::size_t num_skipped() const {return skipped.load();}
+
+private:
+    const std::size_t total;
+    std::atomic<std::size_t> completed;
+    std::atomic<std::size_t> skipped;
+    std::atomic<bool> cancel_flag;
+
+    mutable std::mutex lock;
+    std::condition_variable all_done;
+    std::vector<Tile_id> finished;  /**< Guarded by lock */
+    std::string first_error;        /**< Guarded by lock */
+    Progress work;
+};
+#endif
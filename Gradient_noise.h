@@ -0,0 +1,254 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Gradient_noise.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Gradient (Perlin) noise and the fractals built from it,
+    inline so callers that loop over a whole tile compile to one tight
+    loop. Gradients are picked by hashing the lattice point, so there are
+    no permutation tables to look up or share between threads. The noise
+    can be evaluated in float or double.
+*/
+#ifndef GRADIENT_NOISE_H
+#define GRADIENT_NOISE_H
+
+#include <cmath>
+#include <cstdint>
+
+/**
+ * How smoothly noise is interpolated between lattice points, as
+ * noise::NoiseQuality
+ */
+enum class NOISE_QUALITY {
+    fast,       /**< Linear, creases at lattice lines */
+    standard,   /**< Cubic s-curve */
+    best        /**< Quintic s-curve, smooth second derivative */
+};
+
+/**
+ * \return A printable name for the quality q.
+ */
+inline const char* noise_quality_name(NOISE_QUALITY q)
+{
+    switch (q) {
+    case NOISE_QUALITY::fast:     return "fast";
+    case NOISE_QUALITY::standard: return "standard";
+    case NOISE_QUALITY::best:     return "best";
+    }
+    return "unknown";
+}
+
+/* Multipliers that spread each lattice coordinate over the hash */
+constexpr std::uint32_t lattice_x_prime = 0x8da6b343u;
+constexpr std::uint32_t lattice_y_prime = 0xd8163841u;
+constexpr std::uint32_t lattice_z_prime = 0xcb1ab31fu;
+constexpr std::uint32_t lattice_seed_prime = 0x165667b1u;
+
+/**
+ * \return h with its bits mixed so every input bit affects every output bit.
+ */
+inline std::uint32_t lattice_mix(std::uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * \return A well mixed hash of a lattice point and a seed.
+ */
+inline std::uint32_t lattice_hash(std::int32_t x, std::int32_t y,
+    std::int32_t z, std::int32_t seed)
+{
+    return lattice_mix(static_cast<std::uint32_t>(x) * lattice_x_prime
+        ^ static_cast<std::uint32_t>(y) * lattice_y_prime
+        ^ static_cast<std::uint32_t>(z) * lattice_z_prime
+        ^ static_cast<std::uint32_t>(seed) * lattice_seed_prime);
+}
+
+/**
+ * \return The dot product of (x, y, z) with one of the 12 cube edge
+ * gradients picked by h, four of them twice so a mask can pick one.
+ */
+template<typename T>
+inline T lattice_gradient(std::uint32_t h, T x, T y, T z)
+{
+    h &= 15;
+    const T u = (h < 8 ? x : y);
+    const T v = (h < 4 ? y : (h == 12 || h == 14 ? x : z));
+    return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+/**
+ * \return The quintic s-curve 6t^5 - 15t^4 + 10t^3.
+ */
+template<typename T>
+inline T noise_fade(T t)
+{
+    return t * t * t * (t * (t * T(6) - T(15)) + T(10));
+}
+
+/**
+ * \return t eased for interpolating noise of quality Q.
+ */
+template<NOISE_QUALITY Q, typename T>
+inline T noise_curve(T t)
+{
+    switch (Q) {
+    case NOISE_QUALITY::fast:     return t;
+    case NOISE_QUALITY::standard: return t * t * (T(3) - T(2) * t);
+    case NOISE_QUALITY::best:     return noise_fade(t);
+    }
+    return t;
+}
+
+/**
+ * \return v rounded down, without a branch so loops of it vectorize.
+ */
+template<typename T>
+inline std::int32_t noise_floor(T v)
+{
+    std::int32_t i = static_cast<std::int32_t>(v);
+    return i - (v < i);
+}
+
+/**
+ * One octave of 3D gradient noise at an offset from a lattice point, so
+ * the offset can be held at less precision than the whole coordinate.
+ * \param x0, y0, z0 The lattice point.
+ * \param fx, fy, fz The offset from it, each in [0, 1).
+ * \return A value in about [-1, 1], 0 at every lattice point.
+ */
+template<NOISE_QUALITY Q, typename T>
+inline T gradient_noise_cell(std::int32_t x0, std::int32_t y0,
+    std::int32_t z0, T fx, T fy, T fz, std::int32_t seed)
+{
+    const T u = noise_curve<Q>(fx);
+    const T v = noise_curve<Q>(fy);
+    const T w = noise_curve<Q>(fz);
+
+    /* The terms of lattice_hash() for each axis, shared by the corners */
+    const std::uint32_t hs = static_cast<std::uint32_t>(seed)
+        * lattice_seed_prime;
+    const std::uint32_t hx[2] = {
+        static_cast<std::uint32_t>(x0) * lattice_x_prime,
+        static_cast<std::uint32_t>(x0 + 1) * lattice_x_prime};
+    const std::uint32_t hy[2] = {
+        static_cast<std::uint32_t>(y0) * lattice_y_prime,
+        static_cast<std::uint32_t>(y0 + 1) * lattice_y_prime};
+    const std::uint32_t hz[2] = {
+        static_cast<std::uint32_t>(z0) * lattice_z_prime ^ hs,
+        static_cast<std::uint32_t>(z0 + 1) * lattice_z_prime ^ hs};
+
+    auto corner = [&](int dx, int dy, int dz) {
+        return lattice_gradient(lattice_mix(hx[dx] ^ hy[dy] ^ hz[dz]),
+            fx - T(dx), fy - T(dy), fz - T(dz));
+    };
+    auto lerp = [](T a, T b, T t) {return a + t * (b - a);};
+
+    const T x00 = lerp(corner(0, 0, 0), corner(1, 0, 0), u);
+    const T x10 = lerp(corner(0, 1, 0), corner(1, 1, 0), u);
+    const T x01 = lerp(corner(0, 0, 1), corner(1, 0, 1), u);
+    const T x11 = lerp(corner(0, 1, 1), corner(1, 1, 1), u);
+    return lerp(lerp(x00, x10, v), lerp(x01, x11, v), w);
+}
+
+/**
+ * One octave of 3D gradient noise.
+ * \return A value in about [-1, 1], 0 at every lattice point.
+ */
+template<NOISE_QUALITY Q = NOISE_QUALITY::best>
+inline double gradient_noise(double x, double y, double z, std::int32_t seed)
+{
+    const std::int32_t x0 = noise_floor(x);
+    const std::int32_t y0 = noise_floor(y);
+    const std::int32_t z0 = noise_floor(z);
+    return gradient_noise_cell<Q>(x0, y0, z0, x - x0, y - y0, z - z0, seed);
+}
+
+/**
+ * Fractal brownian motion, the sum of octaves of gradient noise, as
+ * noise::module::Perlin sums them. Each octave uses the next seed.
+ * \return A value in about [-1, 1] for a persistence of 0.5.
+ */
+template<NOISE_QUALITY Q = NOISE_QUALITY::best>
+inline double fbm_noise(double x, double y, double z, std::int32_t seed,
+    int octaves, double persistence, double lacunarity)
+{
+    double value = 0.0;
+    double amplitude = 1.0;
+    for (int o=0; o<octaves; o++) {
+        value += gradient_noise<Q>(x, y, z, seed + o) * amplitude;
+        x *= lacunarity;
+        y *= lacunarity;
+        z *= lacunarity;
+        amplitude *= persistence;
+    }
+    return value;
+}
+
+/**
+ * Fold one octave of gradient noise into a ridge for ridged_noise().
+ * \param n The gradient noise of the octave.
+ * \param weight The weight from the octave before, updated for the next.
+ * \return The weighted ridge, to be scaled by lacunarity^-octave.
+ */
+inline double ridged_signal(double n, double& weight)
+{
+    constexpr double offset = 1.0;
+    constexpr double gain = 2.0;
+    double signal = offset - std::fabs(n);
+    signal *= signal * weight;
+    weight = signal * gain;
+    weight = (weight > 1.0 ? 1.0 : (weight < 0.0 ? 0.0 : weight));
+    return signal;
+}
+
+/**
+ * Ridged multifractal noise, as noise::module::RidgedMulti makes it.
+ * Octaves are folded into sharp ridges and each is weighted by the one
+ * before, so ridges are rough and valleys smooth.
+ * \return A value in about [-1, 1].
+ */
+template<NOISE_QUALITY Q = NOISE_QUALITY::best>
+inline double ridged_noise(double x, double y, double z, std::int32_t seed,
+    int octaves, double lacunarity)
+{
+    double value = 0.0;
+    double weight = 1.0;
+    double spectral = 1.0;      // lacunarity^-octave
+    for (int o=0; o<octaves; o++) {
+        value += ridged_signal(gradient_noise<Q>(x, y, z, seed + o), weight)
+            * spectral;
+        x *= lacunarity;
+        y *= lacunarity;
+        z *= lacunarity;
+        spectral /= lacunarity;
+    }
+    return value * 1.25 - 1.0;
+}
+#endif
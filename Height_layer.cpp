@@ -0,0 +1,172 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Height_layer.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Storage for the height of every pixel, see Height_layer.h
+*/
+#include "Height_layer.h"
+#include <cmath>
+#include <cstring>
+
+const char* height_format_name(HEIGHT_FORMAT f)
+{
+    switch (f) {
+    case HEIGHT_FORMAT::float64:  return "float64";
+    case HEIGHT_FORMAT::float32:  return "float32";
+    case HEIGHT_FORMAT::unorm16:  return "unorm16";
+    case HEIGHT_FORMAT::half:     return "half";
+    }
+    return "unknown";
+}
+
+std::size_t height_format_size(HEIGHT_FORMAT f)
+{
+    switch (f) {
+    case HEIGHT_FORMAT::float64:  return 8;
+    case HEIGHT_FORMAT::float32:  return 4;
+    case HEIGHT_FORMAT::unorm16:  return 2;
+    case HEIGHT_FORMAT::half:     return 2;
+    }
+    return 8;
+}
+
+std::uint16_t float_to_half(float f)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+
+    std::uint32_t sign = (bits >> 16) & 0x8000;
+    std::int32_t exponent = static_cast<std::int32_t>((bits >> 23) & 0xff)
+        - 127 + 15;
+    std::uint32_t mantissa = bits & 0x7fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff) {    // Inf or NaN
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+    if (exponent >= 0x1f) {                 // Too large, becomes Inf
+        return sign | 0x7c00;
+    }
+    if (exponent <= 0) {                    // Subnormal or zero
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        std::uint32_t shift = 14 - exponent;
+        std::uint32_t half_mantissa = mantissa >> shift;
+        std::uint32_t rest = mantissa & ((1u << shift) - 1);
+        std::uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half_mantissa & 1)))
+            half_mantissa++;
+        return sign | half_mantissa;
+    }
+
+    std::uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    std::uint32_t rest = mantissa & 0x1fff;
+    /* Round to nearest even, a carry into the exponent is still correct */
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return static_cast<std::uint16_t>(half);
+}
+
+float half_to_float(std::uint16_t h)
+{
+    std::uint32_t sign = static_cast<std::uint32_t>(h & 0x8000) << 16;
+    std::uint32_t exponent = (h >> 10) & 0x1f;
+    std::uint32_t mantissa = h & 0x3ff;
+    std::uint32_t bits;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        }
+        else {          // Subnormal, normalise it
+            float f = std::ldexp(static_cast<float>(mantissa), -24);
+            return (sign ? -f : f);
+        }
+    }
+    else if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+Height_layer::Height_layer(std::size_t n, HEIGHT_FORMAT f)
+    :fmt{f}, samples{n}, data{NULL}, owned{false}
+{
+    for (int t=0; t<num_biome_thresholds; t++) {
+        unorm16_thresholds[t] = static_cast<std::uint16_t>(
+            std::ceil(biome_thresholds[t] * 65535.0));
+    }
+    set_format(f);
+}
+
+Height_layer::~Height_layer()
+{
+    if (owned)
+        delete[] data;
+}
+
+void Height_layer::set_format(HEIGHT_FORMAT f)
+{
+    if (owned)
+        delete[] data;
+    fmt = f;
+    data = new unsigned char[bytes()];
+    owned = true;
+    std::memset(data, 0, bytes());
+}
+
+void Height_layer::attach(void* storage, std::size_t n, HEIGHT_FORMAT f)
+{
+    if (owned)
+        delete[] data;
+    fmt = f;
+    samples = n;
+    data = static_cast<unsigned char*>(storage);
+    owned = false;
+}
+
+void Height_layer::resize(std::size_t n)
+{
+    samples = n;
+    set_format(fmt);
+}
+
+void Height_layer::copy_from(const Height_layer& src, std::size_t src_i,
+    std::size_t dst_i, std::size_t n)
+{
+    if (src.fmt == fmt) {
+        const std::size_t size = height_format_size(fmt);
+        std::memcpy(data + dst_i*size, src.data + src_i*size, n*size);
+        return;
+    }
+    for (std::size_t k=0; k<n; k++)
+        set(dst_i + k, src.get(src_i + k));
+}
@@ -0,0 +1,208 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Height_layer.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Storage for the height of every pixel in a map. Heights
+    are in [0, 1] and can be kept at reduced precision to save memory.
+*/
+#ifndef HEIGHT_LAYER_H
+#define HEIGHT_LAYER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "Biome.h"
+
+/**
+ * How each height sample is stored
+ */
+enum class HEIGHT_FORMAT {
+    float64,    /**< 8 bytes, exact */
+    float32,    /**< 4 bytes, ~7 significant digits */
+    unorm16,    /**< 2 bytes, h*65535 rounded, steps of 1.5e-5 */
+    half        /**< 2 bytes, IEEE half, steps of 4.9e-4 near 1.0 */
+};
+
+/**
+ * \return A printable name for the format f.
+ */
+const char* height_format_name(HEIGHT_FORMAT f);
+
+/**
+ * \return The number of bytes used to store one sample in format f.
+ */
+std::size_t height_format_size(HEIGHT_FORMAT f);
+
+/**
+ * Convert a float to an IEEE 754 half, rounding to nearest even.
+ */
+std::uint16_t float_to_half(float f);
+
+/**
+ * Convert an IEEE 754 half to a float.
+ */
+float half_to_float(std::uint16_t h);
+
+class Height_layer {
+public:
+    /**
+     * Constructor
+     * \param n The number of samples in the layer.
+     * \param f The storage format of each sample.
+     */
+    Height_layer(std::size_t n = 0, HEIGHT_FORMAT f = HEIGHT_FORMAT::float64);
+
+    ~Height_layer();
+
+    Height_layer(const Height_layer&) = delete;
+    Height_layer& operator=(const Height_layer&) = delete;
+
+    /**
+     * Change the storage format, every sample is reset to 0. The layer
+     * allocates its own memory again if it was attached.
+     * \param f The new format.
+     */
+    void set_format(HEIGHT_FORMAT f);
+
+    /**
+     * Use memory owned by someone else for the samples. The memory is not
+     * cleared, so the caller can first touch it from whichever threads
+     * will use it.
+     * \param storage At least n * height_format_size(f) bytes, aligned for
+     * a double.
+     * \param n The number of samples.
+     * \param f The storage format of each sample.
+     */
+    void attach(void* storage, std::size_t n, HEIGHT_FORMAT f);
+
+    /**
+     * Change the number of samples, every sample is reset to 0.
+     * \param n The new number of samples.
+     */
+    void resize(std::size_t n);
+
+    HEIGHT_FORMAT format() const {return fmt;}
+    std::size_t size() const {return samples;}
+    std::size_t bytes() const {return samples * height_format_size(fmt);}
+
+    /**
+     * Store a height, rounding it to the precision of the layer.
+     * \param i The index of the sample.
+     * \param h The height, clamped to [0, 1].
+     */
+    void set(std::size_t i, double h)
+    {
+        h = (h < 0.0 ? 0.0 : (h > 1.0 ? 1.0 : h));
+        switch (fmt) {
+        case HEIGHT_FORMAT::float64:
+            reinterpret_cast<double*>(data)[i] = h;
+            break;
+        case HEIGHT_FORMAT::float32:
+            reinterpret_cast<float*>(data)[i] = static_cast<float>(h);
+            break;
+        case HEIGHT_FORMAT::unorm16:
+            reinterpret_cast<std::uint16_t*>(data)[i] =
+                static_cast<std::uint16_t>(h * 65535.0 + 0.5);
+            break;
+        case HEIGHT_FORMAT::half:
+            reinterpret_cast<std::uint16_t*>(data)[i] =
+                float_to_half(static_cast<float>(h));
+            break;
+        }
+    }
+
+    /**
+     * \return The stored height of sample i, in [0, 1].
+     */
+    double get(std::size_t i) const
+    {
+        switch (fmt) {
+        case HEIGHT_FORMAT::float64:
+            return reinterpret_cast<const double*>(data)[i];
+        case HEIGHT_FORMAT::float32:
+            return reinterpret_cast<const float*>(data)[i];
+        case HEIGHT_FORMAT::unorm16:
+            return reinterpret_cast<const std::uint16_t*>(data)[i] / 65535.0;
+        case HEIGHT_FORMAT::half:
+            return half_to_float(
+                reinterpret_cast<const std::uint16_t*>(data)[i]);
+        }
+        return 0.0;
+    }
+
+    /**
+     * Classify the stored height of sample i. Gives the same result as
+     * classify_height(get(i)), but unorm16 samples are compared against
+     * pre-quantized thresholds without converting them.
+     */
+    BIOME biome(std::size_t i) const
+    {
+        if (fmt == HEIGHT_FORMAT::unorm16) {
+            std::uint16_t q = reinterpret_cast<const std::uint16_t*>(data)[i];
+            for (int t=0; t<num_biome_thresholds; t++) {
+                if (q < unorm16_thresholds[t])
+                    return static_cast<BIOME>(t + 1);
+            }
+            return BIOME::snow;
+        }
+        return classify_height(get(i));
+    }
+
+    /**
+     * \return The stored height of sample i scaled to [0, 255], unorm16
+     * samples are shifted down without converting them.
+     */
+    std::uint8_t grey(std::size_t i) const
+    {
+        if (fmt == HEIGHT_FORMAT::unorm16)
+            return reinterpret_cast<const std::uint16_t*>(data)[i] >> 8;
+        return static_cast<std::uint8_t>(get(i) * 255);
+    }
+
+    /**
+     * Copy n samples from another layer, converting if the formats differ.
+     * \param src The layer to copy from.
+     * \param src_i The first sample to copy in src.
+     * \param dst_i Where to put the first sample in this layer.
+     * \param n The number of samples to copy.
+     */
+    void copy_from(const Height_layer& src, std::size_t src_i,
+        std::size_t dst_i, std::size_t n);
+
+    /**
+     * \return The raw samples, laid out in the format of the layer.
+     */
+    const void* raw() const {return data;}
+    void* raw() {return data;}
+
+private:
+    HEIGHT_FORMAT fmt;
+    std::size_t samples;
+    unsigned char* data;
+    bool owned;     /**< True if data should be deleted by this layer */
+
+    /** biome_thresholds as the smallest unorm16 value at or above each */
+    std::uint16_t unorm16_thresholds[num_biome_thresholds];
+};
+#endif
@@ -0,0 +1,377 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Heightfield.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Diamond-square and spectral synthesis, see Heightfield.h
+*/
+#include "Heightfield.h"
+#include "Gradient_noise.h"
+#include "Parallel_for.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <stdexcept>
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+/** Rows of a field worked on per thread at the least */
+constexpr std::size_t min_rows = 16;
+
+/**
+ * \return A random value in [-1, 1] picked by hashing a point, so the
+ * field doesn't depend on the order it is made in.
+ */
+double lattice_random(std::int32_t x, std::int32_t y, std::int32_t z,
+    std::int32_t seed)
+{
+    return lattice_hash(x, y, z, seed) * (2.0 / 4294967295.0) - 1.0;
+}
+
+/**
+ * \return The smallest power of two >= n.
+ */
+std::uint64_t power_of_two_above(std::uint64_t n)
+{
+    std::uint64_t p = 1;
+    while (p < n)
+        p *= 2;
+    return p;
+}
+
+bool cancelled(const Generation_job* owner)
+{
+    return owner != NULL && owner->cancelled();
+}
+
+/*
+Diamond-square on a grid of (n+1)^2 points. Points a feature size apart
+start with random heights, then each level sets the centres of the squares
+(diamond step) then the middles of their edges (square step) to the mean
+of their neighbours plus a random displacement, halving the spacing. The
+displacement shrinks by the persistence each level and stops after the
+octaves are used up, so smaller levels only smooth.
+*/
+bool diamond_square(const Noise_settings& s, int n, std::vector<float>& grid,
+    const Generation_job* owner)
+{
+    const std::size_t stride = n + 1;
+    grid.assign(stride * stride, 0.0f);
+    auto at = [&](int x, int y) -> float& {return grid[y * stride + x];};
+
+    int step = 1;
+    while (step * 2 <= std::min(n, static_cast<int>(1.0 / s.frequency)))
+        step *= 2;
+
+    parallel_for(0, n / step + 1, [&](std::size_t first, std::size_t last) {
+        for (std::size_t j=first; j<last; j++)
+            for (int i=0; i<=n/step; i++)
+                at(i * step, j * step) = static_cast<float>(
+                    lattice_random(i, j, 0, s.seed));
+    }, min_rows);
+
+    double amplitude = s.persistence;
+    for (int level=1; step>1; level++, step/=2, amplitude*=s.persistence) {
+        if (cancelled(owner))
+            return false;
+
+        const int half = step / 2;
+        const double a = (level < s.octaves ? amplitude : 0.0);
+
+        const std::size_t squares = n / step;
+        parallel_for(0, squares, [&](std::size_t first, std::size_t last) {
+            for (std::size_t j=first; j<last; j++) {
+                const int y = static_cast<int>(j) * step + half;
+                for (int x=half; x<n; x+=step) {
+                    const double mean = (at(x - half, y - half)
+                        + at(x + half, y - half) + at(x - half, y + half)
+                        + at(x + half, y + half)) * 0.25;
+                    at(x, y) = static_cast<float>(mean
+                        + a * lattice_random(x, y, level, s.seed));
+                }
+            }
+        }, min_rows);
+
+        /* Rows of edge middles alternate starting at 0 and half */
+        parallel_for(0, 2 * squares + 1, [&](std::size_t first,
+            std::size_t last) {
+            for (std::size_t j=first; j<last; j++) {
+                const int y = static_cast<int>(j) * half;
+                for (int x=(j % 2 ? 0 : half); x<=n; x+=step) {
+                    double sum = 0.0;
+                    int count = 0;
+                    if (x >= half) {sum += at(x - half, y); count++;}
+                    if (x + half <= n) {sum += at(x + half, y); count++;}
+                    if (y >= half) {sum += at(x, y - half); count++;}
+                    if (y + half <= n) {sum += at(x, y + half); count++;}
+                    at(x, y) = static_cast<float>(sum / count
+                        + a * lattice_random(x, y, level, s.seed));
+                }
+            }
+        }, min_rows);
+    }
+    return true;
+}
+
+typedef std::complex<float> Complex;
+
+/** Columns transformed together, a cache line of them */
+constexpr int column_block = 64 / sizeof(Complex);
+
+/**
+ * \return e^(2 pi i k / n) for k in [0, n/2), the twiddles of an inverse
+ * FFT of n values. Each is worked out in double, multiplying them up
+ * loses accuracy over long rows.
+ */
+std::vector<Complex> inverse_twiddles(int n)
+{
+    std::vector<Complex> w(n / 2 > 0 ? n / 2 : 1);
+    for (int k=0; k<n/2; k++) {
+        const double angle = 2.0 * pi * k / n;
+        w[k] = Complex{static_cast<float>(std::cos(angle)),
+            static_cast<float>(std::sin(angle))};
+    }
+    return w;
+}
+
+/**
+ * In place radix-2 inverse FFT of n values, n a power of two, unscaled.
+ * \param twiddles From inverse_twiddles(n).
+ */
+void inverse_fft(Complex* v, int n, const std::vector<Complex>& twiddles)
+{
+    for (int i=1, j=0; i<n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(v[i], v[j]);
+    }
+
+    for (int length=2; length<=n; length*=2) {
+        const int spacing = n / length;
+        for (int k=0; k<length/2; k++) {
+            const float wr = twiddles[k * spacing].real();
+            const float wi = twiddles[k * spacing].imag();
+            for (int start=0; start<n; start+=length) {
+                Complex& a = v[start + k];
+                Complex& b = v[start + k + length/2];
+                /* Written out, std::complex multiplies check for NaNs */
+                const float tr = b.real() * wr - b.imag() * wi;
+                const float ti = b.real() * wi + b.imag() * wr;
+                b = Complex{a.real() - tr, a.imag() - ti};
+                a = Complex{a.real() + tr, a.imag() + ti};
+            }
+        }
+    }
+}
+
+/*
+Spectral synthesis on an nx by ny grid. Every frequency gets a random
+phase and the amplitude fbm gives it: flat up to the base frequency, then
+each band a lacunarity wide has persistence times the height of the one
+below, cut off past the last octave. A band has lacunarity^2 times as many
+frequencies as the one below, so each frequency's amplitude falls by a
+further factor of the lacunarity. One inverse FFT of the rows then the
+columns gives the field, which wraps at its edges.
+*/
+bool spectral(const Noise_settings& s, int nx, int ny,
+    std::vector<float>& field, const Generation_job* owner)
+{
+    std::vector<Complex> grid(static_cast<std::size_t>(nx) * ny);
+    const double exponent = std::log(s.persistence) / std::log(s.lacunarity)
+        - 1.0;
+    const double top = s.frequency * std::pow(s.lacunarity, s.octaves);
+
+    parallel_for(0, ny, [&](std::size_t first, std::size_t last) {
+        for (std::size_t j=first; j<last; j++) {
+            /* Frequencies past half the grid are the negative ones */
+            const int ky = (static_cast<int>(j) <= ny / 2 ?
+                static_cast<int>(j) : static_cast<int>(j) - ny);
+            for (int i=0; i<nx; i++) {
+                const int kx = (i <= nx / 2 ? i : i - nx);
+                const double fx = static_cast<double>(kx) / nx;
+                const double fy = static_cast<double>(ky) / ny;
+                const double f = std::sqrt(fx * fx + fy * fy);
+                if (f == 0.0 || f > top)
+                    continue;
+                const double amplitude = (f < s.frequency ? 1.0
+                    : std::pow(f / s.frequency, exponent));
+                const double phase = pi * lattice_random(kx, ky, 0, s.seed);
+                grid[j * nx + i] = std::polar(static_cast<float>(amplitude),
+                    static_cast<float>(phase));
+            }
+        }
+    }, min_rows);
+    if (cancelled(owner))
+        return false;
+
+    /* Rows above the top frequency are all 0 and stay 0 */
+    const std::vector<Complex> row_twiddles = inverse_twiddles(nx);
+    parallel_for(0, ny, [&](std::size_t first, std::size_t last) {
+        for (std::size_t j=first; j<last; j++) {
+            const int ky = (static_cast<int>(j) <= ny / 2 ?
+                static_cast<int>(j) : static_cast<int>(j) - ny);
+            if (std::abs(static_cast<double>(ky) / ny) <= top)
+                inverse_fft(&grid[j * nx], nx, row_twiddles);
+        }
+    }, min_rows);
+    if (cancelled(owner))
+        return false;
+
+    /* Columns are copied out a block at a time, striding down them one at
+       a time misses the cache */
+    const std::vector<Complex> column_twiddles = inverse_twiddles(ny);
+    const int blocks = (nx + column_block - 1) / column_block;
+    parallel_for(0, blocks, [&](std::size_t first, std::size_t last) {
+        std::vector<Complex> columns(static_cast<std::size_t>(ny)
+            * column_block);
+        for (std::size_t b=first; b<last; b++) {
+            const int x0 = static_cast<int>(b) * column_block;
+            const int width = std::min(column_block, nx - x0);
+            for (int j=0; j<ny; j++)
+                for (int c=0; c<width; c++)
+                    columns[c * ny + j] = grid[j * nx + x0 + c];
+            for (int c=0; c<width; c++)
+                inverse_fft(&columns[c * ny], ny, column_twiddles);
+            for (int j=0; j<ny; j++)
+                for (int c=0; c<width; c++)
+                    grid[j * nx + x0 + c] = columns[c * ny + j];
+        }
+    });
+
+    field.resize(grid.size());
+    for (std::size_t i=0; i<grid.size(); i++)
+        field[i] = grid[i].real();
+    return true;
+}
+
+/**
+ * Scale the width by height corner of a grid to fbm_height_deviation
+ * around 0.5 and write it to out.
+ */
+void normalise(const std::vector<float>& grid, std::size_t stride,
+    Heightfield& out)
+{
+    double sum = 0.0;
+    double squares = 0.0;
+    for (int y=0; y<out.height; y++) {
+        for (int x=0; x<out.width; x++) {
+            const double v = grid[y * stride + x];
+            sum += v;
+            squares += v * v;
+        }
+    }
+    const double n = static_cast<double>(out.width) * out.height;
+    const double mean = sum / n;
+    const double deviation = std::sqrt(std::max(squares / n - mean * mean,
+        1e-30));
+    const double scale = fbm_height_deviation / deviation;
+
+    out.heights.resize(static_cast<std::size_t>(out.width) * out.height);
+    parallel_for(0, out.height, [&](std::size_t first, std::size_t last) {
+        for (std::size_t y=first; y<last; y++) {
+            for (int x=0; x<out.width; x++) {
+                double h = 0.5 + (grid[y * stride + x] - mean) * scale;
+                out.heights[y * out.width + x] = static_cast<float>(
+                    h < 0.0 ? 0.0 : (h > 1.0 ? 1.0 : h));
+            }
+        }
+    }, min_rows);
+}
+
+}
+
+std::uint64_t heightfield_bytes(NOISE_ENGINE e, int width, int height)
+{
+    const std::uint64_t heights = static_cast<std::uint64_t>(width) * height
+        * sizeof(float);
+    switch (e) {
+    case NOISE_ENGINE::diamond_square: {
+        /* A square grid of n + 1 corners a side */
+        const std::uint64_t n = power_of_two_above(std::max(width, height));
+        return (n + 1) * (n + 1) * sizeof(float) + heights;
+    }
+    case NOISE_ENGINE::spectral: {
+        /* The complex grid, and its real part copied out of it */
+        const std::uint64_t cells = power_of_two_above(width)
+            * power_of_two_above(height);
+        return cells * (sizeof(std::complex<float>) + sizeof(float))
+            + heights;
+    }
+    default:
+        return heights;
+    }
+}
+
+std::shared_ptr<const Heightfield> make_heightfield(const Noise_settings& s,
+    int width, int height, const Generation_job* owner)
+{
+    if (width <= 0 || height <= 0)
+        throw std::runtime_error("Heightfield must have a size");
+    /* Written so NaNs fail too */
+    if (!(s.frequency > 0.0) || !(s.persistence > 0.0)
+        || !(s.lacunarity > 1.0) || s.octaves < 1) {
+        throw std::runtime_error("Heightfields need a frequency and "
+            "persistence above 0, a lacunarity above 1 and an octave");
+    }
+    const std::uint64_t bytes = heightfield_bytes(s.engine, width, height);
+    if (bytes > max_heightfield_bytes) {
+        throw std::runtime_error(std::string{"Map too large for "}
+            + noise_engine_name(s.engine) + ", it needs "
+            + std::to_string(bytes >> 20) + "MB and at most "
+            + std::to_string(max_heightfield_bytes >> 20) + "MB is allowed");
+    }
+
+    auto field = std::make_shared<Heightfield>();
+    field->width = width;
+    field->height = height;
+
+    std::vector<float> grid;
+    switch (s.engine) {
+    case NOISE_ENGINE::diamond_square: {
+        const int n = static_cast<int>(power_of_two_above(
+            std::max(width, height)));
+        if (!diamond_square(s, n, grid, owner))
+            return NULL;
+        normalise(grid, n + 1, *field);
+        break;
+    }
+    case NOISE_ENGINE::spectral: {
+        const int nx = static_cast<int>(power_of_two_above(width));
+        const int ny = static_cast<int>(power_of_two_above(height));
+        if (!spectral(s, nx, ny, grid, owner))
+            return NULL;
+        normalise(grid, nx, *field);
+        break;
+    }
+    default:
+        throw std::runtime_error(std::string{"Not a whole map engine: "}
+            + noise_engine_name(s.engine));
+    }
+    return field;
+}
@@ -0,0 +1,89 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Heightfield.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Engines that make the heights of a whole map at once,
+    rather than a pixel or a tile at a time. Diamond-square displaces
+    midpoints level by level in O(n), and spectral synthesis shapes random
+    noise in the frequency domain with FFTs in O(n log n). Tiles of the
+    map are then cut from the field.
+*/
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Generation_job.h"
+#include "Perlin_noise_generator.h"
+
+/**
+ * Standard deviation of fbm heights (noise/2 + 0.5) at the default
+ * settings. Fields are scaled to it so the biomes cover about the same
+ * share of the map as they do with per-pixel noise.
+ */
+constexpr double fbm_height_deviation = 0.155;
+
+/**
+ * Bytes of memory a field may take to make, larger maps are refused
+ */
+constexpr std::uint64_t max_heightfield_bytes = std::uint64_t{2} << 30;
+
+/**
+ * The heights of a whole map
+ */
+struct Heightfield {
+    int width;
+    int height;
+    std::vector<float> heights;     /**< Row major, in [0, 1] */
+
+    float at(int x, int y) const
+    {
+        return heights[static_cast<std::size_t>(y) * width + x];
+    }
+};
+
+/**
+ * \return The bytes of memory make_heightfield() needs for a map: its
+ * heights and the grid they are made on, which is a power of two across
+ * and can be several times larger.
+ */
+std::uint64_t heightfield_bytes(NOISE_ENGINE e, int width, int height);
+
+/**
+ * Make the heights of a map with a whole map engine, in parallel.
+ * Octaves, persistence and frequency mean what they do for fbm noise:
+ * the largest features are about 1/frequency pixels across, and each
+ * halving of size has persistence times the height.
+ * \param s The noise settings, s.engine must be a whole map engine.
+ * \param width, height The size of the map in pixels.
+ * \param owner If not NULL, generation stops early if it is cancelled.
+ * \return The heights, or NULL if cancelled.
+ * Throws if the map needs more than max_heightfield_bytes, or if the
+ * frequency or persistence isn't above 0 or the lacunarity above 1.
+ */
+std::shared_ptr<const Heightfield> make_heightfield(const Noise_settings& s,
+    int width, int height, const Generation_job* owner = NULL);
+#endif
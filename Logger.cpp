@@ -1,9 +1,16 @@
 #include "Logger.h"
 #include <stdexcept>
+#include <mutex>
 
-Logger::Logger(std::string f)
+static bool default_log_appends = false;
+
+Logger::Logger(std::string f, bool append)
 {
-    file_stream.open(f, std::ofstream::out|std::ofstream::trunc);
+    /* Truncate first, then always append, so lines from other processes
+       sharing the file are not written over */
+    if (!append)
+        std::ofstream{f, std::ofstream::out|std::ofstream::trunc};
+    file_stream.open(f, std::ofstream::out|std::ofstream::app);
 
     if (!file_stream) {
         throw std::runtime_error("Failed to open log");
@@ -17,12 +24,20 @@ void Logger::flush()
 
 void LOG(std::string msg)
 {
+    /* Workers on the thread pool log too */
+    static std::mutex lock;
+    std::lock_guard<std::mutex> guard{lock};
     default_log().file_stream << msg << '\n';
     default_log().flush();
 }
 
 Logger& default_log()
 {
-    static Logger lg{"generate.log"};
+    static Logger lg{"generate.log", default_log_appends};
     return lg;
 }
+
+void append_to_default_log()
+{
+    default_log_appends = true;
+}
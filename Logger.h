@@ -8,8 +8,9 @@ class Logger {
 public:
     /**
      * \param f The filename to write to
+     * \param append Add to the end of the file instead of truncating it
      */
-    Logger(std::string f);
+    Logger(std::string f, bool append = false);
 
     /**
      * Flush the buffer to the file
@@ -22,4 +23,10 @@ public:
 void LOG(std::string msg);
 
 Logger& default_log();
+
+/**
+ * Make default_log() add to the end of its file instead of truncating it,
+ * for processes sharing a log. Must be called before anything is logged.
+ */
+void append_to_default_log();
 #endif
@@ -0,0 +1,104 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Map_arena.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A bump allocator for map layers, see Map_arena.h
+*/
+#include "Map_arena.h"
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#include <malloc.h>
+#endif
+
+Map_arena::Map_arena(std::size_t capacity)
+    :block{NULL}, mapping{NULL}, mapping_size{0}, size{padded(capacity)},
+    offset{0}, huge{false}
+{
+    if (size == 0)
+        size = alignment;
+
+#if defined(__linux__)
+    /* Over-allocate so the block can start on a huge page boundary */
+    const bool want_huge = size >= huge_page_size;
+    const std::size_t align = (want_huge ? huge_page_size : alignment);
+    mapping_size = size + align;
+
+    mapping = mmap(NULL, mapping_size, PROT_READ|PROT_WRITE,
+        MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        mapping = NULL;
+        throw std::runtime_error("Failed to allocate map arena");
+    }
+
+    std::uintptr_t start = reinterpret_cast<std::uintptr_t>(mapping);
+    block = reinterpret_cast<unsigned char*>((start + align - 1) / align
+        * align);
+
+#ifdef MADV_HUGEPAGE
+    if (want_huge)
+        huge = (madvise(block, size, MADV_HUGEPAGE) == 0);
+#endif
+#elif defined(_WIN32)
+    block = static_cast<unsigned char*>(_aligned_malloc(size, alignment));
+    mapping = block;
+    if (block == NULL)
+        throw std::runtime_error("Failed to allocate map arena");
+#else
+    if (posix_memalign(&mapping, alignment, size) != 0) {
+        mapping = NULL;
+        throw std::runtime_error("Failed to allocate map arena");
+    }
+    block = static_cast<unsigned char*>(mapping);
+#endif
+}
+
+Map_arena::~Map_arena()
+{
+    if (mapping == NULL)
+        return;
+#if defined(__linux__)
+    munmap(mapping, mapping_size);
+#elif defined(_WIN32)
+    _aligned_free(mapping);
+#else
+    free(mapping);
+#endif
+}
+
+void* Map_arena::allocate(std::size_t bytes)
+{
+    std::size_t needed = padded(bytes);
+    if (needed > size - offset)
+        throw std::runtime_error("Map arena is full");
+
+    void* p = block + offset;
+    offset += needed;
+    return p;
+}
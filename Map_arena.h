@@ -0,0 +1,98 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Map_arena.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A bump allocator that places every layer of a map in one
+    large aligned block. On Linux the block is aligned to and advised for
+    transparent huge pages, so large maps take far fewer page faults and
+    TLB misses.
+*/
+#ifndef MAP_ARENA_H
+#define MAP_ARENA_H
+
+#include <cstddef>
+#include <type_traits>
+
+class Map_arena {
+public:
+    static constexpr std::size_t alignment = 64; /**< Alignment of every
+                                                    allocation, one cache
+                                                    line or AVX-512 vector */
+    static constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+
+    /**
+     * Constructor, reserves the whole block up front. Pages are not touched
+     * so they are faulted in by whichever thread first writes them.
+     * \param capacity The number of bytes that can be allocated.
+     */
+    Map_arena(std::size_t capacity);
+
+    ~Map_arena();
+
+    Map_arena(const Map_arena&) = delete;
+    Map_arena& operator=(const Map_arena&) = delete;
+
+    /**
+     * Take the next bytes from the block, aligned to alignment.
+     * \param bytes The number of bytes wanted.
+     * \return The start of the allocation, throws if the arena is full.
+     */
+    void* allocate(std::size_t bytes);
+
+    /**
+     * Take room for n objects of type T. They are not constructed, so T must
+     * be trivial: the memory is only valid once written.
+     */
+    template<typename T>
+    T* allocate_array(std::size_t n)
+    {
+        static_assert(std::is_trivially_default_constructible<T>::value
+            && std::is_trivially_destructible<T>::value,
+            "Map_arena does not construct or destroy what it holds");
+        return static_cast<T*>(allocate(n * sizeof(T)));
+    }
+
+    /**
+     * \return The number of bytes to reserve for an allocation of the given
+     * size once padded out to alignment.
+     */
+    static std::size_t padded(std::size_t bytes)
+    {
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+
+    std::size_t capacity() const {return size;}
+    std::size_t used() const {return offset;}
+    bool huge_pages() const {return huge;}
+
+private:
+    unsigned char* block;   /**< Aligned start of the block */
+    void* mapping;          /**< What was actually allocated */
+    std::size_t mapping_size;
+    std::size_t size;
+    std::size_t offset;     /**< Next free byte in block */
+    bool huge;              /**< True if huge pages were requested */
+};
+#endif
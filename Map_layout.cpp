@@ -0,0 +1,105 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Map_layout.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Memory layout of map layers, see Map_layout.h
+*/
+#include "Map_layout.h"
+#include <algorithm>
+
+/**
+ * Spread the low 32 bits of v out to the even bits of the result
+ */
+static std::uint64_t spread_bits(std::uint32_t v)
+{
+    std::uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+    x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x << 2)) & 0x3333333333333333ULL;
+    x = (x | (x << 1)) & 0x5555555555555555ULL;
+    return x;
+}
+
+std::uint64_t morton_code(std::uint32_t x, std::uint32_t y)
+{
+    return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+Map_layout::Map_layout(int w, int h, MAP_LAYOUT l)
+    :layout{l}, width{w}, height{h}
+{
+    tiles_x = (width + tile_size - 1) / tile_size;
+    tiles_y = (height + tile_size - 1) / tile_size;
+
+    if (layout != MAP_LAYOUT::tiled)
+        return;
+
+    /* Number the tiles in Morton order. Sorting rather than using the code
+       directly keeps maps that are not square powers of two dense. */
+    const std::size_t num_tiles = static_cast<std::size_t>(tiles_x) * tiles_y;
+    tile_order.reserve(num_tiles);
+    for (int ty=0; ty<tiles_y; ty++)
+        for (int tx=0; tx<tiles_x; tx++)
+            tile_order.push_back(Tile{tx, ty});
+
+    std::sort(tile_order.begin(), tile_order.end(),
+        [](const Tile& a, const Tile& b) {
+            return morton_code(a.tx, a.ty) < morton_code(b.tx, b.ty);
+        });
+
+    tile_slots.resize(num_tiles);
+    for (std::size_t slot=0; slot<num_tiles; slot++) {
+        const Tile& t = tile_order[slot];
+        tile_slots[static_cast<std::size_t>(t.ty) * tiles_x + t.tx] =
+            static_cast<std::uint32_t>(slot);
+    }
+}
+
+std::size_t Map_layout::storage_size() const
+{
+    if (layout == MAP_LAYOUT::row_major)
+        return static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+    return tile_order.size() * tile_area;
+}
+
+SDL_Rect Map_layout::tile_rect(int tx, int ty) const
+{
+    SDL_Rect r{tx * tile_size, ty * tile_size, tile_size, tile_size};
+    if (r.x + r.w > width)
+        r.w = width - r.x;
+    if (r.y + r.h > height)
+        r.h = height - r.y;
+    return r;
+}
+
+SDL_Rect Map_layout::clip(const SDL_Rect& r, const SDL_Rect& bounds)
+{
+    int x0 = std::max(r.x, bounds.x);
+    int y0 = std::max(r.y, bounds.y);
+    int x1 = std::min(r.x + r.w, bounds.x + bounds.w);
+    int y1 = std::min(r.y + r.h, bounds.y + bounds.h);
+    return SDL_Rect{x0, y0, x1 - x0, y1 - y0};
+}
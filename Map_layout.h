@@ -0,0 +1,198 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Map_layout.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Where each pixel of a map lives in its layers. Either plain
+    row major, or split into 64x64 tiles that are stored in Morton (Z)
+    order so neighbouring tiles are close in memory.
+*/
+#ifndef MAP_LAYOUT_H
+#define MAP_LAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <SDL2/SDL.h>
+#include "Tile_address.h"
+
+/**
+ * How the pixels of a map are laid out in memory
+ */
+enum class MAP_LAYOUT {
+    row_major,  /**< y*width + x */
+    tiled       /**< 64x64 tiles in Morton order, row major in a tile */
+};
+
+/**
+ * \return The bits of x and y interleaved, x in the low bit.
+ */
+std::uint64_t morton_code(std::uint32_t x, std::uint32_t y);
+
+class Map_layout {
+public:
+    /**
+     * Constructor
+     * \param w Width of the map in pixels.
+     * \param h Height of the map in pixels.
+     * \param l How the pixels are laid out.
+     */
+    Map_layout(int w = 0, int h = 0, MAP_LAYOUT l = MAP_LAYOUT::row_major);
+
+    MAP_LAYOUT kind() const {return layout;}
+    int num_tiles_x() const {return tiles_x;}
+    int num_tiles_y() const {return tiles_y;}
+
+    /**
+     * \return The index of pixel (x, y) in a layer.
+     */
+    std::size_t index(int x, int y) const
+    {
+        if (layout == MAP_LAYOUT::row_major) {
+            return static_cast<std::size_t>(y) * static_cast<std::size_t>(width)
+                + static_cast<std::size_t>(x);
+        }
+        Tile_address a = tile_address(x, y);
+        return tile_slots[static_cast<std::size_t>(a.ty) * tiles_x + a.tx]
+            * tile_area + tile_offset(a);
+    }
+
+    /**
+     * \return The number of elements each layer needs. Tiled layouts pad
+     * the tiles on the right and bottom edges out to full tiles.
+     */
+    std::size_t storage_size() const;
+
+    /**
+     * \return The pixels covered by tile (tx, ty), clipped to the map.
+     */
+    SDL_Rect tile_rect(int tx, int ty) const;
+
+    /**
+     * Storage is split into blocks that are contiguous in memory, a row for
+     * row major and a tile for tiled layouts. Splitting work by block keeps
+     * each thread on its own memory.
+     */
+    std::size_t num_blocks() const
+    {
+        return (layout == MAP_LAYOUT::row_major ? height : tile_order.size());
+    }
+
+    /**
+     * Call fn(x, y, length, index) for each run of pixels in blocks
+     * [first, last) that is contiguous in memory, in memory order. Pixels
+     * (x, y) to (x + length - 1, y) are at index to index + length - 1.
+     */
+    template<typename F>
+    void for_each_span(std::size_t first, std::size_t last, F fn) const
+    {
+        if (layout == MAP_LAYOUT::row_major) {
+            for (std::size_t y=first; y<last; y++)
+                fn(0, (int) y, width, index(0, (int) y));
+            return;
+        }
+        for (std::size_t slot=first; slot<last; slot++) {
+            SDL_Rect r = tile_rect(tile_order[slot].tx, tile_order[slot].ty);
+            std::size_t i = slot * tile_area;
+            for (int y=r.y; y<r.y+r.h; y++) {
+                fn(r.x, y, r.w, i);
+                i += tile_size;
+            }
+        }
+    }
+
+    /**
+     * Call fn(x, y, length, index) for each contiguous run of pixels in
+     * the whole map, in memory order.
+     */
+    template<typename F>
+    void for_each_span(F fn) const
+    {
+        for_each_span(0, num_blocks(), fn);
+    }
+
+    /**
+     * Call fn(x, y, length, index) for each contiguous run of pixels
+     * inside area, which is clipped to the map. Tiled layouts are walked a
+     * tile at a time.
+     */
+    template<typename F>
+    void for_each_span(const SDL_Rect& area, F fn) const
+    {
+        SDL_Rect a = clip(area);
+        if (a.w <= 0 || a.h <= 0)
+            return;
+
+        if (layout == MAP_LAYOUT::row_major) {
+            for (int y=a.y; y<a.y+a.h; y++)
+                fn(a.x, y, a.w, index(a.x, y));
+            return;
+        }
+        for (int ty=a.y/tile_size; ty<=(a.y+a.h-1)/tile_size; ty++) {
+            for (int tx=a.x/tile_size; tx<=(a.x+a.w-1)/tile_size; tx++) {
+                SDL_Rect t = clip(tile_rect(tx, ty), a);
+                for (int y=t.y; y<t.y+t.h; y++)
+                    fn(t.x, y, t.w, index(t.x, y));
+            }
+        }
+    }
+
+    /**
+     * Call fn(x, y, index) for every pixel of the map, in memory order.
+     */
+    template<typename F>
+    void for_each_pixel(F fn) const
+    {
+        for_each_span([&fn](int x, int y, int length, std::size_t i) {
+            for (int k=0; k<length; k++)
+                fn(x + k, y, i + k);
+        });
+    }
+
+private:
+    MAP_LAYOUT layout;
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+
+    struct Tile {
+        int tx;
+        int ty;
+    };
+
+    std::vector<std::uint32_t> tile_slots;  /**< Slot of each tile, tiles in
+                                                row major order */
+    std::vector<Tile> tile_order;           /**< Tile in each slot */
+
+    /**
+     * \return r clipped to bounds.
+     */
+    static SDL_Rect clip(const SDL_Rect& r, const SDL_Rect& bounds);
+    SDL_Rect clip(const SDL_Rect& r) const
+    {
+        return clip(r, SDL_Rect{0, 0, width, height});
+    }
+};
+#endif
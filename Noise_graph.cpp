@@ -0,0 +1,655 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Noise_graph.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Building, describing and compiling noise graphs, see
+    Noise_graph.h
+*/
+#include "Noise_graph.h"
+#include "Tile_address.h"
+#include <algorithm>
+#include <climits>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+namespace {
+
+const NOISE_NODE all_nodes[] = {
+    NOISE_NODE::constant, NOISE_NODE::fbm, NOISE_NODE::ridged,
+    NOISE_NODE::scale_bias, NOISE_NODE::add, NOISE_NODE::multiply,
+    NOISE_NODE::select, NOISE_NODE::warp
+};
+
+int num_inputs(NOISE_NODE t)
+{
+    switch (t) {
+    case NOISE_NODE::constant:
+    case NOISE_NODE::fbm:
+    case NOISE_NODE::ridged:      return 0;
+    case NOISE_NODE::scale_bias:  return 1;
+    case NOISE_NODE::add:
+    case NOISE_NODE::multiply:    return 2;
+    case NOISE_NODE::select:
+    case NOISE_NODE::warp:        return 3;
+    }
+    return 0;
+}
+
+/**
+ * \return The settings a node of type t uses, as named in descriptions.
+ */
+std::vector<std::string> node_settings(NOISE_NODE t)
+{
+    switch (t) {
+    case NOISE_NODE::constant:    return {"value"};
+    case NOISE_NODE::fbm:         return {"seed", "frequency", "octaves",
+                                      "persistence", "lacunarity", "quality"};
+    case NOISE_NODE::ridged:      return {"seed", "frequency", "octaves",
+                                      "lacunarity", "quality"};
+    case NOISE_NODE::scale_bias:  return {"scale", "bias"};
+    case NOISE_NODE::select:      return {"lower", "upper", "falloff"};
+    case NOISE_NODE::warp:        return {"strength"};
+    default:                      return {};
+    }
+}
+
+/**
+ * \return The setting called name of n, as text or, if value is not NULL,
+ * after setting it from value. Throws if there is no such setting.
+ */
+std::string node_setting(Noise_node& n, const std::string& name,
+    const std::string* value = NULL)
+{
+    std::ostringstream out;
+    out << std::setprecision(17);
+    std::istringstream in{value ? *value : std::string{}};
+    auto setting = [&](auto& field) {
+        if (value != NULL && (!(in >> field) || !in.eof()))
+            throw std::runtime_error("Bad value for " + name + ": " + *value);
+        out << field;
+    };
+
+    if (name == "seed") setting(n.seed);
+    else if (name == "frequency") setting(n.frequency);
+    else if (name == "octaves") setting(n.octaves);
+    else if (name == "persistence") setting(n.persistence);
+    else if (name == "lacunarity") setting(n.lacunarity);
+    else if (name == "quality") {
+        const NOISE_QUALITY all[] = {NOISE_QUALITY::fast,
+            NOISE_QUALITY::standard, NOISE_QUALITY::best};
+        if (value != NULL) {
+            auto q = std::find_if(std::begin(all), std::end(all),
+                [&](NOISE_QUALITY q) {return *value == noise_quality_name(q);});
+            if (q == std::end(all))
+                throw std::runtime_error("Bad value for quality: " + *value);
+            n.quality = *q;
+        }
+        out << noise_quality_name(n.quality);
+    }
+    else if (name == "value") setting(n.value);
+    else if (name == "scale") setting(n.scale);
+    else if (name == "bias") setting(n.bias);
+    else if (name == "lower") setting(n.lower);
+    else if (name == "upper") setting(n.upper);
+    else if (name == "falloff") setting(n.falloff);
+    else if (name == "strength") setting(n.strength);
+    else
+        throw std::runtime_error("Unknown setting: " + name);
+    return out.str();
+}
+
+/**
+ * \return The cubic s-curve 3t^2 - 2t^3 that select blends with.
+ */
+inline double blend_curve(double t)
+{
+    return t * t * (3.0 - 2.0 * t);
+}
+
+}
+
+const char* noise_node_name(NOISE_NODE t)
+{
+    switch (t) {
+    case NOISE_NODE::constant:    return "constant";
+    case NOISE_NODE::fbm:         return "fbm";
+    case NOISE_NODE::ridged:      return "ridged";
+    case NOISE_NODE::scale_bias:  return "scale_bias";
+    case NOISE_NODE::add:         return "add";
+    case NOISE_NODE::multiply:    return "multiply";
+    case NOISE_NODE::select:      return "select";
+    case NOISE_NODE::warp:        return "warp";
+    }
+    return "unknown";
+}
+
+int Noise_graph::constant(double value)
+{
+    Noise_node n{NOISE_NODE::constant};
+    n.value = value;
+    return add_node(n);
+}
+
+int Noise_graph::fbm(int seed, double frequency, int octaves,
+    double persistence, double lacunarity)
+{
+    Noise_node n{NOISE_NODE::fbm};
+    n.seed = seed;
+    n.frequency = frequency;
+    n.octaves = octaves;
+    n.persistence = persistence;
+    n.lacunarity = lacunarity;
+    return add_node(n);
+}
+
+int Noise_graph::ridged(int seed, double frequency, int octaves,
+    double lacunarity)
+{
+    Noise_node n{NOISE_NODE::ridged};
+    n.seed = seed;
+    n.frequency = frequency;
+    n.octaves = octaves;
+    n.lacunarity = lacunarity;
+    return add_node(n);
+}
+
+int Noise_graph::scale_bias(int input, double scale, double bias)
+{
+    Noise_node n{NOISE_NODE::scale_bias};
+    n.inputs[0] = input;
+    n.scale = scale;
+    n.bias = bias;
+    return add_node(n);
+}
+
+int Noise_graph::add(int a, int b)
+{
+    Noise_node n{NOISE_NODE::add};
+    n.inputs[0] = a;
+    n.inputs[1] = b;
+    return add_node(n);
+}
+
+int Noise_graph::multiply(int a, int b)
+{
+    Noise_node n{NOISE_NODE::multiply};
+    n.inputs[0] = a;
+    n.inputs[1] = b;
+    return add_node(n);
+}
+
+int Noise_graph::select(int a, int b, int control, double lower,
+    double upper, double falloff)
+{
+    Noise_node n{NOISE_NODE::select};
+    n.inputs[0] = a;
+    n.inputs[1] = b;
+    n.inputs[2] = control;
+    n.lower = lower;
+    n.upper = upper;
+    n.falloff = falloff;
+    return add_node(n);
+}
+
+int Noise_graph::warp(int source, int dx, int dy, double strength)
+{
+    Noise_node n{NOISE_NODE::warp};
+    n.inputs[0] = source;
+    n.inputs[1] = dx;
+    n.inputs[2] = dy;
+    n.strength = strength;
+    return add_node(n);
+}
+
+int Noise_graph::add_node(const Noise_node& node)
+{
+    Noise_node n = node;
+    const int index = static_cast<int>(graph.size());
+    for (int i=0; i<3; i++) {
+        bool used = i < num_inputs(n.type);
+        if (used != (n.inputs[i] >= 0) || n.inputs[i] >= index) {
+            throw std::runtime_error(std::string{"Bad inputs to "}
+                + noise_node_name(n.type) + " node " + std::to_string(index));
+        }
+    }
+    if (n.octaves < 1 || n.octaves > 30 || n.frequency <= 0.0
+        || n.lacunarity <= 0.0 || n.falloff < 0.0 || n.lower > n.upper) {
+        throw std::runtime_error(std::string{"Bad settings for "}
+            + noise_node_name(n.type) + " node " + std::to_string(index));
+    }
+    /* As noise::module::Select, the edges can't overlap */
+    n.falloff = std::min(n.falloff, (n.upper - n.lower) / 2.0);
+    graph.push_back(n);
+    return index;
+}
+
+std::string Noise_graph::to_string() const
+{
+    std::ostringstream out;
+    for (std::size_t i=0; i<graph.size(); i++) {
+        Noise_node n = graph[i];
+        out << 'n' << i << " = " << noise_node_name(n.type);
+        for (int k=0; k<num_inputs(n.type); k++)
+            out << " n" << n.inputs[k];
+        for (const std::string& name : node_settings(n.type)) {
+            /* Left out at its default, so graphs written before there
+               was a quality keep their text and hash */
+            if (name == "quality" && n.quality == Noise_node{}.quality)
+                continue;
+            out << ' ' << name << '=' << node_setting(n, name);
+        }
+        out << '\n';
+    }
+    return out.str();
+}
+
+Noise_graph Noise_graph::parse(const std::string& text)
+{
+    Noise_graph g;
+    std::map<std::string, int> names;
+    std::istringstream lines{text};
+    std::string line;
+    for (int number=1; std::getline(lines, line); number++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream in{line};
+        std::vector<std::string> words;
+        std::string word;
+        while (in >> word)
+            words.push_back(word);
+        if (words.empty())
+            continue;
+
+        const std::string where = "Noise graph line "
+            + std::to_string(number) + ": ";
+        if (words.size() < 3 || words[1] != "=")
+            throw std::runtime_error(where + "expected name = type");
+        if (names.count(words[0]))
+            throw std::runtime_error(where + words[0] + " is already used");
+
+        auto type = std::find_if(std::begin(all_nodes), std::end(all_nodes),
+            [&](NOISE_NODE t) {return words[2] == noise_node_name(t);});
+        if (type == std::end(all_nodes))
+            throw std::runtime_error(where + "unknown type " + words[2]);
+
+        Noise_node n{*type};
+        const std::vector<std::string> settings = node_settings(n.type);
+        int inputs = 0;
+        for (std::size_t w=3; w<words.size(); w++) {
+            const std::size_t equals = words[w].find('=');
+            if (equals == std::string::npos) {
+                auto input = names.find(words[w]);
+                if (input == names.end() || inputs >= num_inputs(n.type))
+                    throw std::runtime_error(where + "bad input " + words[w]);
+                n.inputs[inputs++] = input->second;
+                continue;
+            }
+            const std::string name = words[w].substr(0, equals);
+            const std::string value = words[w].substr(equals + 1);
+            if (std::find(settings.begin(), settings.end(), name)
+                == settings.end())
+                throw std::runtime_error(where + words[2] + " has no "
+                    + name);
+            try {
+                node_setting(n, name, &value);
+            }
+            catch (std::runtime_error& e) {
+                throw std::runtime_error(where + e.what());
+            }
+        }
+        if (inputs != num_inputs(n.type)) {
+            throw std::runtime_error(where + words[2] + " needs "
+                + std::to_string(num_inputs(n.type)) + " inputs");
+        }
+
+        try {
+            names[words[0]] = g.add_node(n);
+        }
+        catch (std::runtime_error& e) {
+            throw std::runtime_error(where + e.what());
+        }
+    }
+    return g;
+}
+
+Noise_graph Noise_graph::terrain()
+{
+    Noise_graph g;
+    const int continents = g.fbm(0, 0.25, 6);
+    const int hills = g.fbm(1, 1.0, 4);
+    const int lowland = g.add(g.scale_bias(continents, 0.8, -0.1),
+        g.scale_bias(hills, 0.2, 0.0));
+
+    const int mountains = g.warp(g.ridged(2, 1.0, 6), g.fbm(3, 0.5, 3),
+        g.fbm(4, 0.5, 3), 0.5);
+    const int peaks = g.scale_bias(mountains, 0.45, 0.5);
+
+    g.select(lowland, peaks, continents, 0.3, 100.0, 0.15);
+    return g;
+}
+
+/**
+ * What is known about the values while compiling a graph. Values 0 and 1
+ * are the x and y coordinates, every operation writes a new value.
+ */
+struct Noise_kernel::Compile_state {
+    int num_values = 2;
+    std::vector<int> producer = {-1, -1};   /**< Operation writing each
+                                                value */
+    std::vector<bool> exclusive = {false, false};   /**< Values with only
+                                                        one reader */
+    std::vector<int> uses;      /**< Readers of each node of the graph */
+    std::map<std::tuple<int, int, int>, int> compiled; /**< Value of each
+                                                          node at (x, y) */
+};
+
+Noise_kernel::Noise_kernel(const Noise_graph& g)
+    :slots{0}, coordinates{-1, -1}, result{-1}, text{g.to_string()}
+{
+    if (g.nodes().empty())
+        throw std::runtime_error("Noise graph has no nodes");
+
+    graph_hash = 0xcbf29ce484222325ULL;
+    for (char c : text) {
+        graph_hash ^= static_cast<unsigned char>(c);
+        graph_hash *= 0x100000001b3ULL;
+    }
+
+    Compile_state state;
+    state.uses.assign(g.nodes().size(), 0);
+    for (const Noise_node& n : g.nodes())
+        for (int k=0; k<num_inputs(n.type); k++)
+            state.uses[n.inputs[k]]++;
+
+    result = compile(g, g.output(), 0, 1, state);
+    allocate_slots(state.num_values);
+}
+
+int Noise_kernel::emit(OP op, int in0, int in1, int in2, int x, int y,
+    const Noise_node& params, Compile_state& state)
+{
+    program.push_back(Operation{op, state.num_values, {in0, in1, in2}, x, y,
+        params, 1.0, 0.0, NULL});
+    state.producer.push_back(static_cast<int>(program.size()) - 1);
+    state.exclusive.push_back(false);
+    return state.num_values++;
+}
+
+int Noise_kernel::compile(const Noise_graph& g, int node, int x, int y,
+    Compile_state& state)
+{
+    const auto key = std::make_tuple(node, x, y);
+    auto found = state.compiled.find(key);
+    if (found != state.compiled.end())
+        return found->second;
+
+    const Noise_node& n = g.nodes()[node];
+    auto input = [&](int k) {return compile(g, n.inputs[k], x, y, state);};
+
+    /* Scale and bias are folded into the operation writing a value, when
+       nothing else reads it */
+    auto foldable = [&](int v) {return state.exclusive[v];};
+    auto fold = [&](int v, double scale, double bias) {
+        Operation& op = program[state.producer[v]];
+        op.scale *= scale;
+        op.bias = op.bias * scale + bias;
+    };
+    auto constant_value = [&](int v, double& value) {
+        if (!foldable(v) || program[state.producer[v]].op != OP::constant)
+            return false;
+        const Operation& op = program[state.producer[v]];
+        value = op.params.value * op.scale + op.bias;
+        return true;
+    };
+
+    int v = -1;
+    switch (n.type) {
+    case NOISE_NODE::constant:
+        v = emit(OP::constant, -1, -1, -1, -1, -1, n, state);
+        break;
+    case NOISE_NODE::fbm:
+        v = emit(OP::fbm, -1, -1, -1, x, y, n, state);
+        program.back().kernel = fbm_kernel(n.quality);
+        break;
+    case NOISE_NODE::ridged:
+        v = emit(OP::ridged, -1, -1, -1, x, y, n, state);
+        program.back().kernel = ridged_kernel(n.quality);
+        break;
+    case NOISE_NODE::scale_bias:
+        v = input(0);
+        if (foldable(v)) {
+            fold(v, n.scale, n.bias);
+        }
+        else {
+            v = emit(OP::copy, v, -1, -1, -1, -1, n, state);
+            program.back().scale = n.scale;
+            program.back().bias = n.bias;
+        }
+        break;
+    case NOISE_NODE::add:
+    case NOISE_NODE::multiply: {
+        const bool add = n.type == NOISE_NODE::add;
+        int a = input(0);
+        int b = input(1);
+        double c;
+        if (constant_value(a, c))
+            std::swap(a, b);
+        if (foldable(a) && constant_value(b, c)) {
+            /* The constant is left unread and dropped later */
+            fold(a, (add ? 1.0 : c), (add ? c : 0.0));
+            v = a;
+        }
+        else {
+            v = emit(add ? OP::add : OP::multiply, a, b, -1, -1, -1, n,
+                state);
+        }
+        break;
+    }
+    case NOISE_NODE::select: {
+        const int a = input(0);
+        const int b = input(1);
+        v = emit(OP::select, a, b, input(2), -1, -1, n, state);
+        break;
+    }
+    case NOISE_NODE::warp: {
+        /* The source is compiled again at the moved coordinates */
+        const int dx = input(1);
+        const int dy = input(2);
+        const int wx = emit(OP::offset, x, dx, -1, -1, -1, n, state);
+        const int wy = emit(OP::offset, y, dy, -1, -1, -1, n, state);
+        v = compile(g, n.inputs[0], wx, wy, state);
+        break;
+    }
+    }
+
+    state.exclusive[v] = (state.uses[node] <= 1);
+    state.compiled[key] = v;
+    return v;
+}
+
+void Noise_kernel::allocate_slots(int num_values)
+{
+    /* Drop operations nothing reads, working back from the result */
+    std::vector<bool> live(num_values, false);
+    live[result] = true;
+    std::vector<Operation> kept;
+    for (auto op = program.rbegin(); op != program.rend(); ++op) {
+        if (!live[op->out])
+            continue;
+        for (int v : {op->in[0], op->in[1], op->in[2], op->x, op->y})
+            if (v >= 0)
+                live[v] = true;
+        kept.push_back(*op);
+    }
+    program.assign(kept.rbegin(), kept.rend());
+
+    /* Give each value a slot from when it is written until its last read,
+       an operation may write to a slot it reads as the loops run over
+       samples in step */
+    std::vector<int> last_read(num_values, -1);
+    for (std::size_t i=0; i<program.size(); i++)
+        for (int v : {program[i].in[0], program[i].in[1], program[i].in[2],
+            program[i].x, program[i].y})
+            if (v >= 0)
+                last_read[v] = static_cast<int>(i);
+    last_read[result] = INT_MAX;
+
+    std::vector<int> slot_of(num_values, -1);
+    std::vector<int> free_slots;
+    auto take_slot = [&](int v) {
+        if (free_slots.empty()) {
+            slot_of[v] = slots++;
+        }
+        else {
+            slot_of[v] = free_slots.back();
+            free_slots.pop_back();
+        }
+    };
+    for (int v : {0, 1})
+        if (last_read[v] >= 0)
+            take_slot(v);
+    coordinates[0] = slot_of[0];
+    coordinates[1] = slot_of[1];
+
+    for (std::size_t i=0; i<program.size(); i++) {
+        Operation& op = program[i];
+        for (int* v : {&op.in[0], &op.in[1], &op.in[2], &op.x, &op.y}) {
+            if (*v < 0)
+                continue;
+            const int value = *v;
+            *v = slot_of[value];
+            if (last_read[value] == static_cast<int>(i)) {
+                free_slots.push_back(slot_of[value]);
+                last_read[value] = -1;  // Freed once if read twice
+            }
+        }
+        const int value = op.out;
+        take_slot(value);
+        op.out = slot_of[value];
+        if (value == result)
+            result = op.out;
+    }
+}
+
+bool Noise_kernel::evaluate(int px0, int py0, double frequency, int seed,
+    double z, double* out, const Generation_job* owner) const
+{
+    /* Kept by each thread between tiles, so a tile allocates nothing */
+    thread_local std::vector<double> buffers;
+    const std::size_t needed = static_cast<std::size_t>(slots) * tile_area;
+    if (buffers.size() < needed)
+        buffers.resize(needed);
+    auto slot = [&](int s) {return &buffers[s * tile_area];};
+
+    if (coordinates[0] >= 0) {
+        double* x = slot(coordinates[0]);
+        for (std::size_t i=0; i<tile_area; i++)
+            x[i] = frequency * (px0 + static_cast<int>(i & tile_mask));
+    }
+    if (coordinates[1] >= 0) {
+        double* y = slot(coordinates[1]);
+        for (std::size_t i=0; i<tile_area; i++)
+            y[i] = frequency * (py0 + static_cast<int>(i >> tile_shift));
+    }
+
+    for (const Operation& op : program) {
+        if (owner != NULL && owner->cancelled())
+            return false;
+
+        const Noise_node& p = op.params;
+        const double scale = op.scale;
+        const double bias = op.bias;
+        double* o = slot(op.out);
+        const double* a = (op.in[0] >= 0 ? slot(op.in[0]) : NULL);
+        const double* b = (op.in[1] >= 0 ? slot(op.in[1]) : NULL);
+        const double* c = (op.in[2] >= 0 ? slot(op.in[2]) : NULL);
+
+        switch (op.op) {
+        case OP::constant:
+            std::fill(o, o + tile_area, p.value * scale + bias);
+            break;
+        case OP::fbm:
+        case OP::ridged: {
+            Octave_settings s;
+            s.seed = seed + p.seed;
+            s.octaves = p.octaves;
+            s.frequency = p.frequency;
+            s.persistence = p.persistence;
+            s.lacunarity = p.lacunarity;
+            s.scale = scale;
+            s.bias = bias;
+            op.kernel(slot(op.x), slot(op.y), z, tile_area, s, o);
+            break;
+        }
+        case OP::copy:
+            for (std::size_t i=0; i<tile_area; i++)
+                o[i] = a[i] * scale + bias;
+            break;
+        case OP::add:
+            for (std::size_t i=0; i<tile_area; i++)
+                o[i] = (a[i] + b[i]) * scale + bias;
+            break;
+        case OP::multiply:
+            for (std::size_t i=0; i<tile_area; i++)
+                o[i] = a[i] * b[i] * scale + bias;
+            break;
+        case OP::select:
+            /* As noise::module::Select, blending over falloff either side
+               of each edge of the range */
+            for (std::size_t i=0; i<tile_area; i++) {
+                const double control = c[i];
+                double v;
+                if (control < p.lower - p.falloff
+                    || control > p.upper + p.falloff) {
+                    v = a[i];
+                }
+                else if (control < p.lower + p.falloff) {
+                    double t = blend_curve((control - p.lower + p.falloff)
+                        / (2.0 * p.falloff));
+                    v = a[i] + t * (b[i] - a[i]);
+                }
+                else if (control > p.upper - p.falloff) {
+                    double t = blend_curve((control - p.upper + p.falloff)
+                        / (2.0 * p.falloff));
+                    v = b[i] + t * (a[i] - b[i]);
+                }
+                else {
+                    v = b[i];
+                }
+                o[i] = v * scale + bias;
+            }
+            break;
+        case OP::offset:
+            for (std::size_t i=0; i<tile_area; i++)
+                o[i] = (a[i] + b[i] * p.strength) * scale + bias;
+            break;
+        }
+    }
+
+    std::copy(slot(result), slot(result) + tile_area, out);
+    return true;
+}
@@ -0,0 +1,205 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Noise_graph.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Terrain described as a graph of noise nodes, such as
+    fractals combined with arithmetic, selection and domain warping. A
+    graph is compiled into a Noise_kernel, a flat list of operations that
+    each run over a whole tile at once, so a graph costs a loop per node
+    per tile rather than a virtual call per node per pixel.
+*/
+#ifndef NOISE_GRAPH_H
+#define NOISE_GRAPH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Generation_job.h"
+#include "Noise_kernels.h"
+
+/**
+ * The kinds of node in a noise graph
+ */
+enum class NOISE_NODE {
+    constant,   /**< value */
+    fbm,        /**< Fractal gradient noise, like noise::module::Perlin */
+    ridged,     /**< Ridged multifractal, like noise::module::RidgedMulti */
+    scale_bias, /**< input * scale + bias */
+    add,        /**< input 0 + input 1 */
+    multiply,   /**< input 0 * input 1 */
+    select,     /**< input 1 where input 2 is in [lower, upper], input 0
+                    elsewhere, blended over falloff at the edges */
+    warp        /**< input 0 sampled at the coordinates moved by input 1
+                    and input 2 times strength */
+};
+
+/**
+ * \return The name of the node type t, as used in graph descriptions.
+ */
+const char* noise_node_name(NOISE_NODE t);
+
+struct Noise_node {
+    NOISE_NODE type;
+    int inputs[3] = {-1, -1, -1};   /**< Indices of input nodes, -1 if
+                                        unused */
+    int seed = 0;               /**< Added to the seed of the map */
+    double frequency = 1.0;     /**< Multiplies the map coordinates */
+    int octaves = 6;
+    double persistence = 0.5;
+    double lacunarity = 2.0;
+    NOISE_QUALITY quality = NOISE_QUALITY::best;
+    double value = 0.0;         /**< Of a constant */
+    double scale = 1.0;
+    double bias = 0.0;
+    double lower = -1.0;        /**< Of the range select picks input 1 in */
+    double upper = 1.0;
+    double falloff = 0.0;
+    double strength = 1.0;      /**< Of a warp, in map coordinates */
+};
+
+/**
+ * A noise graph under construction. Nodes can only use nodes added before
+ * them, and the last node added is the output.
+ */
+class Noise_graph {
+public:
+    /* Each adds a node and returns its index */
+    int constant(double value);
+    int fbm(int seed, double frequency = 1.0, int octaves = 6,
+        double persistence = 0.5, double lacunarity = 2.0);
+    int ridged(int seed, double frequency = 1.0, int octaves = 6,
+        double lacunarity = 2.0);
+    int scale_bias(int input, double scale, double bias);
+    int add(int a, int b);
+    int multiply(int a, int b);
+    int select(int a, int b, int control, double lower, double upper,
+        double falloff = 0.0);
+    int warp(int source, int dx, int dy, double strength);
+
+    /**
+     * Add a node, throws if its inputs or settings are invalid. The
+     * falloff of a select is limited to half its range.
+     * \return The index of the node.
+     */
+    int add_node(const Noise_node& n);
+
+    const std::vector<Noise_node>& nodes() const {return graph;}
+    int output() const {return static_cast<int>(graph.size()) - 1;}
+
+    /**
+     * \return The graph as text that parse() reads back, one node per
+     * line, e.g. "n2 = select n0 n1 n0 lower=0.1 upper=1 falloff=0.05".
+     * The quality of a node is only written if it isn't best.
+     */
+    std::string to_string() const;
+
+    /**
+     * Read a graph from text. Each line is "name = type inputs...
+     * key=value...", inputs are names of earlier lines and anything after
+     * a # is ignored. Throws on errors.
+     */
+    static Noise_graph parse(const std::string& text);
+
+    /**
+     * \return A graph of warped ridged mountains rising out of rolling
+     * continents.
+     */
+    static Noise_graph terrain();
+
+private:
+    std::vector<Noise_node> graph;
+};
+
+/**
+ * A noise graph compiled for evaluating whole tiles. Immutable, so one
+ * kernel can be shared by every thread.
+ */
+class Noise_kernel {
+public:
+    /**
+     * Compile a graph, throws if it is empty.
+     */
+    explicit Noise_kernel(const Noise_graph& g);
+
+    /**
+     * Evaluate the graph over a tile.
+     * \param px0 The pixel column of the top left of the tile.
+     * \param py0 The pixel row of the top left of the tile.
+     * \param frequency Pixel coordinates are scaled by this.
+     * \param seed Added to the seed of every node.
+     * \param z The third coordinate of every sample.
+     * \param out tile_area values, row major, in about [-1, 1].
+     * \param owner If not NULL the job is checked between operations.
+     * \return false if owner was cancelled before the tile was finished.
+     */
+    bool evaluate(int px0, int py0, double frequency, int seed, double z,
+        double* out, const Generation_job* owner = NULL) const;
+
+    /**
+     * \return A hash of the graph, for telling tiles of different graphs
+     * apart.
+     */
+    std::uint64_t hash() const {return graph_hash;}
+
+    /**
+     * \return The graph the kernel was compiled from, as text.
+     */
+    const std::string& description() const {return text;}
+
+    std::size_t num_operations() const {return program.size();}
+    int num_slots() const {return slots;}
+
+private:
+    /* The operations a graph is compiled to */
+    enum class OP {constant, fbm, ridged, copy, add, multiply, select,
+        offset};
+
+    struct Operation {
+        OP op;
+        int out;                /**< Slot written */
+        int in[3];              /**< Slots read, -1 if unused */
+        int x, y;               /**< Slots of the sample coordinates */
+        Noise_node params;      /**< Of the node compiled */
+        double scale, bias;     /**< Applied to every value written, so
+                                    scale_bias nodes cost nothing */
+        Noise_run_kernel kernel;    /**< Of fbm and ridged operations */
+    };
+
+    std::vector<Operation> program;
+    int slots;                  /**< Tile sized buffers needed */
+    int coordinates[2];         /**< Slots of x and y, -1 if unused */
+    int result;                 /**< Slot holding the output */
+    std::string text;
+    std::uint64_t graph_hash;
+
+    struct Compile_state;
+
+    int compile(const Noise_graph& g, int node, int x, int y,
+        Compile_state& state);
+    int emit(OP op, int in0, int in1, int in2, int x, int y,
+        const Noise_node& params, Compile_state& state);
+    void allocate_slots(int num_values);
+};
+#endif
@@ -0,0 +1,238 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Noise_kernels.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: The noise kernels and their dispatch tables, see
+    Noise_kernels.h
+*/
+#include "Noise_kernels.h"
+#include "Simplex_noise.h"
+#include <algorithm>
+
+namespace {
+
+/** Samples worked on together, small enough for the stack and L1 */
+constexpr std::size_t chunk_size = 256;
+
+/*
+The kernels work an octave at a time over a chunk of samples, rather than
+a sample at a time over its octaves, and make their sums in the same order
+as fbm_noise() and ridged_noise() so the values are exactly the same. A
+chunk is read in full before any of it is written, so out may alias x or y.
+
+The octave loop is deliberately left rolled: unrolling it for each octave
+count put a copy of gradient_noise() per octave in every kernel, which was
+slower and stopped the sample loops vectorizing.
+*/
+template<NOISE_QUALITY Q>
+void fbm_run(const double* x, const double* y, double z, std::size_t n,
+    const Octave_settings& s, double* out)
+{
+    double xs[chunk_size], ys[chunk_size], value[chunk_size];
+
+    for (std::size_t c=0; c<n; c+=chunk_size) {
+        const std::size_t m = std::min(chunk_size, n - c);
+        for (std::size_t i=0; i<m; i++) {
+            xs[i] = x[c + i] * s.frequency;
+            ys[i] = y[c + i] * s.frequency;
+            value[i] = 0.0;
+        }
+
+        double zs = z * s.frequency;
+        double amplitude = 1.0;
+        for (int o=0; o<s.octaves; o++) {
+            const std::int32_t seed = s.seed + o;
+            for (std::size_t i=0; i<m; i++) {
+                value[i] += gradient_noise<Q>(xs[i], ys[i], zs, seed)
+                    * amplitude;
+                xs[i] *= s.lacunarity;
+                ys[i] *= s.lacunarity;
+            }
+            zs *= s.lacunarity;
+            amplitude *= s.persistence;
+        }
+
+        for (std::size_t i=0; i<m; i++)
+            out[c + i] = value[i] * s.scale + s.bias;
+    }
+}
+
+template<NOISE_QUALITY Q>
+void ridged_run(const double* x, const double* y, double z, std::size_t n,
+    const Octave_settings& s, double* out)
+{
+    double xs[chunk_size], ys[chunk_size], value[chunk_size];
+    double weight[chunk_size];
+
+    for (std::size_t c=0; c<n; c+=chunk_size) {
+        const std::size_t m = std::min(chunk_size, n - c);
+        for (std::size_t i=0; i<m; i++) {
+            xs[i] = x[c + i] * s.frequency;
+            ys[i] = y[c + i] * s.frequency;
+            value[i] = 0.0;
+            weight[i] = 1.0;
+        }
+
+        double zs = z * s.frequency;
+        double spectral = 1.0;
+        for (int o=0; o<s.octaves; o++) {
+            const std::int32_t seed = s.seed + o;
+            for (std::size_t i=0; i<m; i++) {
+                value[i] += ridged_signal(gradient_noise<Q>(xs[i], ys[i], zs,
+                    seed), weight[i]) * spectral;
+                xs[i] *= s.lacunarity;
+                ys[i] *= s.lacunarity;
+            }
+            zs *= s.lacunarity;
+            spectral /= s.lacunarity;
+        }
+
+        for (std::size_t i=0; i<m; i++)
+            out[c + i] = (value[i] * 1.25 - 1.0) * s.scale + s.bias;
+    }
+}
+
+void simplex_run(const double* x, const double* y, double, std::size_t n,
+    const Octave_settings& s, double* out)
+{
+    double xs[chunk_size], ys[chunk_size], value[chunk_size];
+
+    for (std::size_t c=0; c<n; c+=chunk_size) {
+        const std::size_t m = std::min(chunk_size, n - c);
+        for (std::size_t i=0; i<m; i++) {
+            xs[i] = x[c + i] * s.frequency;
+            ys[i] = y[c + i] * s.frequency;
+            value[i] = 0.0;
+        }
+
+        double amplitude = 1.0;
+        for (int o=0; o<s.octaves; o++) {
+            const std::int32_t seed = s.seed + o;
+            for (std::size_t i=0; i<m; i++) {
+                value[i] += simplex_noise(xs[i], ys[i], seed) * amplitude;
+                xs[i] *= s.lacunarity;
+                ys[i] *= s.lacunarity;
+            }
+            amplitude *= s.persistence;
+        }
+
+        for (std::size_t i=0; i<m; i++)
+            out[c + i] = value[i] * s.scale + s.bias;
+    }
+}
+
+/** Samples a float offset may span in a row kernel */
+constexpr std::size_t row_run_size = 64;
+
+/*
+As fbm_run, in float. The y and z offsets and lattice points are the same
+for the whole row so are split once per octave.
+*/
+template<NOISE_QUALITY Q>
+void fbm_row_f32(double x, double y, double dx, double z, std::size_t n,
+    const Octave_settings& s, float* out)
+{
+    float value[row_run_size];
+
+    for (std::size_t c=0; c<n; c+=row_run_size) {
+        /* An int count, converting a size_t to float doesn't vectorize */
+        const int m = static_cast<int>(std::min(row_run_size, n - c));
+        for (int i=0; i<m; i++)
+            value[i] = 0.0f;
+
+        double xs = (x + c * dx) * s.frequency;
+        double ys = y * s.frequency;
+        double zs = z * s.frequency;
+        double step = dx * s.frequency;
+        float amplitude = 1.0f;
+        for (int o=0; o<s.octaves; o++) {
+            const std::int32_t seed = s.seed + o;
+            const std::int32_t x0 = noise_floor(xs);
+            const std::int32_t y0 = noise_floor(ys);
+            const std::int32_t z0 = noise_floor(zs);
+            const float fx = static_cast<float>(xs - x0);
+            const float fy = static_cast<float>(ys - y0);
+            const float fz = static_cast<float>(zs - z0);
+            const float fstep = static_cast<float>(step);
+            for (int i=0; i<m; i++) {
+                const float local = fx + fstep * static_cast<float>(i);
+                const std::int32_t k = noise_floor(local);
+                value[i] += gradient_noise_cell<Q>(x0 + k, y0, z0,
+                    local - static_cast<float>(k), fy, fz, seed) * amplitude;
+            }
+            xs *= s.lacunarity;
+            ys *= s.lacunarity;
+            zs *= s.lacunarity;
+            step *= s.lacunarity;
+            amplitude *= static_cast<float>(s.persistence);
+        }
+
+        const float scale = static_cast<float>(s.scale);
+        const float bias = static_cast<float>(s.bias);
+        for (int i=0; i<m; i++)
+            out[c + i] = value[i] * scale + bias;
+    }
+}
+
+/** By NOISE_QUALITY */
+const Noise_run_kernel fbm_kernels[] = {
+    &fbm_run<NOISE_QUALITY::fast>,
+    &fbm_run<NOISE_QUALITY::standard>,
+    &fbm_run<NOISE_QUALITY::best>
+};
+
+const Noise_run_kernel ridged_kernels[] = {
+    &ridged_run<NOISE_QUALITY::fast>,
+    &ridged_run<NOISE_QUALITY::standard>,
+    &ridged_run<NOISE_QUALITY::best>
+};
+
+const Noise_row_kernel_f32 fbm_row_kernels_f32[] = {
+    &fbm_row_f32<NOISE_QUALITY::fast>,
+    &fbm_row_f32<NOISE_QUALITY::standard>,
+    &fbm_row_f32<NOISE_QUALITY::best>
+};
+
+}
+
+Noise_run_kernel fbm_kernel(NOISE_QUALITY q)
+{
+    return fbm_kernels[static_cast<int>(q)];
+}
+
+Noise_run_kernel ridged_kernel(NOISE_QUALITY q)
+{
+    return ridged_kernels[static_cast<int>(q)];
+}
+
+Noise_run_kernel simplex_kernel()
+{
+    return &simplex_run;
+}
+
+Noise_row_kernel_f32 fbm_row_kernel_f32(NOISE_QUALITY q)
+{
+    return fbm_row_kernels_f32[static_cast<int>(q)];
+}
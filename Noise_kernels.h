@@ -0,0 +1,90 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Noise_kernels.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Fractal noise over runs of samples. A kernel is compiled
+    for each quality, so the interpolation curve is a constant, and works
+    an octave at a time across the samples, so the inner loop is one
+    inlined gradient_noise() call the compiler can vectorize. The kernel
+    for some settings is looked up once rather than decided per sample.
+*/
+#ifndef NOISE_KERNELS_H
+#define NOISE_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "Gradient_noise.h"
+
+/**
+ * Settings for running a kernel over samples
+ */
+struct Octave_settings {
+    std::int32_t seed = 0;
+    int octaves = 6;
+    double frequency = 1.0;     /**< Coordinates are scaled by this */
+    double persistence = 0.5;   /**< Ignored by ridged kernels */
+    double lacunarity = 2.0;
+    double scale = 1.0;         /**< Every value is scaled and biased */
+    double bias = 0.0;
+};
+
+/**
+ * Evaluates noise for n samples: out[i] = noise(x[i], y[i], z) * scale +
+ * bias. out may be x or y.
+ */
+typedef void (*Noise_run_kernel)(const double* x, const double* y, double z,
+    std::size_t n, const Octave_settings& s, double* out);
+
+/**
+ * \return The kernel giving fbm_noise<q>().
+ */
+Noise_run_kernel fbm_kernel(NOISE_QUALITY q);
+
+/**
+ * \return The kernel giving ridged_noise<q>().
+ */
+Noise_run_kernel ridged_kernel(NOISE_QUALITY q);
+
+/**
+ * \return The kernel giving simplex_fbm(), z is unused.
+ */
+Noise_run_kernel simplex_kernel();
+
+/**
+ * Evaluates noise in float for n samples along a row: out[i] = noise(x +
+ * i*dx, y, z) * scale + bias. Every octave splits the start of each run
+ * of samples into a lattice point and an offset in double, and only the
+ * offsets, which span at most 64 samples, are held in float. Precision is
+ * then the same anywhere on the map rather than falling off away from
+ * the origin.
+ */
+typedef void (*Noise_row_kernel_f32)(double x, double y, double dx, double z,
+    std::size_t n, const Octave_settings& s, float* out);
+
+/**
+ * \return The kernel giving fbm_noise<q>() in float.
+ */
+Noise_row_kernel_f32 fbm_row_kernel_f32(NOISE_QUALITY q);
+#endif
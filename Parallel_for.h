@@ -0,0 +1,93 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Parallel_for.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Split a range of work into one contiguous chunk per
+    hardware thread.
+*/
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+/**
+ * Call fn(chunk_begin, chunk_end) over [begin, end) split into one
+ * contiguous chunk per hardware thread, the calling thread takes the last
+ * chunk. Returns once every chunk is done, then rethrows the first
+ * exception thrown by any chunk.
+ * \param min_chunk Ranges smaller than this per thread are not split.
+ */
+template<typename F>
+void parallel_for(std::size_t begin, std::size_t end, F fn,
+    std::size_t min_chunk = 1)
+{
+    if (end <= begin)
+        return;
+
+    std::size_t threads = std::thread::hardware_concurrency();
+    std::size_t n = end - begin;
+    if (threads == 0)
+        threads = 1;
+    if (min_chunk > 0 && n / min_chunk < threads)
+        threads = (n / min_chunk > 0 ? n / min_chunk : 1);
+
+    if (threads <= 1) {
+        fn(begin, end);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(threads);
+    workers.reserve(threads - 1);
+    std::size_t chunk = n / threads;
+    std::size_t start = begin;
+    for (std::size_t t=0; t<threads-1; t++) {
+        workers.emplace_back([&fn, &errors, t, start, chunk] {
+            try {
+                fn(start, start + chunk);
+            }
+            catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+        start += chunk;
+    }
+    try {
+        fn(start, end);
+    }
+    catch (...) {
+        errors[threads - 1] = std::current_exception();
+    }
+
+    for (auto& w : workers)
+        w.join();
+    for (auto& e : errors)
+        if (e)
+            std::rethrow_exception(e);
+}
+#endif
@@ -29,9 +29,95 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #ifndef PERLIN_NOISE_GENERATOR_H
 #define PERLIN_NOISE_GENERATOR_H
+#include <memory>
 #include <libnoise/module/perlin.h>
+
+class Noise_kernel;
+struct Heightfield;
+
+/**
+ * What makes the noise of a map that has no graph
+ */
+enum class NOISE_ENGINE {
+    libnoise,       /**< noise::module::Perlin, one sample at a time */
+    gradient,       /**< fbm_kernel(), a row at a time */
+    gradient_f32,   /**< As gradient in float, see fbm_row_kernel_f32() */
+    simplex,        /**< simplex_kernel(), 2D, a row at a time */
+    diamond_square, /**< Whole map, see Heightfield.h */
+    spectral        /**< Whole map, see Heightfield.h */
+};
+constexpr int num_noise_engines = 6;
+
+/**
+ * \return A printable name for the engine e.
+ */
+inline const char* noise_engine_name(NOISE_ENGINE e)
+{
+    switch (e) {
+    case NOISE_ENGINE::libnoise:        return "libnoise";
+    case NOISE_ENGINE::gradient:        return "gradient";
+    case NOISE_ENGINE::gradient_f32:    return "gradient_f32";
+    case NOISE_ENGINE::simplex:         return "simplex";
+    case NOISE_ENGINE::diamond_square:  return "diamond_square";
+    case NOISE_ENGINE::spectral:        return "spectral";
+    }
+    return "unknown";
+}
+
+/**
+ * \return true if the engine e makes a whole map at once, tiles can then
+ * only be cut from a Heightfield it made.
+ */
+inline bool whole_map_engine(NOISE_ENGINE e)
+{
+    return e == NOISE_ENGINE::diamond_square || e == NOISE_ENGINE::spectral;
+}
+
+/**
+ * Everything that decides the noise a map is generated from. The defaults
+ * are those of noise::module::Perlin.
+ */
+struct Noise_settings {
+    int seed = 0;               /**< Seed of the noise */
+    double frequency = 1.0;     /**< Pixel coordinates are scaled by this */
+    int octaves = 6;            /**< Number of octaves, in [1, 30] */
+    double persistence = 0.5;   /**< Amplitude multiplier per octave */
+    double lacunarity = 2.0;    /**< Frequency multiplier per octave */
+    noise::NoiseQuality quality = noise::QUALITY_STD;
+    NOISE_ENGINE engine = NOISE_ENGINE::libnoise;
+    double adaptive_tolerance = 0.0;    /**< If above 0, heights are
+                                            interpolated from a coarse
+                                            lattice with errors over this
+                                            refined, see
+                                            Adaptive_sampling.h */
+    std::shared_ptr<const Noise_kernel> graph;  /**< If set, the map is
+                                                    generated from this
+                                                    graph instead of the
+                                                    octaves above */
+    std::shared_ptr<const Heightfield> field;   /**< Made by a whole map
+                                                    engine, tiles are cut
+                                                    from it */
+};
+
 struct Perlin_noise_generator {
     noise::module::Perlin generator;
+
+    Perlin_noise_generator() {}
+
+    /**
+     * Constructor
+     * \param s The seed and octave settings to use, frequency is applied
+     * by the caller.
+     */
+    Perlin_noise_generator(const Noise_settings& s)
+    {
+        generator.SetSeed(s.seed);
+        generator.SetOctaveCount(s.octaves);
+        generator.SetPersistence(s.persistence);
+        generator.SetLacunarity(s.lacunarity);
+        generator.SetNoiseQuality(s.quality);
+    }
+
     double get_num(double x, double y, double z=0.5f)
     {
         return (generator.GetValue(x, y, z) / 2.0f + 0.5f);
@@ -28,23 +28,31 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
     Description: Defines a pixel map, see Pixel_map.h
 */
 #include "Pixel_map.h"
+#include "Heightfield.h"
 #include "Perlin_noise_generator.h"
 #include "Logger.h"
+#include "EasyBMP.h"
+#include "Parallel_for.h"
+#include "Thread_pool.h"
+#include <algorithm>
+#include <utility>
 #include <libnoise/module/perlin.h>
 #include <climits>
+#include <cstring>
 
 Pixel_map::Pixel_map(SDL_Renderer* r, int w, int h, int pl, double z)
-    :renderer{r}
+    :index_image{NULL}, shown_image{NULL}, anim_image{NULL},
+    anim_width{0}, anim_height{0}, animating{false}, arena{NULL}, map{NULL},
+    biome_layer{NULL}, biome_layer_valid{false},
+    render_mode{RENDER_MODE::per_pixel}, error_reported{false},
+    tile_cache{NULL}, renderer{r}
 {
     width = (w<0 ? 100 : w);
     height = (h<0 ? 100 : h);
     pixel_length = (pl<0 ? 1 : pl);
     zoom_factor = (z<0 ? 1.0f : z);
 
-    map = new Pixel[width * height];
-    if (map == NULL) {
-        throw std::runtime_error("Failed to allocate pixel map array");
-    }
+    allocate_layers(HEIGHT_FORMAT::float64, MAP_LAYOUT::row_major);
 
     map_image = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
         SDL_TEXTUREACCESS_TARGET, width, height);
@@ -53,81 +61,109 @@ Pixel_map::Pixel_map(SDL_Renderer* r, int w, int h, int pl, double z)
         throw std::runtime_error("Failed to create map_image: " +
             std::string{SDL_GetError()});
 
-    zero_map_pixels();
-
-    double new_width = width*zoom_factor;
-    double new_height = height*zoom_factor;
-
-    /* Check if values can fit in an int */
-    if (new_width > INT_MAX)
-        new_width = INT_MAX;
-    if (new_height > INT_MAX)
-        new_width = INT_MAX;
+    reset_palette();
 
-    source_location = SDL_Rect{0, 0, (int) new_width, (int) new_height};
+    source_location = SDL_Rect{0, 0, 0, 0};
+    update_source_size();
 
     generate_color = Random_color_generator();
 }
 
 Pixel_map::~Pixel_map()
 {
-    delete[] map;
+    cancel_generation();
+    delete arena;
     SDL_DestroyTexture(map_image);
+    if (index_image != NULL)
+        SDL_DestroyTexture(index_image);
+    if (anim_image != NULL)
+        SDL_DestroyTexture(anim_image);
     renderer = NULL;    //Note: this class does not own the renderer. Is this
                         // still nedded? Likely not.
 }
 
+void Pixel_map::allocate_layers(HEIGHT_FORMAT f, MAP_LAYOUT l)
+{
+    cancel_generation();
+    const Map_layout new_layout{width, height, l};
+    const std::size_t n = new_layout.storage_size();
+    const std::size_t height_bytes = n * height_format_size(f);
+
+    /* Allocate everything before touching the map, so if any of it throws
+       the old layers are still whole */
+    std::unique_ptr<Map_arena> fresh{new Map_arena(
+        Map_arena::padded(n * sizeof(Pixel)) + Map_arena::padded(n)
+        + Map_arena::padded(height_bytes))};
+    Pixel* new_map = fresh->allocate_array<Pixel>(n);
+    Uint8* new_biomes = fresh->allocate_array<Uint8>(n);
+    void* new_heights = fresh->allocate(height_bytes);
+
+    delete arena;
+    arena = fresh.release();
+    layout = new_layout;
+    map = new_map;
+    biome_layer = new_biomes;
+    heights.attach(new_heights, n, f);
+
+    LOG("Allocated " + std::to_string(arena->capacity() >> 20)
+        + "MB for map layers, huge pages "
+        + (arena->huge_pages() ? "on" : "off"));
+
+    /* The arena is untouched, so this is where every page is faulted in */
+    zero_map_pixels();
+}
+
 void Pixel_map::zero_map_pixels()
 {
-    for (int y=0; y<height; y++) {
-        for (int x=0; x<width; x++) {
-            map[y*width + x] = Pixel{SDL_Rect{x, y, pixel_length, pixel_length},
-                BIOME::empty, 0, 0, 0, 0.0f};
-        }
-    }
+    parallel_for(0, layout.num_blocks(),
+        [this](std::size_t first, std::size_t last) {
+            layout.for_each_span(first, last,
+                [this](int x0, int y, int length, std::size_t i0) {
+                    for (int k=0; k<length; k++) {
+                        const int x = x0 + k;
+                        const std::size_t i = i0 + k;
+                        map[i] = Pixel{
+                            SDL_Rect{x, y, pixel_length, pixel_length},
+                            BIOME::empty, 0, 0, 0};
+                        biome_layer[i] = static_cast<Uint8>(BIOME::empty);
+                        heights.set(i, 0.0);
+                    }
+                });
+        }, 4);
+    biome_layer_valid = false;
 }
 
 void Pixel_map::fill_color_static()
 {
-    for (int y=0; y<height; y++) {
-        for (int x=0; x<width; x++) {
-            map[y*width + x].ID = BIOME::empty;
-            map[y*width + x].r = generate_color();
-            map[y*width + x].g = generate_color();
-            map[y*width + x].b = generate_color();
-            map[y*width + x].height = 0.0f;
-        }
-    }
+    cancel_generation();
+    biome_layer_valid = false;
+    layout.for_each_pixel([&](int x, int y, std::size_t i) {
+        map[i].ID = BIOME::empty;
+        map[i].r = generate_color();
+        map[i].g = generate_color();
+        map[i].b = generate_color();
+        heights.set(i, 0.0);
+    });
 }
 
 void Pixel_map::fill_static()
 {
-    for (int y=0; y<height; y++) {
-        for (int x=0; x<width; x++) {
-            Uint8 color = generate_color();
-            map[y*width + x].ID = BIOME::empty;
-            map[y*width + x].r = color;
-            map[y*width + x].g = color;
-            map[y*width + x].b = color;
-            map[y*width + x].height = 0.0f;
-        }
-    }
+    cancel_generation();
+    biome_layer_valid = false;
+    layout.for_each_pixel([&](int x, int y, std::size_t i) {
+        Uint8 color = generate_color();
+        map[i].ID = BIOME::empty;
+        map[i].r = color;
+        map[i].g = color;
+        map[i].b = color;
+        heights.set(i, 0.0);
+    });
 }
 
 void Pixel_map::fill_perlin_noise(double freq)
 {
-    Perlin_noise_generator generator{};
-    for (int y=0; y<height; y++) {
-        for (int x=0; x<width; x++) {
-            map[y*width + x].height = generator.get_num(freq*x, freq*y);
-
-            Uint8 color = map[y*width + x].height * 255;
-            map[y*width + x].r = color;
-            map[y*width + x].g = color;
-            map[y*width + x].b = color;
-            map[y*width + x].ID = BIOME::empty;
-        }
-    }
+    start_perlin_noise(freq);
+    job->wait();
 }
 
 void Pixel_map::fill_color_perlin_noise(double freq)
@@ -136,95 +172,400 @@ void Pixel_map::fill_color_perlin_noise(double freq)
 
 void Pixel_map::fill_perlin_map(double freq)
 {
-    Perlin_noise_generator generator{};
-    for (int y=0; y<height; y++) {
-        for (int x=0; x<width; x++) {
-            double temp_height = generator.get_num(freq*x, freq*y);
+    start_perlin_map(freq);
+    job->wait();
+}
 
-            if (temp_height < 0.55) {    //Deep sea
-                map[y*width + x].ID = BIOME::deep_sea;
-                map[y*width + x].r = 0;
-    			map[y*width + x].g = 0;
-    			map[y*width + x].b = 130;
-            }
-            else if (temp_height < 0.57) {     //If under water table
-                map[y*width + x].ID = BIOME::shore;
-                map[y*width + x].r = 0;
-    			map[y*width + x].g = 0;
-    			map[y*width + x].b = 227;
-            }
-            else if (temp_height < 0.59) {     //sand beaches
-                map[y*width + x].ID = BIOME::beach;
-                map[y*width + x].r = 240;
-    			map[y*width + x].g = 255;
-    			map[y*width + x].b = 140;
-            }
-            else if (temp_height < 0.8) { //grass
-                map[y*width + x].ID = BIOME::grassland;
-                map[y*width + x].r = 0;
-    			map[y*width + x].g = 175;
-    			map[y*width + x].b = 0;
-            }
-            else if (temp_height < 0.9) {    //darker grass
-                map[y*width + x].ID = BIOME::woodland;
-                map[y*width + x].r = 0;
-    			map[y*width + x].g = 145;
-    			map[y*width + x].b = 0;
+void Pixel_map::start_perlin_noise(double freq)
+{
+    noise.frequency = freq;
+    start_job(FILL::perlin_noise);
+}
+
+void Pixel_map::start_perlin_map(double freq)
+{
+    noise.frequency = freq;
+    start_job(FILL::perlin_map);
+}
+
+void Pixel_map::start_job(FILL kind)
+{
+    /* A new fill overwrites every tile, so the old one is obsolete */
+    cancel_generation();
+    biome_layer_valid = (kind == FILL::perlin_map);
+
+    std::vector<Tile_id> tiles = tiles_by_priority();
+    std::shared_ptr<Generation_job> new_job =
+        std::make_shared<Generation_job>(tiles.size());
+    /* Shared so a whole map field can be added before the tiles run */
+    const std::shared_ptr<Noise_settings> settings =
+        std::make_shared<Noise_settings>(noise);
+
+    std::vector<Thread_pool::Task> tasks;
+    tasks.reserve(tiles.size());
+    for (const Tile_id& t : tiles) {
+        tasks.push_back([this, new_job, kind, settings, t] {
+            /* Every tile must be counted, or wait() never returns */
+            try {
+                if (!new_job->cancelled()
+                    && produce_tile(kind, *settings, t, *new_job)) {
+                    new_job->tile_done(t);
+                    return;
+                }
             }
-            else if (temp_height < 0.99999) {    //rock
-                map[y*width + x].ID = BIOME::mountain;
-                map[y*width + x].r = 140;
-    			map[y*width + x].g = 140;
-    			map[y*width + x].b = 140;
+            catch (std::exception& e) {
+                new_job->tile_failed(e.what());
+                return;
             }
-            else {      //snow caps
-                map[y*width + x].ID = BIOME::snow;
-                map[y*width + x].r = 240;
-    			map[y*width + x].g = 240;
-    			map[y*width + x].b = 240;
+            catch (...) {
+                new_job->tile_failed("Unknown error");
+                return;
             }
-            map[y*width + x].height = temp_height;
+            new_job->tile_skipped();
+        });
+    }
+
+    job = new_job;
+    error_reported = false;
+    if (!whole_map_engine(settings->engine) || settings->graph) {
+        default_pool().submit(tasks);
+        return;
+    }
+
+    /* The field is made on a worker, then the tiles are cut from it. If
+       cancelled the tiles still run, and skip themselves. If it can't be
+       made every tile fails, so the job still finishes. */
+    const int w = width;
+    const int h = height;
+    auto pending = std::make_shared<std::vector<Thread_pool::Task>>(
+        std::move(tasks));
+    default_pool().submit([new_job, settings, pending, w, h] {
+        std::string error;
+        try {
+            settings->field = make_heightfield(*settings, w, h,
+                new_job.get());
+        }
+        catch (std::exception& e) {
+            error = e.what();
+        }
+        catch (...) {
+            error = "Unknown error";
+        }
+        if (error.empty()) {
+            default_pool().submit(*pending);
+            return;
         }
+        new_job->cancel();
+        for (std::size_t i=0; i<pending->size(); i++)
+            new_job->tile_failed(error);
+    });
+}
+
+std::vector<Tile_id> Pixel_map::tiles_by_priority() const
+{
+    std::vector<Tile_id> tiles;
+    tiles.reserve(static_cast<std::size_t>(num_tiles_x()) * num_tiles_y());
+    for (int ty=0; ty<num_tiles_y(); ty++)
+        for (int tx=0; tx<num_tiles_x(); tx++)
+            tiles.push_back(Tile_id{tx, ty});
+
+    /* Tiles on screen first, then outwards from the centre of the screen */
+    const SDL_Rect& view = source_location;
+    const double cx = view.x + view.w / 2.0;
+    const double cy = view.y + view.h / 2.0;
+    auto priority = [this, &view, cx, cy](const Tile_id& t) {
+        SDL_Rect r = tile_rect(t.tx, t.ty);
+        bool visible = r.x < view.x + view.w && r.x + r.w > view.x
+            && r.y < view.y + view.h && r.y + r.h > view.y;
+        double dx = r.x + r.w / 2.0 - cx;
+        double dy = r.y + r.h / 2.0 - cy;
+        return std::make_pair(!visible, dx*dx + dy*dy);
+    };
+    std::stable_sort(tiles.begin(), tiles.end(),
+        [&priority](const Tile_id& a, const Tile_id& b) {
+            return priority(a) < priority(b);
+        });
+    return tiles;
+}
+
+bool Pixel_map::produce_tile(FILL kind, const Noise_settings& s,
+    Tile_id t, const Generation_job& owner)
+{
+    if (tile_cache != NULL) {
+        std::shared_ptr<const Tile_data> tile = tile_cache->get(s,
+            heights.format(), t, &owner);
+        if (!tile)
+            return false;
+        copy_tile(kind, *tile);
+        return true;
     }
+
+    Tile_data tile{heights.format()};
+    if (!generate_tile(s, t, tile, &owner))
+        return false;
+    copy_tile(kind, tile);
+    return true;
+}
+
+void Pixel_map::copy_tile(FILL kind, const Tile_data& tile)
+{
+    const int x0 = tile.id.tx * tile_size;
+    const int y0 = tile.id.ty * tile_size;
+    layout.for_each_span(tile_rect(tile.id.tx, tile.id.ty),
+        [&](int x, int y, int length, std::size_t i0) {
+            const std::size_t src = static_cast<std::size_t>(y - y0)
+                * tile_size + (x - x0);
+            heights.copy_from(tile.heights, src, i0, length);
+
+            for (int k=0; k<length; k++) {
+                const std::size_t i = i0 + k;
+                if (kind == FILL::perlin_noise) {
+                    Uint8 color = heights.grey(i);
+                    map[i].r = color;
+                    map[i].g = color;
+                    map[i].b = color;
+                    map[i].ID = BIOME::empty;
+                    continue;
+                }
+
+                Uint8 biome = tile.biomes[src + k];
+                const SDL_Color& c = palette[biome];
+                map[i].ID = static_cast<BIOME>(biome);
+                map[i].r = c.r;
+                map[i].g = c.g;
+                map[i].b = c.b;
+                biome_layer[i] = biome;
+            }
+        });
+}
+
+void Pixel_map::set_noise_settings(const Noise_settings& s)
+{
+    noise = s;
+}
+
+void Pixel_map::set_tile_cache(Tile_cache* cache)
+{
+    cancel_generation();
+    tile_cache = cache;
+}
+
+bool Pixel_map::generating() const
+{
+    return job && !job->done();
+}
+
+Progress_report Pixel_map::generation_progress() const
+{
+    return (job ? job->progress().report() : Progress_report{});
+}
+
+void Pixel_map::finish_generation()
+{
+    if (!job)
+        return;
+    job->wait();
+    report_generation_error();
+}
+
+void Pixel_map::report_generation_error()
+{
+    if (job && !job->error().empty() && !error_reported) {
+        LOG("Generation failed: " + job->error());
+        error_reported = true;
+    }
+}
+
+void Pixel_map::cancel_generation()
+{
+    if (!job)
+        return;
+
+    job->cancel();
+    job->wait();
+    report_generation_error();
+    if (job->num_skipped() > 0) {
+        LOG("Cancelled " + std::to_string(job->num_skipped()) + " of "
+            + std::to_string(job->num_tiles()) + " tiles");
+    }
+    job.reset();
+}
+
+int Pixel_map::upload_finished_tiles()
+{
+    if (!job)
+        return 0;
+
+    std::vector<Tile_id> tiles = job->take_finished();
+    for (const Tile_id& t : tiles)
+        render_area(tile_rect(t.tx, t.ty));
+    if (job->done())
+        report_generation_error();
+    return static_cast<int>(tiles.size());
 }
 
 bool Pixel_map::render()
+{
+    /* Tiles still being generated would be drawn half finished */
+    finish_generation();
+    if (job)
+        job->take_finished();
+    render_area(SDL_Rect{0, 0, width, height});
+    return true;
+}
+
+void Pixel_map::render_area(const SDL_Rect& area)
+{
+    if (render_mode == RENDER_MODE::indexed && biome_layer_valid)
+        render_indexed(area);
+    else
+        render_pixels(area);
+}
+
+void Pixel_map::render_pixels(const SDL_Rect& area)
 {
     if (SDL_SetRenderTarget(renderer, map_image) < 0) {
         throw std::runtime_error("Failed to change rendering target to map_image.");
     }
 
-    for (int y=0; y<height; y++) {
-        for (int x=0; x<width; x++) {
-            const Pixel* p = &map[y*width + x];
+    layout.for_each_span(area, [&](int x0, int y, int length, std::size_t i0) {
+        for (int k=0; k<length; k++) {
+            const Pixel* p = &map[i0 + k];
             SDL_SetRenderDrawColor(renderer, p->r, p->g, p->b,
                 SDL_ALPHA_OPAQUE);
 
             SDL_RenderFillRect(renderer, &p->rect);
         }
-    }
+    });
 
     if (SDL_SetRenderTarget(renderer, NULL) < 0) {
         throw std::runtime_error("Failed to revert renderer");
     }
+    shown_image = map_image;
+}
+
+void Pixel_map::render_indexed(const SDL_Rect& area)
+{
+    if (index_image == NULL) {
+        index_image = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+            SDL_TEXTUREACCESS_STREAMING, width, height);
+        if (index_image == NULL)
+            throw std::runtime_error("Failed to create index_image: " +
+                std::string{SDL_GetError()});
+    }
+
+    Uint32 lut[256];
+    pack_palette(lut);
+
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(index_image, &area, &pixels, &pitch) != 0) {
+        throw std::runtime_error("Failed to lock index_image: " +
+            std::string{SDL_GetError()});
+    }
+
+    /* pixels points at the top left of area */
+    layout.for_each_span(area, [&](int x, int y, int length, std::size_t i) {
+        const Uint8* src = &biome_layer[i];
+        Uint32* dst = reinterpret_cast<Uint32*>(static_cast<Uint8*>(pixels)
+            + static_cast<std::size_t>(y - area.y)*pitch) + (x - area.x);
+        for (int k=0; k<length; k++)
+            dst[k] = lut[src[k]];
+    });
+
+    SDL_UnlockTexture(index_image);
+    shown_image = index_image;
+}
+
+void Pixel_map::pack_palette(Uint32* lut) const
+{
+    for (int i=0; i<256; i++) {
+        lut[i] = (Uint32{palette[i].r} << 24) | (Uint32{palette[i].g} << 16)
+            | (Uint32{palette[i].b} << 8) | SDL_ALPHA_OPAQUE;
+    }
+}
+
+void Pixel_map::upload_animation(const Animated_noise& a)
+{
+    if (a.width() == 0 || a.height() == 0)
+        return;
+    if (anim_image == NULL || a.width() != anim_width
+        || a.height() != anim_height) {
+        if (anim_image != NULL)
+            SDL_DestroyTexture(anim_image);
+        anim_image = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+            SDL_TEXTUREACCESS_STREAMING, a.width(), a.height());
+        if (anim_image == NULL)
+            throw std::runtime_error("Failed to create anim_image: " +
+                std::string{SDL_GetError()});
+        anim_width = a.width();
+        anim_height = a.height();
+    }
+
+    Uint32 lut[256];
+    pack_palette(lut);
+
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(anim_image, NULL, &pixels, &pitch) != 0) {
+        throw std::runtime_error("Failed to lock anim_image: " +
+            std::string{SDL_GetError()});
+    }
+    const Uint8* src = a.biomes().data();
+    for (int y=0; y<anim_height; y++) {
+        Uint32* dst = reinterpret_cast<Uint32*>(static_cast<Uint8*>(pixels)
+            + static_cast<std::size_t>(y)*pitch);
+        for (int x=0; x<anim_width; x++)
+            dst[x] = lut[src[x]];
+        src += anim_width;
+    }
+    SDL_UnlockTexture(anim_image);
+    animating = true;
+}
+
+void Pixel_map::set_render_mode(RENDER_MODE m)
+{
+    render_mode = m;
+}
+
+void Pixel_map::set_biome_color(BIOME b, SDL_Color c)
+{
+    palette[static_cast<Uint8>(b)] = SDL_Color{c.r, c.g, c.b,
+        SDL_ALPHA_OPAQUE};
+}
+
+void Pixel_map::reset_palette()
+{
+    for (int i=0; i<256; i++)
+        palette[i] = SDL_Color{0, 0, 0, SDL_ALPHA_OPAQUE};
+
+    for (int i=0; i<num_biomes; i++) {
+        Biome_color c = default_biome_color(static_cast<BIOME>(i));
+        palette[i] = SDL_Color{c.r, c.g, c.b, SDL_ALPHA_OPAQUE};
+    }
 }
 
 void Pixel_map::zoom(double z)
 {
     if (z > 0) {
         zoom_factor = z;
-        double new_width = width*zoom_factor;
-        double new_height = height*zoom_factor;
+        update_source_size();
+    }
+}
 
-        /* Check if values can fit in an int */
-        if (new_width > INT_MAX)
-            new_width = INT_MAX;
-        if (new_height > INT_MAX)
-            new_width = INT_MAX;
+void Pixel_map::update_source_size()
+{
+    double new_width = width*zoom_factor;
+    double new_height = height*zoom_factor;
 
-        source_location.w = (int) new_width;
-        source_location.h = (int) new_height;
-    }
+    /* Check if values can fit in an int */
+    if (new_width > INT_MAX)
+        new_width = INT_MAX;
+    if (new_height > INT_MAX)
+        new_height = INT_MAX;
+
+    source_location.w = (int) new_width;
+    source_location.h = (int) new_height;
 }
 
 void Pixel_map::set_source_location(int x, int y)
@@ -243,11 +584,108 @@ void Pixel_map::increment_zoom(double inc)
         zoom(zoom_factor + inc);
 }
 
+void Pixel_map::set_height_format(HEIGHT_FORMAT f)
+{
+    allocate_layers(f, layout.kind());
+}
+
+void Pixel_map::set_layout(MAP_LAYOUT l)
+{
+    allocate_layers(heights.format(), l);
+}
+
+bool Pixel_map::export_bmp(const std::string& height_file,
+    const std::string& color_file)
+{
+    finish_generation();
+    BMP height_image, color_image;
+    height_image.SetSize(width, height);
+    height_image.SetBitDepth(24);
+    color_image.SetSize(width, height);
+    color_image.SetBitDepth(24);
+
+    layout.for_each_pixel([&](int x, int y, std::size_t i) {
+        Uint8 grey = heights.grey(i);
+        RGBApixel* h = height_image(x, y);
+        h->Red = grey;
+        h->Green = grey;
+        h->Blue = grey;
+        h->Alpha = 0;
+
+        const Pixel& p = map[i];
+        RGBApixel* c = color_image(x, y);
+        c->Red = p.r;
+        c->Green = p.g;
+        c->Blue = p.b;
+        c->Alpha = 0;
+    });
+
+    return height_image.WriteToFile(height_file.c_str())
+        && color_image.WriteToFile(color_file.c_str());
+}
+
+void Pixel_map::export_region(const std::string& filename)
+{
+    finish_generation();
+    Region_writer region{filename, width, height, heights.format(),
+        tile_key(noise, heights.format())};
+
+    const std::size_t n = static_cast<std::size_t>(num_tiles_x())
+        * num_tiles_y();
+    parallel_for(0, n, [&](std::size_t first, std::size_t last) {
+        Tile_data tile{heights.format()};
+        for (std::size_t k=first; k<last; k++) {
+            tile.id = Tile_id{static_cast<int>(k % num_tiles_x()),
+                static_cast<int>(k / num_tiles_x())};
+            /* Parts of edge tiles outside the map are stored as empty */
+            std::fill(tile.biomes.begin(), tile.biomes.end(), 0);
+            std::memset(tile.heights.raw(), 0, tile.heights.bytes());
+            const int x0 = tile.id.tx * tile_size;
+            const int y0 = tile.id.ty * tile_size;
+            layout.for_each_span(tile_rect(tile.id.tx, tile.id.ty),
+                [&](int x, int y, int length, std::size_t i0) {
+                    const std::size_t dst = static_cast<std::size_t>(y - y0)
+                        * tile_size + (x - x0);
+                    tile.heights.copy_from(heights, i0, dst, length);
+                    for (int j=0; j<length; j++)
+                        tile.biomes[dst + j] =
+                            static_cast<Uint8>(map[i0 + j].ID);
+                });
+            region.write_tile(tile);
+        }
+    }, 16);
+    region.finish();
+}
+
+void Pixel_map::load_region(const Region_reader& region, int tx0, int ty0)
+{
+    cancel_generation();
+    const std::size_t n = static_cast<std::size_t>(num_tiles_x())
+        * num_tiles_y();
+    parallel_for(0, n, [&](std::size_t first, std::size_t last) {
+        Tile_data tile{region.format()};
+        for (std::size_t k=first; k<last; k++) {
+            const Tile_id t{static_cast<int>(k % num_tiles_x()),
+                static_cast<int>(k / num_tiles_x())};
+            if (!region.read_tile(Tile_id{tx0 + t.tx, ty0 + t.ty}, tile)) {
+                std::fill(tile.biomes.begin(), tile.biomes.end(), 0);
+                std::memset(tile.heights.raw(), 0, tile.heights.bytes());
+            }
+            tile.id = t;
+            copy_tile(FILL::perlin_map, tile);
+        }
+    }, 16);
+    biome_layer_valid = true;
+}
+
 bool Pixel_map::show(SDL_Rect* destination)
 {
     if (SDL_SetRenderTarget(renderer, NULL) != 0) {
         LOG("Failed to set renderer target to default");
     }
-    return SDL_RenderCopy(renderer, map_image, &source_location, destination)
+    if (animating)
+        return SDL_RenderCopy(renderer, anim_image, NULL, destination) == 0;
+    SDL_Texture* image = (shown_image != NULL ? shown_image : map_image);
+    return SDL_RenderCopy(renderer, image, &source_location, destination)
         == 0;
 }
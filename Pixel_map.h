@@ -35,10 +35,23 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <random>
 #include <cstdint>
 #include <stdexcept>
+#include <string>
+#include <memory>
+#include <vector>
 
 #include <SDL2/SDL.h>
 #include "Biome.h"
+#include "Height_layer.h"
+#include "Tile_address.h"
+#include "Map_layout.h"
+#include "Map_arena.h"
+#include "Generation_job.h"
+#include "Perlin_noise_generator.h"
+#include "Tile_data.h"
+#include "Tile_cache.h"
+#include "Region_file.h"
 #include "Random_color_generator.h"
+#include "Animated_noise.h"
 
 /**
  * Defines a pixel
@@ -49,7 +62,14 @@ struct Pixel {
     Uint8 r;        /**< The red value in [0, 255] */
     Uint8 g;        /**< The green value in [0, 255] */
     Uint8 b;        /**< The blue value in [0, 255] */
-	double height;  /**< The height of the pixel */
+};
+
+/**
+ * How the pixel map is drawn onto its texture
+ */
+enum class RENDER_MODE {
+    per_pixel,  /**< Draw each Pixel's colour as a rectangle */
+    indexed     /**< Expand the 1 byte biome layer through the palette */
 };
 
 class Pixel_map {
@@ -96,11 +116,99 @@ public:
     void fill_perlin_map(double freq = 1.0f);
 
     /**
-     * Render the map to the screen.
+     * Start filling the map with greyscale perlin noise on the thread pool
+     * and return straight away. Tiles are generated in parallel, the ones
+     * under source_location first.
+     * \param freq The frequency of perlin noise to use. must be >0.
+     */
+    void start_perlin_noise(double freq = 1.0f);
+
+    /**
+     * Start filling the map with a perlin noise map on the thread pool and
+     * return straight away, see start_perlin_noise().
+     */
+    void start_perlin_map(double freq = 1.0f);
+
+    /**
+     * Set the seed and octave settings used by the perlin fills. The
+     * frequency is replaced by the one passed to each fill.
+     */
+    void set_noise_settings(const Noise_settings& s);
+
+    const Noise_settings& get_noise_settings() const {return noise;}
+
+    /**
+     * Get the tiles of perlin fills through a cache. Tiles found in the
+     * cache are copied instead of generated, new tiles are added to it.
+     * \param cache The cache, or NULL for none. Not owned, it must outlive
+     * the map or be unset first.
+     */
+    void set_tile_cache(Tile_cache* cache);
+
+    /**
+     * \return true while tiles of the last started fill are outstanding.
+     */
+    bool generating() const;
+
+    /**
+     * \return The progress of the last started fill, all zero if none has
+     * been started.
+     */
+    Progress_report generation_progress() const;
+
+    /**
+     * Block until every tile of the last started fill is generated.
+     */
+    void finish_generation();
+
+    /**
+     * Abandon the last started fill. Tiles not yet started are skipped and
+     * tiles in progress stop at their next row, so this returns within
+     * about a tile's worth of work. Starting any fill does this first.
+     */
+    void cancel_generation();
+
+    /**
+     * Render the tiles that have been generated since the last call. Must
+     * be called from the thread that owns the renderer.
+     * \return The number of tiles rendered.
+     */
+    int upload_finished_tiles();
+
+    /**
+     * Render the map to the screen. Waits for any fill still in progress.
      * \return true if successfully rendered to screen, false otherwise.
      */
     bool render();
 
+    /**
+     * Set how render() draws the map. In RENDER_MODE::indexed maps without
+     * biomes (static, greyscale noise) are still drawn per pixel.
+     * \param m The new render mode.
+     */
+    void set_render_mode(RENDER_MODE m);
+
+    RENDER_MODE get_render_mode() const {return render_mode;}
+
+    /**
+     * Change the colour a biome is drawn with. Only the palette is changed,
+     * call render() in RENDER_MODE::indexed to recolour the map without
+     * touching any pixels.
+     * \param b The biome to recolour.
+     * \param c The new colour, alpha is ignored.
+     */
+    void set_biome_color(BIOME b, SDL_Color c);
+
+    SDL_Color get_biome_color(BIOME b) const
+    {
+        return palette[static_cast<Uint8>(b)];
+    }
+
+    /**
+     * Reset every biome to its default colour.
+     */
+    void reset_palette();
+
     /**
      * set the zoom of the pixel map.
      * \param z The new zoom value. Must be >0, else zoom will be set to 1.0f
@@ -114,8 +222,109 @@ public:
 
     void set_source_location(int x, int y);
 
+    /**
+     * Change how heights are stored. The map is cleared and must be filled
+     * again.
+     * \param f The new storage format.
+     */
+    void set_height_format(HEIGHT_FORMAT f);
+
+    HEIGHT_FORMAT get_height_format() const {return heights.format();}
+
+    /**
+     * \return The height of the pixel at (x, y) in [0, 1], at the precision
+     * of the height layer.
+     */
+    double get_height(int x, int y) const {return heights.get(index(x, y));}
+
+    /**
+     * Write the map to two 24 bit bitmaps.
+     * \param height_file File to write the greyscale height map to.
+     * \param color_file File to write the coloured map to.
+     * \return true if both files were written.
+     */
+    bool export_bmp(const std::string& height_file,
+        const std::string& color_file);
+
+    /**
+     * Write the map to a region file, throws on failure.
+     * \param filename The file to write.
+     */
+    void export_region(const std::string& filename);
+
+    /**
+     * Fill the map with part of a region file. Tiles missing from the file
+     * are left empty.
+     * \param region The file to read.
+     * \param tx0 The tile of the region to put at the top left of the map.
+     * \param ty0 See tx0.
+     */
+    void load_region(const Region_reader& region, int tx0, int ty0);
+
     bool show(SDL_Rect* destination);
 
+    /**
+     * Draw the last frame of an animation through the palette, show() then
+     * stretches it over the destination instead of showing the map, until
+     * end_animation(). Must be called from the thread that owns the
+     * renderer.
+     * \param a The animation, sampled a pixel per screen pixel.
+     */
+    void upload_animation(const Animated_noise& a);
+
+    /**
+     * Go back to showing the map.
+     */
+    void end_animation() {animating = false;}
+
+    bool showing_animation() const {return animating;}
+
+    /**
+     * Change how the layers are laid out in memory. The map is cleared and
+     * must be filled again.
+     * \param l The new layout.
+     */
+    void set_layout(MAP_LAYOUT l);
+
+    MAP_LAYOUT get_layout() const {return layout.kind();}
+
+    /**
+     * \return The memory layout of the layers, use its for_each_span and
+     * for_each_pixel to walk the map in memory order.
+     */
+    const Map_layout& get_map_layout() const {return layout;}
+
+    /**
+     * \return The index of the pixel at (x, y) in each layer of the map.
+     * Computed in 64 bits so maps past 46340x46340 do not overflow.
+     */
+    std::size_t index(int x, int y) const {return layout.index(x, y);}
+
+    /**
+     * \return The index of a pixel given relative to a tile.
+     */
+    std::size_t index(const Tile_address& a) const
+    {
+        return index(a.tx*tile_size + a.lx, a.ty*tile_size + a.ly);
+    }
+
+    /**
+     * \return The number of pixels in the map.
+     */
+    std::size_t num_pixels() const
+    {
+        return static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+    }
+
+    int num_tiles_x() const {return layout.num_tiles_x();}
+    int num_tiles_y() const {return layout.num_tiles_y();}
+
+    /**
+     * \return The pixels covered by tile (tx, ty), tiles on the right and
+     * bottom edges are clipped to the map.
+     */
+    SDL_Rect tile_rect(int tx, int ty) const {return layout.tile_rect(tx, ty);}
+
     int width;    /**< Width of the pixel map */
     int height;   /**< Height of the pixel map */
     int pixel_length; /**< The length of the sides of each pixel */
@@ -123,17 +332,111 @@ public:
                                     draw */
 private:
     SDL_Texture* map_image; /**< texture which we draw the pixel map on */
+    SDL_Texture* index_image;   /**< streaming texture the biome layer is
+                                    expanded into, created on first use */
+    SDL_Texture* shown_image;   /**< texture last written by render() */
+    SDL_Texture* anim_image;    /**< streaming texture of the last frame of
+                                    an animation, created on first use */
+    int anim_width, anim_height;    /**< Size of anim_image */
+    bool animating;     /**< True if show() draws anim_image */
 
-    int zoom_factor;    /**< The zoom factor to draw the map at */
+    double zoom_factor; /**< The zoom factor to draw the map at */
+    Map_layout layout;  /**< Where each pixel is in the layers below */
+    Map_arena* arena;   /**< Owns the memory of every layer below */
     Pixel* map; /**< Pointer to array of pixels that represents the map */
+    Uint8* biome_layer; /**< BIOME of each pixel, 1 byte per pixel */
+    bool biome_layer_valid; /**< True if the last fill classified biomes */
+    Height_layer heights;   /**< Height of each pixel */
+
+    RENDER_MODE render_mode;
+    SDL_Color palette[256]; /**< Colour of each biome index */
+
+    std::shared_ptr<Generation_job> job;    /**< The last fill started on
+                                                the thread pool */
+    bool error_reported;    /**< True once a failure of job is logged */
+    Noise_settings noise;   /**< Noise used by the perlin fills */
+    Tile_cache* tile_cache;     /**< Not owned, may be NULL */
+
+    /**
+     * The fills that are generated a tile at a time
+     */
+    enum class FILL {
+        perlin_noise, perlin_map
+    };
     SDL_Renderer* renderer;
 
     Random_color_generator generate_color; /**< Generator of numbers in
                                                 [0, 255]*/
 
     /**
-     * Initialise each pixel in the map
+     * Allocate every layer of the map from a new arena, then clear them.
+     * \param f The storage format of the height layer.
+     * \param l The memory layout of every layer.
+     */
+    void allocate_layers(HEIGHT_FORMAT f, MAP_LAYOUT l);
+
+    /**
+     * Initialise each pixel in the map. Blocks of the layout are split
+     * across threads so a fresh arena is first touched in parallel.
      */
     void zero_map_pixels();
+
+    /**
+     * Size source_location for the current zoom_factor, clamped to INT_MAX
+     */
+    void update_source_size();
+
+    /**
+     * Log the first error a tile of job failed with, once per job.
+     */
+    void report_generation_error();
+
+    /**
+     * Queue every tile of a fill on the thread pool, after cancelling the
+     * previous fill.
+     */
+    void start_job(FILL kind);
+
+    /**
+     * \return Every tile of the map, tiles intersecting source_location
+     * first and the rest by distance from its centre.
+     */
+    std::vector<Tile_id> tiles_by_priority() const;
+
+    /**
+     * Get a tile from the tile cache or generate it, then copy it into
+     * the map. Safe to call from several threads at once for different
+     * tiles.
+     * \param owner The job the tile belongs to, checked between rows.
+     * \return false if owner was cancelled before the tile was finished.
+     */
+    bool produce_tile(FILL kind, const Noise_settings& s, Tile_id t,
+        const Generation_job& owner);
+
+    /**
+     * Copy the part of a tile that is inside the map into every layer.
+     */
+    void copy_tile(FILL kind, const Tile_data& tile);
+
+    /**
+     * Render part of the map with the current render mode
+     */
+    void render_area(const SDL_Rect& area);
+
+    /**
+     * Render by drawing each pixel as a filled rectangle
+     */
+    void render_pixels(const SDL_Rect& area);
+
+    /**
+     * Render by expanding the biome layer through the palette into a
+     * streaming texture, 1 byte read per pixel.
+     */
+    void render_indexed(const SDL_Rect& area);
+
+    /**
+     * Pack the palette as RGBA8888 so each pixel is a single table lookup.
+     */
+    void pack_palette(Uint32* lut) const;
 };
 #endif
@@ -0,0 +1,168 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Progress.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Progress of long running work, see Progress.h
+*/
+#include "Progress.h"
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+std::int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::string format_seconds(double s)
+{
+    long total = static_cast<long>(s + 0.5);
+    std::ostringstream out;
+    if (total >= 3600)
+        out << total / 3600 << 'h' << std::setw(2) << std::setfill('0');
+    if (total >= 60)
+        out << (total / 60) % 60 << 'm' << std::setw(2) << std::setfill('0');
+    out << total % 60 << 's';
+    return out.str();
+}
+
+}
+
+Progress::Progress()
+    :units_total{0}, units_at_start{0}, start_ns{now_ns()}, units_done{0},
+    pixels_done{0}
+{
+}
+
+void Progress::start(std::uint64_t total, std::uint64_t already_done)
+{
+    std::lock_guard<std::mutex> guard{start_lock};
+    units_total = total;
+    units_at_start = already_done;
+    start_ns = now_ns();
+    units_done.store(already_done);
+    pixels_done.store(0);
+}
+
+bool Progress::finished() const
+{
+    std::lock_guard<std::mutex> guard{start_lock};
+    return units_done.load() >= units_total;
+}
+
+Progress_report Progress::report() const
+{
+    Progress_report r;
+    std::uint64_t at_start;
+    {
+        std::lock_guard<std::mutex> guard{start_lock};
+        r.done = units_done.load(std::memory_order_relaxed);
+        r.total = units_total;
+        r.pixels = pixels_done.load(std::memory_order_relaxed);
+        r.elapsed = (now_ns() - start_ns) / 1e9;
+        at_start = units_at_start;
+    }
+    r.pixels_per_second = (r.elapsed > 0 ? r.pixels / r.elapsed : 0.0);
+
+    /* Time left at the rate units have been finished by this run, done
+       can only be below at_start if units were added before start() */
+    const std::uint64_t this_run = (r.done > at_start ? r.done - at_start
+        : 0);
+    r.remaining = -1.0;
+    if (this_run > 0 && r.done <= r.total)
+        r.remaining = r.elapsed * (r.total - r.done) / this_run;
+    return r;
+}
+
+std::string format_progress(const Progress_report& r)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(0) << r.fraction() * 100 << "% ("
+        << r.done << '/' << r.total << ") " << std::setprecision(1)
+        << r.pixels_per_second / 1e6 << "Mpx/s ";
+    if (r.done >= r.total)
+        out << "done in " << format_seconds(r.elapsed);
+    else if (r.remaining >= 0)
+        out << format_seconds(r.remaining) << " left";
+    else
+        out << "starting";
+    return out.str();
+}
+
+std::string progress_json(const Progress_report& r)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3)
+        << "{\"done\": " << r.done << ", \"total\": " << r.total
+        << ", \"fraction\": " << r.fraction()
+        << ", \"pixels\": " << r.pixels
+        << ", \"elapsed_s\": " << r.elapsed
+        << ", \"pixels_per_s\": " << std::setprecision(0)
+        << r.pixels_per_second << std::setprecision(3)
+        << ", \"remaining_s\": ";
+    if (r.remaining >= 0)
+        out << r.remaining;
+    else
+        out << "null";
+    out << '}';
+    return out.str();
+}
+
+Progress_reporter::Progress_reporter(const Progress& p, std::ostream& o,
+    bool j, int interval)
+    :progress{p}, out{o}, json{j}, interval_ms{interval}, stopping{false}
+{
+    printer = std::thread{[this] {
+        std::unique_lock<std::mutex> guard{lock};
+        while (!wake.wait_for(guard, std::chrono::milliseconds{interval_ms},
+            [this] {return stopping;}))
+            print();
+    }};
+}
+
+Progress_reporter::~Progress_reporter()
+{
+    {
+        std::lock_guard<std::mutex> guard{lock};
+        stopping = true;
+    }
+    wake.notify_all();
+    printer.join();
+    print();
+    if (!json)
+        out << '\n';
+}
+
+void Progress_reporter::print()
+{
+    Progress_report r = progress.report();
+    if (json)
+        out << progress_json(r) << std::endl;
+    else
+        out << '\r' << format_progress(r) << "    " << std::flush;
+}
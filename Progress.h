@@ -0,0 +1,145 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Progress.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Progress of long running work, such as generating a map or
+    exporting one. Work is counted in units (tiles) and pixels by atomic
+    counters, so workers can report without locking, and throughput and
+    time remaining are worked out from them.
+*/
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+/**
+ * A snapshot of a Progress
+ */
+struct Progress_report {
+    std::uint64_t done;         /**< Units finished, including resumed ones */
+    std::uint64_t total;        /**< Units in the whole task */
+    std::uint64_t pixels;       /**< Pixels finished since start() */
+    double elapsed;             /**< Seconds since start() */
+    double pixels_per_second;
+    double remaining;           /**< Estimated seconds left, < 0 if not yet
+                                    known */
+
+    double fraction() const
+    {
+        return (total > 0 ? static_cast<double>(done) / total : 0.0);
+    }
+};
+
+class Progress {
+public:
+    Progress();
+
+    /**
+     * Begin counting a new task.
+     * \param total The number of units in the task.
+     * \param already_done Units finished before this run, such as when
+     * resuming. They count towards done but not towards throughput.
+     */
+    void start(std::uint64_t total, std::uint64_t already_done = 0);
+
+    /**
+     * Record finished work, safe to call from any thread.
+     */
+    void add(std::uint64_t units, std::uint64_t pixels)
+    {
+        pixels_done.fetch_add(pixels, std::memory_order_relaxed);
+        units_done.fetch_add(units, std::memory_order_relaxed);
+    }
+
+    Progress_report report() const;
+
+    bool finished() const;
+
+private:
+    /* Set together by start(), so a report never mixes two tasks */
+    mutable std::mutex start_lock;
+    std::uint64_t units_total;
+    std::uint64_t units_at_start;
+    std::int64_t start_ns;                  /**< steady_clock at start() */
+
+    std::atomic<std::uint64_t> units_done;
+    std::atomic<std::uint64_t> pixels_done;
+};
+
+/**
+ * \return A one line summary, e.g. "42% (420/1000) 3.1Mpx/s 12s left".
+ */
+std::string format_progress(const Progress_report& r);
+
+/**
+ * \return The report as a single line JSON object.
+ */
+std::string progress_json(const Progress_report& r);
+
+/**
+ * Prints a Progress from a thread of its own until destroyed, for headless
+ * runs. Text reports overwrite each other on one line, JSON reports are
+ * one object per line.
+ */
+class Progress_reporter {
+public:
+    /**
+     * Constructor, starts printing.
+     * \param p The progress to report, must outlive the reporter.
+     * \param out Where to print, usually std::cerr.
+     * \param json Print JSON instead of text.
+     * \param interval_ms Time between reports.
+     */
+    Progress_reporter(const Progress& p, std::ostream& out, bool json,
+        int interval_ms = 1000);
+
+    /**
+     * Prints a final report and stops.
+     */
+    ~Progress_reporter();
+
+    Progress_reporter(const Progress_reporter&) = delete;
+    Progress_reporter& operator=(const Progress_reporter&) = delete;
+
+private:
+    const Progress& progress;
+    std::ostream& out;
+    const bool json;
+    const int interval_ms;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+    std::thread printer;
+
+    void print();
+};
+#endif
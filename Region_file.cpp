@@ -0,0 +1,493 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Region_file.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A file holding the tiles of a whole world, see
+    Region_file.h
+*/
+#include "Region_file.h"
+#include "File_util.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <cstdio>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char region_magic[4] = {'B', 'M', 'G', 'R'};
+
+std::uint32_t checksum(const std::uint8_t* p, std::size_t n)
+{
+    std::uint32_t h = 2166136261u;
+    for (std::size_t i=0; i<n; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+std::uint64_t aligned(std::uint64_t n, std::uint64_t a)
+{
+    return (n + a - 1) / a * a;
+}
+
+/**
+ * \return Sample i of raw heights that are w bytes each.
+ */
+std::uint64_t load_sample(const void* raw, std::size_t w, std::size_t i)
+{
+    switch (w) {
+    case 2: return static_cast<const std::uint16_t*>(raw)[i];
+    case 4: return static_cast<const std::uint32_t*>(raw)[i];
+    default: return static_cast<const std::uint64_t*>(raw)[i];
+    }
+}
+
+void store_sample(void* raw, std::size_t w, std::size_t i, std::uint64_t v)
+{
+    switch (w) {
+    case 2: static_cast<std::uint16_t*>(raw)[i] =
+        static_cast<std::uint16_t>(v); break;
+    case 4: static_cast<std::uint32_t*>(raw)[i] =
+        static_cast<std::uint32_t>(v); break;
+    default: static_cast<std::uint64_t*>(raw)[i] = v; break;
+    }
+}
+
+void put_varint(std::vector<std::uint8_t>& out, std::uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(v));
+}
+
+bool get_varint(const std::uint8_t*& p, const std::uint8_t* end,
+    std::uint64_t& v)
+{
+    v = 0;
+    for (int shift=0; shift<64 && p < end; shift += 7) {
+        std::uint8_t b = *p++;
+        v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * \return The sample of a tile that sample i is predicted from.
+ */
+std::size_t predictor(std::size_t i)
+{
+    return (i % tile_size != 0 ? i - 1 : i - tile_size);
+}
+
+}
+
+std::size_t max_payload_size(HEIGHT_FORMAT f)
+{
+    /* A zigzag delta fits in the sample's bits, 7 of them a varint byte */
+    const std::size_t varint_bytes = (height_format_size(f) * 8 + 6) / 7;
+    return 4 + tile_area * varint_bytes + tile_area * 2;
+}
+
+void encode_tile(const Tile_data& tile, std::vector<std::uint8_t>& out)
+{
+    const std::size_t w = height_format_size(tile.heights.format());
+    const int bits = static_cast<int>(w * 8);
+    const std::uint64_t mask = (bits == 64 ? ~0ULL : (1ULL << bits) - 1);
+    const void* raw = tile.heights.raw();
+
+    out.clear();
+    out.reserve(max_payload_size(tile.heights.format()));
+    out.resize(4);      // Length of the heights, filled in below
+
+    for (std::size_t i=0; i<tile_area; i++) {
+        std::uint64_t pred = (i == 0 ? 0 : load_sample(raw, w, predictor(i)));
+        std::uint64_t delta = (load_sample(raw, w, i) - pred) & mask;
+        /* Sign extend from the sample width so small steps down are small */
+        std::int64_t d = static_cast<std::int64_t>(delta << (64 - bits))
+            >> (64 - bits);
+        put_varint(out, (static_cast<std::uint64_t>(d) << 1)
+            ^ static_cast<std::uint64_t>(d >> 63));
+    }
+    std::uint32_t height_bytes = static_cast<std::uint32_t>(out.size() - 4);
+    std::memcpy(out.data(), &height_bytes, 4);
+
+    for (std::size_t i=0; i<tile_area; ) {
+        std::size_t run = 1;
+        while (i + run < tile_area && run < 256
+            && tile.biomes[i + run] == tile.biomes[i])
+            run++;
+        out.push_back(static_cast<std::uint8_t>(run - 1));
+        out.push_back(tile.biomes[i]);
+        i += run;
+    }
+}
+
+bool decode_tile(const std::uint8_t* payload, std::size_t size,
+    Tile_data& out)
+{
+    const std::size_t w = height_format_size(out.heights.format());
+    const int bits = static_cast<int>(w * 8);
+    const std::uint64_t mask = (bits == 64 ? ~0ULL : (1ULL << bits) - 1);
+    void* raw = out.heights.raw();
+
+    std::uint32_t height_bytes;
+    if (size < 4)
+        return false;
+    std::memcpy(&height_bytes, payload, 4);
+    if (height_bytes > size - 4)
+        return false;
+
+    const std::uint8_t* p = payload + 4;
+    const std::uint8_t* end = p + height_bytes;
+    for (std::size_t i=0; i<tile_area; i++) {
+        std::uint64_t z;
+        if (!get_varint(p, end, z))
+            return false;
+        std::uint64_t d = (z >> 1) ^ (~(z & 1) + 1);
+        std::uint64_t pred = (i == 0 ? 0 : load_sample(raw, w, predictor(i)));
+        store_sample(raw, w, i, (pred + d) & mask);
+    }
+    if (p != end)
+        return false;
+
+    end = payload + size;
+    std::size_t i = 0;
+    while (p + 1 < end && i < tile_area) {
+        std::size_t run = std::size_t{p[0]} + 1;
+        if (run > tile_area - i)
+            return false;
+        std::fill_n(out.biomes.begin() + i, run, p[1]);
+        i += run;
+        p += 2;
+    }
+    return i == tile_area && p == end;
+}
+
+Region_writer::Region_writer(const std::string& filename, int w, int h,
+    HEIGHT_FORMAT f, std::uint64_t key, bool resume)
+    :name{filename}, file{NULL}, end{0}
+{
+    if (w <= 0 || h <= 0)
+        throw std::runtime_error("Region must not be empty: " + filename);
+
+    std::memset(&header, 0, sizeof(header));
+    header.version = region_version;
+    header.key = key;
+    header.width = w;
+    header.height = h;
+    header.tiles_x = (w + tile_size - 1) / tile_size;
+    header.tiles_y = (h + tile_size - 1) / tile_size;
+    header.format = static_cast<std::uint32_t>(f);
+
+    const std::size_t n = static_cast<std::size_t>(header.tiles_x)
+        * header.tiles_y;
+    index.assign(n, Region_entry{0, 0, 0});
+    header.data_offset = aligned(region_page + n * sizeof(Region_entry),
+        region_page);
+
+    if (resume) {
+        /* The header is zero until finish(), so an unfinished file stays
+           unreadable while it is resumed */
+        file = std::fopen(filename.c_str(), "r+b");
+        if (file == NULL)
+            throw std::runtime_error("Failed to open region file: "
+                + filename);
+        end = seek_to_end(file);
+        if (end < header.data_offset) {
+            std::fclose(file);
+            file = NULL;
+            throw std::runtime_error("Region file is too short to resume: "
+                + filename);
+        }
+        return;
+    }
+
+    file = std::fopen(filename.c_str(), "wb");
+    if (file == NULL)
+        throw std::runtime_error("Failed to open region file: " + filename);
+
+    /* Room for the header and index, the header stays zero until finish()
+       so an unfinished file is never mistaken for a good one */
+    static const std::uint8_t zeros[region_page] = {};
+    while (end < header.data_offset)
+        write_at_end(zeros, static_cast<std::size_t>(std::min<std::uint64_t>(
+            region_page, header.data_offset - end)));
+}
+
+Region_writer::~Region_writer()
+{
+    if (file != NULL)
+        std::fclose(file);
+}
+
+void Region_writer::write_tile(const Tile_data& tile)
+{
+    if (tile.heights.format() != format())
+        throw std::runtime_error("Tile format does not match region: "
+            + name);
+
+    std::vector<std::uint8_t> payload;
+    encode_tile(tile, payload);
+    write_payload(tile.id, payload);
+}
+
+void Region_writer::write_payload(Tile_id t,
+    const std::vector<std::uint8_t>& payload)
+{
+    if (t.tx < 0 || t.ty < 0 || t.tx >= header.tiles_x
+        || t.ty >= header.tiles_y)
+        throw std::runtime_error("Tile outside region: " + name);
+
+    std::lock_guard<std::mutex> guard{lock};
+    if (file == NULL)
+        throw std::runtime_error("Region file already finished: " + name);
+
+    static const std::uint8_t zeros[region_alignment] = {};
+    write_at_end(zeros, static_cast<std::size_t>(
+        aligned(end, region_alignment) - end));
+
+    Region_entry& e = index[static_cast<std::size_t>(t.ty)
+        * header.tiles_x + t.tx];
+    e.offset = end;
+    e.size = static_cast<std::uint32_t>(payload.size());
+    e.checksum = checksum(payload.data(), payload.size());
+    write_at_end(payload.data(), payload.size());
+    written.push_back(Region_tile{t, e});
+}
+
+bool Region_writer::restore_tile(Tile_id t, const Region_entry& e)
+{
+    std::lock_guard<std::mutex> guard{lock};
+    if (t.tx < 0 || t.ty < 0 || t.tx >= header.tiles_x
+        || t.ty >= header.tiles_y || e.offset < header.data_offset
+        || e.offset % region_alignment != 0 || e.size > end
+        || e.offset > end - e.size)
+        return false;
+    index[static_cast<std::size_t>(t.ty) * header.tiles_x + t.tx] = e;
+    return true;
+}
+
+void Region_writer::flush()
+{
+    std::lock_guard<std::mutex> guard{lock};
+    if (file != NULL && !sync_file(file))
+        throw std::runtime_error("Failed to write region file: " + name);
+}
+
+std::vector<Region_tile> Region_writer::take_written()
+{
+    std::lock_guard<std::mutex> guard{lock};
+    std::vector<Region_tile> tiles;
+    tiles.swap(written);
+    return tiles;
+}
+
+void Region_writer::finish()
+{
+    std::lock_guard<std::mutex> guard{lock};
+    if (file == NULL)
+        return;
+
+    std::copy(region_magic, region_magic + 4, header.magic);
+    header.file_size = end;
+
+    bool ok = seek_to(file, region_page)
+        && std::fwrite(index.data(), sizeof(Region_entry), index.size(), file)
+            == index.size()
+        && std::fseek(file, 0, SEEK_SET) == 0
+        && std::fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = (std::fclose(file) == 0) && ok;
+    file = NULL;
+    if (!ok)
+        throw std::runtime_error("Failed to finish region file: " + name);
+}
+
+void Region_writer::write_at_end(const void* data, std::size_t bytes)
+{
+    if (bytes == 0)
+        return;
+    if (std::fwrite(data, 1, bytes, file) != bytes)
+        throw std::runtime_error("Failed to write region file: " + name);
+    end += bytes;
+}
+
+Region_reader::Region_reader(const std::string& filename)
+    :name{filename}, index{NULL}, data{NULL}, mapped_size{0}, file{NULL}
+{
+    std::uint64_t actual_size = 0;
+#ifdef _WIN32
+    file = std::fopen(filename.c_str(), "rb");
+    if (file == NULL)
+        throw std::runtime_error("Failed to open region file: " + filename);
+    if (std::fread(&header, sizeof(header), 1, file) != 1) {
+        std::fclose(file);
+        throw std::runtime_error("Not a region file: " + filename);
+    }
+    actual_size = seek_to_end(file);
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Failed to open region file: " + filename);
+    struct stat st;
+    if (fstat(fd, &st) != 0
+        || static_cast<std::size_t>(st.st_size) < sizeof(header)) {
+        ::close(fd);
+        throw std::runtime_error("Not a region file: " + filename);
+    }
+    actual_size = static_cast<std::uint64_t>(st.st_size);
+    mapped_size = static_cast<std::size_t>(st.st_size);
+    void* m = mmap(NULL, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED)
+        throw std::runtime_error("Failed to map region file: " + filename);
+    data = static_cast<const std::uint8_t*>(m);
+#ifdef MADV_RANDOM
+    madvise(m, mapped_size, MADV_RANDOM);
+#endif
+    std::memcpy(&header, data, sizeof(header));
+#endif
+
+    const std::uint64_t n = static_cast<std::uint64_t>(header.tiles_x)
+        * static_cast<std::uint64_t>(header.tiles_y);
+    bool ok = std::equal(region_magic, region_magic + 4, header.magic)
+        && header.version == region_version
+        && header.width > 0 && header.height > 0
+        && header.tiles_x == (header.width + tile_size - 1) / tile_size
+        && header.tiles_y == (header.height + tile_size - 1) / tile_size
+        && header.format <= static_cast<std::uint32_t>(HEIGHT_FORMAT::half)
+        && header.data_offset >= region_page + n * sizeof(Region_entry)
+        && header.file_size == actual_size;
+
+#ifdef _WIN32
+    if (ok) {
+        index_copy.resize(static_cast<std::size_t>(n));
+        ok = seek_to(file, region_page)
+            && std::fread(index_copy.data(), sizeof(Region_entry),
+                index_copy.size(), file) == index_copy.size();
+        index = index_copy.data();
+    }
+#else
+    index = reinterpret_cast<const Region_entry*>(data + region_page);
+#endif
+
+    if (!ok) {
+        close();
+        throw std::runtime_error("Not a region file: " + filename);
+    }
+}
+
+Region_reader::~Region_reader()
+{
+    close();
+}
+
+void Region_reader::close()
+{
+#ifdef _WIN32
+    if (file != NULL)
+        std::fclose(file);
+    file = NULL;
+#else
+    if (data != NULL)
+        munmap(const_cast<std::uint8_t*>(data), mapped_size);
+    data = NULL;
+#endif
+}
+
+bool Region_reader::has_tile(int tx, int ty) const
+{
+    return tx >= 0 && ty >= 0 && tx < header.tiles_x && ty < header.tiles_y
+        && entry(tx, ty).offset != 0;
+}
+
+bool Region_reader::read_tile(Tile_id t, Tile_data& out) const
+{
+    if (!has_tile(t.tx, t.ty))
+        return false;
+
+    std::vector<std::uint8_t> buffer;
+    std::size_t size;
+    const std::uint8_t* p = payload(t, buffer, size);
+
+    if (out.heights.format() != format())
+        out.heights.set_format(format());
+    if (!decode_tile(p, size, out))
+        throw std::runtime_error("Damaged tile in region file: " + name);
+    out.id = t;
+    return true;
+}
+
+bool Region_reader::read_payload(Tile_id t, std::vector<std::uint8_t>& out)
+    const
+{
+    if (!has_tile(t.tx, t.ty))
+        return false;
+
+    std::size_t size;
+    const std::uint8_t* p = payload(t, out, size);
+    if (p != out.data())
+        out.assign(p, p + size);
+    return true;
+}
+
+const std::uint8_t* Region_reader::payload(Tile_id t,
+    std::vector<std::uint8_t>& buffer, std::size_t& size) const
+{
+    const Region_entry& e = entry(t.tx, t.ty);
+    if (e.offset < header.data_offset || e.size > header.file_size
+        || e.offset > header.file_size - e.size)
+        throw std::runtime_error("Damaged region index: " + name);
+
+    const std::uint8_t* p = NULL;
+    if (data != NULL) {
+        p = data + e.offset;
+    }
+    else {
+#ifdef _WIN32
+        buffer.resize(e.size);
+        std::lock_guard<std::mutex> guard{lock};
+        if (!seek_to(file, e.offset)
+            || std::fread(buffer.data(), 1, e.size, file) != e.size)
+            throw std::runtime_error("Failed to read region file: " + name);
+#endif
+        p = buffer.data();
+    }
+
+    if (checksum(p, e.size) != e.checksum)
+        throw std::runtime_error("Damaged tile in region file: " + name);
+    size = e.size;
+    return p;
+}
@@ -0,0 +1,265 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Region_file.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A file holding the tiles of a whole generated world so any
+    part of it can be read without reading the rest.
+
+    Layout, in host byte order:
+        Region_header   at 0
+        Region_entry    tiles_x * tiles_y of them at region_page, row major
+        payloads        from data_offset, each aligned to region_alignment
+
+    A payload is the heights as zigzag varint deltas from the sample to the
+    left (the sample above for the first of a row) followed by the biomes
+    run length encoded. Offsets are 64 bit so worlds larger than 4GB work,
+    and the header is written last so a file that was never finished is
+    rejected by the reader.
+*/
+#ifndef REGION_FILE_H
+#define REGION_FILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Tile_data.h"
+
+constexpr std::uint32_t region_version = 1;
+constexpr std::uint64_t region_page = 4096;     /**< Start of the index */
+constexpr std::uint64_t region_alignment = 64;  /**< Of every payload */
+
+struct Region_header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t key;          /**< tile_key() of the settings, or 0 */
+    std::int32_t width;         /**< Of the world in pixels */
+    std::int32_t height;
+    std::int32_t tiles_x;
+    std::int32_t tiles_y;
+    std::uint32_t format;       /**< HEIGHT_FORMAT of the heights */
+    std::uint32_t reserved;
+    std::uint64_t data_offset;  /**< Start of the payloads */
+    std::uint64_t file_size;
+};
+
+struct Region_entry {
+    std::uint64_t offset;       /**< Of the payload, 0 if the tile is absent */
+    std::uint32_t size;         /**< Of the payload in bytes */
+    std::uint32_t checksum;     /**< FNV-1a of the payload */
+};
+
+/**
+ * Where a tile was written in a region file
+ */
+struct Region_tile {
+    Tile_id id;
+    Region_entry entry;
+};
+
+/**
+ * \return The most bytes a tile of heights in format f can take as a
+ * payload, every height a varint as long as it gets and every biome a
+ * run of its own.
+ */
+std::size_t max_payload_size(HEIGHT_FORMAT f);
+
+/**
+ * Compress a tile into a region payload, at most max_payload_size() bytes.
+ * \param out Replaced with the payload.
+ */
+void encode_tile(const Tile_data& tile, std::vector<std::uint8_t>& out);
+
+/**
+ * Decompress a region payload into a tile.
+ * \param out Must already have the height format the tile was encoded in.
+ * \return false if the payload is damaged.
+ */
+bool decode_tile(const std::uint8_t* payload, std::size_t size,
+    Tile_data& out);
+
+/**
+ * Writes a region file a tile at a time, so a world never has to be held
+ * in memory. Only the index is kept, 16 bytes per tile.
+ */
+class Region_writer {
+public:
+    /**
+     * Constructor, creates or truncates the file.
+     * \param filename The file to write.
+     * \param w The width of the world in pixels.
+     * \param h The height of the world in pixels.
+     * \param f The format heights are stored in.
+     * \param key The tile_key() the tiles were generated with, or 0.
+     * \param resume If true the file is not truncated, tiles written by an
+     * earlier writer can be added back with restore_tile() and new tiles
+     * are written after them.
+     */
+    Region_writer(const std::string& filename, int w, int h, HEIGHT_FORMAT f,
+        std::uint64_t key = 0, bool resume = false);
+
+    /**
+     * Closes the file. Unless finish() was called it is left without a
+     * header, so it can not be opened by mistake.
+     */
+    ~Region_writer();
+
+    Region_writer(const Region_writer&) = delete;
+    Region_writer& operator=(const Region_writer&) = delete;
+
+    /**
+     * Add a tile, in any order. Writing a tile twice keeps the second.
+     * Safe to call from several threads, compression is done outside the
+     * lock.
+     * \param tile A tile inside the world with the format of the file.
+     */
+    void write_tile(const Tile_data& tile);
+
+    /**
+     * Add a tile already compressed by encode_tile(), such as one copied
+     * from another region file with the same format.
+     */
+    void write_payload(Tile_id t, const std::vector<std::uint8_t>& payload);
+
+    /**
+     * Add a tile written to the file by an earlier writer to the index.
+     * \return false if the entry is outside the data of the file.
+     */
+    bool restore_tile(Tile_id t, const Region_entry& e);
+
+    /**
+     * Flush written tiles to disk, throws on failure.
+     */
+    void flush();
+
+    /**
+     * \return Every tile written since the last call.
+     */
+    std::vector<Region_tile> take_written();
+
+    /**
+     * Write the index and header and close the file. Throws on failure.
+     */
+    void finish();
+
+    int tiles_x() const {return header.tiles_x;}
+    int tiles_y() const {return header.tiles_y;}
+    HEIGHT_FORMAT format() const
+    {
+        return static_cast<HEIGHT_FORMAT>(header.format);
+    }
+
+private:
+    std::string name;
+    FILE* file;
+    Region_header header;
+    std::vector<Region_entry> index;
+    std::uint64_t end;          /**< Bytes written so far */
+    std::vector<Region_tile> written;   /**< Since take_written() */
+    std::mutex lock;
+
+    void write_at_end(const void* data, std::size_t bytes);
+};
+
+/**
+ * Reads tiles from a region file. Only the header is checked on opening;
+ * on POSIX systems the file is mapped so opening takes the same time
+ * whatever its size, and tiles are paged in as they are read.
+ */
+class Region_reader {
+public:
+    /**
+     * Constructor, throws if the file can not be opened or is not a
+     * finished region file.
+     */
+    Region_reader(const std::string& filename);
+
+    ~Region_reader();
+
+    Region_reader(const Region_reader&) = delete;
+    Region_reader& operator=(const Region_reader&) = delete;
+
+    /**
+     * \return true if the tile was written to the file.
+     */
+    bool has_tile(int tx, int ty) const;
+
+    /**
+     * Read a tile. Safe to call from several threads.
+     * \param t The tile wanted.
+     * \param out Filled with the tile, its height format is changed to the
+     * format of the file if it differs.
+     * \return false if the tile is outside the world or was never written.
+     * Throws if the tile is damaged.
+     */
+    bool read_tile(Tile_id t, Tile_data& out) const;
+
+    /**
+     * Read the compressed payload of a tile, checking its checksum. Safe
+     * to call from several threads.
+     * \param out Replaced with the payload.
+     * \return false if the tile is outside the world or was never written.
+     */
+    bool read_payload(Tile_id t, std::vector<std::uint8_t>& out) const;
+
+    int width() const {return header.width;}
+    int height() const {return header.height;}
+    int tiles_x() const {return header.tiles_x;}
+    int tiles_y() const {return header.tiles_y;}
+    std::uint64_t key() const {return header.key;}
+    HEIGHT_FORMAT format() const
+    {
+        return static_cast<HEIGHT_FORMAT>(header.format);
+    }
+
+private:
+    std::string name;
+    Region_header header;
+    const Region_entry* index;
+    const std::uint8_t* data;   /**< The mapped file, NULL if not mapped */
+    std::size_t mapped_size;
+    FILE* file;                 /**< Used where the file is not mapped */
+    std::vector<Region_entry> index_copy;
+    mutable std::mutex lock;
+
+    /**
+     * Unmap or close the file.
+     */
+    void close();
+
+    /**
+     * \return The checked payload of a tile that is in the file, either in
+     * the mapping or read into buffer. Throws if it is damaged.
+     */
+    const std::uint8_t* payload(Tile_id t, std::vector<std::uint8_t>& buffer,
+        std::size_t& size) const;
+
+    const Region_entry& entry(int tx, int ty) const
+    {
+        return index[static_cast<std::size_t>(ty) * header.tiles_x + tx];
+    }
+};
+#endif
@@ -0,0 +1,240 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Seed_search.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Searching seeds, see Seed_search.h
+*/
+#include "Seed_search.h"
+#include "Heightfield.h"
+#include "Parallel_for.h"
+#include "Tile_data.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/**
+ * Connected pieces of land, found a row at a time with union-find
+ */
+class Landmass_finder {
+public:
+    explicit Landmass_finder(int width)
+        :above(width, -1), row(width, -1)
+    {
+    }
+
+    /**
+     * Add the next row of the map.
+     * \param land Which of the pixels of the row are land.
+     */
+    void add_row(const std::vector<bool>& land)
+    {
+        const int width = static_cast<int>(row.size());
+        for (int x=0; x<width; x++) {
+            if (!land[x]) {
+                row[x] = -1;
+                continue;
+            }
+            int label = (x > 0 ? row[x - 1] : -1);
+            if (above[x] >= 0) {
+                if (label < 0)
+                    label = above[x];
+                else
+                    join(label, above[x]);
+            }
+            if (label < 0) {
+                label = static_cast<int>(parent.size());
+                parent.push_back(label);
+                size.push_back(0);
+            }
+            size[find(label)]++;
+            row[x] = label;
+        }
+        std::swap(above, row);
+    }
+
+    /**
+     * \return The number of pixels in the largest piece of land.
+     */
+    long largest()
+    {
+        long best = 0;
+        for (std::size_t i=0; i<parent.size(); i++)
+            if (find(static_cast<int>(i)) == static_cast<int>(i))
+                best = std::max(best, size[i]);
+        return best;
+    }
+
+private:
+    std::vector<int> above;     /**< Labels of the previous row, -1 if sea */
+    std::vector<int> row;
+    std::vector<int> parent;
+    std::vector<long> size;     /**< Pixels of each root */
+
+    int find(int i)
+    {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    void join(int a, int b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b)
+            return;
+        if (size[a] < size[b])
+            std::swap(a, b);
+        parent[b] = a;
+        size[a] += size[b];
+    }
+};
+
+/**
+ * The map as searched has a pixel for every step pixels of the full map
+ */
+static void search_size(const Seed_search_settings& s, int& step,
+    int& width, int& height)
+{
+    const int longest = std::max(s.width, s.height);
+    step = std::max(1, (longest + s.resolution - 1) / s.resolution);
+    width = (s.width + step - 1) / step;
+    height = (s.height + step - 1) / step;
+}
+
+Seed_stats summarise_seed(const Seed_search_settings& s, int seed)
+{
+    int step, width, height;
+    search_size(s, step, width, height);
+
+    Noise_settings noise = s.noise;
+    noise.seed = seed;
+    if (whole_map_engine(noise.engine) && !noise.graph) {
+        /* A field made smaller is a different map, so the field of the
+           full map is made and every step'th pixel of it kept */
+        std::shared_ptr<const Heightfield> full = make_heightfield(noise,
+            s.width, s.height);
+        auto field = std::make_shared<Heightfield>();
+        field->width = width;
+        field->height = height;
+        field->heights.resize(static_cast<std::size_t>(width) * height);
+        for (int y=0; y<height; y++) {
+            const int fy = std::min(y * step, s.height - 1);
+            for (int x=0; x<width; x++) {
+                field->heights[static_cast<std::size_t>(y) * width + x] =
+                    full->at(std::min(x * step, s.width - 1), fy);
+            }
+        }
+        noise.field = field;
+    }
+    noise.frequency *= step;
+
+    long counts[num_biomes] = {};
+    Landmass_finder landmasses{width};
+    std::vector<bool> land(width);
+    std::vector<std::uint8_t> band(static_cast<std::size_t>(width)
+        * tile_size);
+    Tile_data tile{HEIGHT_FORMAT::float32};
+
+    /* A band of tiles at a time, the rows of which are then added to the
+       landmasses in order */
+    const int tiles_x = (width + tile_size - 1) / tile_size;
+    const int tiles_y = (height + tile_size - 1) / tile_size;
+    for (int ty=0; ty<tiles_y; ty++) {
+        const int rows = std::min(tile_size, height - ty*tile_size);
+        for (int tx=0; tx<tiles_x; tx++) {
+            generate_tile(noise, Tile_id{tx, ty}, tile);
+            const int cols = std::min(tile_size, width - tx*tile_size);
+            for (int ly=0; ly<rows; ly++) {
+                std::copy_n(&tile.biomes[static_cast<std::size_t>(ly)
+                    * tile_size], cols, &band[static_cast<std::size_t>(ly)
+                    * width + tx*tile_size]);
+            }
+        }
+        for (int ly=0; ly<rows; ly++) {
+            const std::uint8_t* b = &band[static_cast<std::size_t>(ly)
+                * width];
+            for (int x=0; x<width; x++) {
+                counts[b[x]]++;
+                land[x] = is_land(static_cast<BIOME>(b[x]));
+            }
+            landmasses.add_row(land);
+        }
+    }
+
+    const double pixels = static_cast<double>(width) * height;
+    Seed_stats stats;
+    stats.seed = seed;
+    stats.land = 0.0;
+    for (int b=0; b<num_biomes; b++) {
+        stats.biomes[b] = counts[b] / pixels;
+        if (is_land(static_cast<BIOME>(b)))
+            stats.land += stats.biomes[b];
+    }
+    stats.landmass = landmasses.largest() / pixels;
+    return stats;
+}
+
+std::vector<Seed_stats> search_seeds(const Seed_search_settings& s)
+{
+    const std::size_t count = (s.count > 0 ? s.count : 0);
+    std::vector<Seed_stats> all(count);
+    int step, width, height;
+    search_size(s, step, width, height);
+    const std::uint64_t pixels = static_cast<std::uint64_t>(width) * height;
+    if (s.progress != NULL)
+        s.progress->start(count);
+
+    /* Whole map engines make each field in parallel already */
+    const bool whole = whole_map_engine(s.noise.engine) && !s.noise.graph;
+    parallel_for(0, count, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i=begin; i<end; i++) {
+            all[i] = summarise_seed(s, s.first_seed + static_cast<int>(i));
+            if (s.progress != NULL)
+                s.progress->add(1, pixels);
+        }
+    }, (whole ? count : 1));
+
+    const Seed_criteria& c = s.criteria;
+    const double target = (c.target_land >= 0.0 ? c.target_land
+        : (c.min_land + c.max_land) / 2.0);
+    std::vector<Seed_stats> kept;
+    for (const Seed_stats& stats : all) {
+        if (stats.land >= c.min_land && stats.land <= c.max_land
+            && stats.landmass >= c.min_landmass)
+            kept.push_back(stats);
+    }
+    std::stable_sort(kept.begin(), kept.end(),
+        [target](const Seed_stats& a, const Seed_stats& b) {
+            const double da = std::fabs(a.land - target);
+            const double db = std::fabs(b.land - target);
+            if (da != db)
+                return da < db;
+            return a.landmass > b.landmass;
+        });
+    return kept;
+}
@@ -0,0 +1,94 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Seed_search.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Searching many seeds for maps that meet some criteria,
+    such as a share of land. Each seed is generated at a low resolution,
+    the same map with fewer pixels, and summarised as it is made.
+*/
+#ifndef SEED_SEARCH_H
+#define SEED_SEARCH_H
+
+#include <vector>
+#include "Biome.h"
+#include "Perlin_noise_generator.h"
+#include "Progress.h"
+
+/**
+ * \return true if pixels of biome b are land, beaches and above.
+ */
+inline bool is_land(BIOME b)
+{
+    return b >= BIOME::beach;
+}
+
+/**
+ * What a seed must give to be kept
+ */
+struct Seed_criteria {
+    double min_land = 0.0;      /**< Share of the map that is land */
+    double max_land = 1.0;
+    double min_landmass = 0.0;  /**< Share of the map in the largest
+                                    connected piece of land */
+    double target_land = -1.0;  /**< Seeds are ranked by how close their
+                                    land is to this, the middle of
+                                    [min_land, max_land] if < 0 */
+};
+
+struct Seed_search_settings {
+    Noise_settings noise;       /**< noise.seed is ignored */
+    int first_seed = 0;
+    int count = 1000;           /**< Number of seeds from first_seed */
+    int width = 2000;           /**< Of the full size map in pixels */
+    int height = 2000;
+    int resolution = 256;       /**< Longest side of the map as searched */
+    Seed_criteria criteria;
+    Progress* progress = NULL;  /**< If not NULL, started and counted in
+                                    seeds */
+};
+
+/**
+ * The summary of one seed
+ */
+struct Seed_stats {
+    int seed;
+    double land;                /**< Share of the map that is land */
+    double landmass;            /**< Share in the largest piece of land */
+    double biomes[num_biomes];  /**< Share of each BIOME */
+};
+
+/**
+ * Summarise the map of one seed.
+ * \param s The settings of the search, s.noise and the size of the map.
+ * \param seed The seed to summarise.
+ */
+Seed_stats summarise_seed(const Seed_search_settings& s, int seed);
+
+/**
+ * Summarise every seed of a search in parallel and rank the seeds that
+ * meet its criteria, best first.
+ */
+std::vector<Seed_stats> search_seeds(const Seed_search_settings& s);
+#endif
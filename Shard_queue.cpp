@@ -0,0 +1,577 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Shard_queue.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Splits the export of a world between processes, see
+    Shard_queue.h
+*/
+#include "Shard_queue.h"
+#include "File_util.h"
+#include "Logger.h"
+#include "Noise_graph.h"
+#include "Region_file.h"
+#include "Tile_data.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <sys/utime.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+namespace {
+
+constexpr char plan_name[] = "plan.txt";
+constexpr char plan_magic[] = "bmg-shards";
+constexpr int plan_version = 1;
+constexpr int max_rounds = 3;
+constexpr int claim_refresh = Shard_queue::claim_lease / 8;  /**< Seconds */
+
+void make_directory(const std::string& dir)
+{
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+}
+
+void write_plan(const std::string& filename, const Shard_plan& p)
+{
+    const std::string temp = filename + ".tmp";
+    {
+        std::ofstream out{temp, std::ofstream::out|std::ofstream::trunc};
+        if (!out)
+            throw std::runtime_error("Failed to write shard plan: " + temp);
+        out << std::setprecision(17)
+            << plan_magic << ' ' << plan_version << '\n'
+            << "seed " << p.noise.seed << '\n'
+            << "frequency " << p.noise.frequency << '\n'
+            << "octaves " << p.noise.octaves << '\n'
+            << "persistence " << p.noise.persistence << '\n'
+            << "lacunarity " << p.noise.lacunarity << '\n'
+            << "quality " << static_cast<int>(p.noise.quality) << '\n'
+            << "engine " << static_cast<int>(p.noise.engine) << '\n'
+            << "adaptive " << p.noise.adaptive_tolerance << '\n'
+            << "width " << p.settings.width << '\n'
+            << "height " << p.settings.height << '\n'
+            << "format " << static_cast<int>(p.settings.format) << '\n'
+            << "memory " << p.settings.memory_budget << '\n'
+            << "threads " << p.settings.threads << '\n'
+            << "shards " << p.num_shards << '\n';
+
+        /* A graph is kept as its description, a line per node */
+        if (p.noise.graph) {
+            std::istringstream graph{p.noise.graph->description()};
+            std::string line;
+            while (std::getline(graph, line))
+                out << "graph " << line << '\n';
+        }
+        if (!out)
+            throw std::runtime_error("Failed to write shard plan: " + temp);
+    }
+    if (!replace_file(temp, filename))
+        throw std::runtime_error("Failed to write shard plan: " + filename);
+}
+
+Shard_plan read_plan(const std::string& filename)
+{
+    std::ifstream in{filename};
+    std::string magic;
+    int version = 0;
+    if (!(in >> magic >> version) || magic != plan_magic
+        || version != plan_version)
+        throw std::runtime_error("Not a shard plan: " + filename);
+
+    Shard_plan p;
+    std::string name;
+    std::string graph;
+    while (in >> name) {
+        int quality = 0, engine = 0, format = 0;
+        std::string line;
+        if (name == "seed") in >> p.noise.seed;
+        else if (name == "frequency") in >> p.noise.frequency;
+        else if (name == "octaves") in >> p.noise.octaves;
+        else if (name == "persistence") in >> p.noise.persistence;
+        else if (name == "lacunarity") in >> p.noise.lacunarity;
+        else if (name == "quality") {
+            in >> quality;
+            p.noise.quality = static_cast<noise::NoiseQuality>(quality);
+        }
+        else if (name == "engine") {
+            in >> engine;
+            p.noise.engine = static_cast<NOISE_ENGINE>(engine);
+        }
+        else if (name == "adaptive") in >> p.noise.adaptive_tolerance;
+        else if (name == "width") in >> p.settings.width;
+        else if (name == "height") in >> p.settings.height;
+        else if (name == "format") {
+            in >> format;
+            p.settings.format = static_cast<HEIGHT_FORMAT>(format);
+        }
+        else if (name == "memory") in >> p.settings.memory_budget;
+        else if (name == "threads") in >> p.settings.threads;
+        else if (name == "shards") in >> p.num_shards;
+        else if (name == "graph" && std::getline(in, line))
+            graph += line + '\n';
+        else
+            throw std::runtime_error("Unknown setting in shard plan: "
+                + name);
+        if (!in)
+            throw std::runtime_error("Bad " + name + " in shard plan: "
+                + filename);
+    }
+    if (!in.eof())
+        throw std::runtime_error("Failed to read shard plan: " + filename);
+    if (p.num_shards <= 0 || p.settings.width <= 0 || p.settings.height <= 0
+        || !(p.noise.frequency > 0.0) || !(p.noise.persistence > 0.0)
+        || !(p.noise.lacunarity > 0.0) || p.noise.octaves < 1)
+        throw std::runtime_error("Bad shard plan: " + filename);
+    if (!graph.empty()) {
+        p.noise.graph = std::make_shared<const Noise_kernel>(
+            Noise_graph::parse(graph));
+    }
+    return p;
+}
+
+/**
+ * \return The name of this host, "?" if it is unknown.
+ */
+std::string host_name()
+{
+#ifdef _WIN32
+    const char* name = std::getenv("COMPUTERNAME");
+    return name != NULL && name[0] != '\0' ? name : "?";
+#else
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) != 0 || name[0] == '\0')
+        return "?";
+    return name;
+#endif
+}
+
+/**
+ * Create a file holding contents only if it does not exist, atomically.
+ * \return true if this call created it.
+ */
+bool create_exclusive(const std::string& filename,
+    const std::string& contents)
+{
+#ifdef _WIN32
+    int fd = _open(filename.c_str(), _O_CREAT|_O_EXCL|_O_WRONLY, 0644);
+    if (fd < 0)
+        return false;
+    if (_write(fd, contents.data(), static_cast<unsigned>(contents.size()))
+        < 0)
+        LOG("Failed to write claim: " + filename);
+    _close(fd);
+#else
+    int fd = open(filename.c_str(), O_CREAT|O_EXCL|O_WRONLY, 0644);
+    if (fd < 0)
+        return false;
+    if (write(fd, contents.data(), contents.size()) < 0)
+        LOG("Failed to write claim: " + filename);
+    close(fd);
+#endif
+    return true;
+}
+
+/**
+ * \param[out] time When the file was last modified.
+ * \return false if the file does not exist.
+ */
+bool modified_time(const std::string& filename, std::time_t& time)
+{
+#ifdef _WIN32
+    struct _stat st;
+    if (_stat(filename.c_str(), &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return false;
+#endif
+    time = st.st_mtime;
+    return true;
+}
+
+/**
+ * Set the modification time of a file to now.
+ */
+void touch_file(const std::string& filename)
+{
+#ifdef _WIN32
+    _utime(filename.c_str(), NULL);
+#else
+    utime(filename.c_str(), NULL);
+#endif
+}
+
+/**
+ * Refreshes a claim every claim_refresh seconds until destroyed, so it is
+ * not taken for the claim of a dead worker.
+ */
+class Claim_heartbeat {
+public:
+    explicit Claim_heartbeat(const std::string& filename)
+        :stopped{false}, beat{[this, filename]{
+            std::unique_lock<std::mutex> l{lock};
+            while (!wake.wait_for(l, std::chrono::seconds{claim_refresh},
+                [this]{return stopped;}))
+                touch_file(filename);
+        }}
+    {}
+
+    ~Claim_heartbeat()
+    {
+        {
+            std::lock_guard<std::mutex> l{lock};
+            stopped = true;
+        }
+        wake.notify_all();
+        beat.join();
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopped;
+    std::thread beat;   /**< Last, it uses the members above */
+};
+
+}
+
+constexpr int Shard_queue::claim_lease;
+
+void Shard_queue::create(const std::string& dir, const Shard_plan& plan)
+{
+    make_directory(dir);
+    write_plan(dir + "/" + plan_name, plan);
+
+    Shard_queue queue{dir};
+    queue.release_unfinished();
+}
+
+Shard_queue::Shard_queue(const std::string& dir)
+    :directory{dir}, shard_plan{read_plan(dir + "/" + plan_name)}
+{
+    const int tiles_y = (shard_plan.settings.height + tile_size - 1)
+        / tile_size;
+    if (shard_plan.num_shards > tiles_y)
+        shard_plan.num_shards = tiles_y;
+}
+
+std::string Shard_queue::path(const std::string& name) const
+{
+    return directory + "/" + name;
+}
+
+std::string Shard_queue::shard_file(int k) const
+{
+    return path("shard_" + std::to_string(k) + ".region");
+}
+
+std::string Shard_queue::claim_file(int k) const
+{
+    return path("shard_" + std::to_string(k) + ".claim");
+}
+
+int Shard_queue::first_row(int k) const
+{
+    const long tiles_y = (shard_plan.settings.height + tile_size - 1)
+        / tile_size;
+    return static_cast<int>(tiles_y * k / shard_plan.num_shards);
+}
+
+Stream_settings Shard_queue::shard_settings(int k) const
+{
+    Stream_settings s = shard_plan.settings;
+    s.first_tile_row = first_row(k);
+    const int last_y = std::min(shard_plan.settings.height,
+        first_row(k + 1) * tile_size);
+    s.height = last_y - s.first_tile_row * tile_size;
+    return s;
+}
+
+bool Shard_queue::finished(int k) const
+{
+    const Stream_settings s = shard_settings(k);
+    try {
+        Region_reader shard{shard_file(k)};
+        return shard.key() == tile_key(shard_plan.noise, s.format)
+            && shard.width() == s.width && shard.height() == s.height
+            && shard.format() == s.format;
+    }
+    catch (std::runtime_error&) {
+        return false;
+    }
+}
+
+bool Shard_queue::all_finished() const
+{
+    for (int k=0; k<num_shards(); k++)
+        if (!finished(k))
+            return false;
+    return true;
+}
+
+int Shard_queue::claim()
+{
+#ifdef _WIN32
+    const long pid = _getpid();
+#else
+    const long pid = getpid();
+#endif
+    const std::string owner = host_name() + " " + std::to_string(pid)
+        + "\n";
+    for (int k=0; k<num_shards(); k++) {
+        if (!finished(k) && create_exclusive(claim_file(k), owner))
+            return k;
+    }
+    return -1;
+}
+
+bool Shard_queue::claim_stale(int k) const
+{
+    const std::string filename = claim_file(k);
+    std::time_t modified;
+    if (!modified_time(filename, modified))
+        return false;
+    if (std::difftime(std::time(NULL), modified) > claim_lease)
+        return true;
+
+#ifndef _WIN32
+    /* A worker on this host can be asked directly if it is still there */
+    std::ifstream in{filename};
+    std::string host;
+    long pid = 0;
+    if (in >> host >> pid && host != "?" && host == host_name() && pid > 0
+        && kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH)
+        return true;
+#endif
+    return false;
+}
+
+void Shard_queue::release_unfinished()
+{
+    for (int k=0; k<num_shards(); k++)
+        if (!finished(k) && claim_stale(k))
+            std::remove(claim_file(k).c_str());
+}
+
+bool Shard_queue::working() const
+{
+    std::time_t modified;
+    for (int k=0; k<num_shards(); k++)
+        if (!finished(k) && modified_time(claim_file(k), modified)
+            && !claim_stale(k))
+            return true;
+    return false;
+}
+
+void Shard_queue::run_worker()
+{
+    int k;
+    while ((k = claim()) >= 0) {
+        LOG("Exporting shard " + std::to_string(k) + " of "
+            + std::to_string(num_shards()));
+        try {
+            Claim_heartbeat heartbeat{claim_file(k)};
+            stream_export(shard_plan.noise, shard_settings(k),
+                shard_file(k));
+        }
+        catch (...) {
+            std::remove(claim_file(k).c_str());
+            throw;
+        }
+    }
+}
+
+void Shard_queue::stitch(const std::string& output)
+{
+    const Stream_settings& s = shard_plan.settings;
+    Region_writer region{output, s.width, s.height, s.format,
+        tile_key(shard_plan.noise, s.format)};
+
+    std::vector<std::uint8_t> payload;
+    for (int k=0; k<num_shards(); k++) {
+        Region_reader shard{shard_file(k)};
+        const int row0 = first_row(k);
+        for (int ty=0; ty<shard.tiles_y(); ty++) {
+            for (int tx=0; tx<shard.tiles_x(); tx++) {
+                if (!shard.read_payload(Tile_id{tx, ty}, payload))
+                    throw std::runtime_error("Shard is missing tiles: "
+                        + shard_file(k));
+                region.write_payload(Tile_id{tx, row0 + ty}, payload);
+            }
+        }
+    }
+    region.finish();
+}
+
+void Shard_queue::remove()
+{
+    for (int k=0; k<num_shards(); k++) {
+        std::remove(shard_file(k).c_str());
+        std::remove(claim_file(k).c_str());
+    }
+    std::remove(path(plan_name).c_str());
+#ifdef _WIN32
+    _rmdir(directory.c_str());
+#else
+    rmdir(directory.c_str());
+#endif
+}
+
+void run_sharded_export(const Shard_plan& plan, const std::string& output,
+    int workers, const std::string& program, Progress* progress)
+{
+    const std::string dir = output + ".shards";
+    Shard_queue::create(dir, plan);
+    Shard_queue queue{dir};
+
+    /* Workers append to the log, so it must be opened before they start */
+    LOG("Exporting " + output + " as " + std::to_string(queue.num_shards())
+        + " shards with " + std::to_string(workers) + " workers");
+
+    /* Workers are other processes, so progress is counted a shard at a
+       time as their files are finished */
+    const int tiles_x = (plan.settings.width + tile_size - 1) / tile_size;
+    std::vector<bool> counted(queue.num_shards(), false);
+    auto count_finished = [&](bool report) -> std::uint64_t {
+        std::uint64_t tiles = 0;
+        for (int k=0; k<queue.num_shards(); k++) {
+            if (counted[k] || !queue.finished(k))
+                continue;
+            const Stream_settings s = queue.shard_settings(k);
+            const std::uint64_t n = static_cast<std::uint64_t>(tiles_x)
+                * ((s.height + tile_size - 1) / tile_size);
+            if (report)
+                progress->add(n, static_cast<std::uint64_t>(s.width)
+                    * s.height);
+            counted[k] = true;
+            tiles += n;
+        }
+        return tiles;
+    };
+    if (progress != NULL) {
+        const std::uint64_t total = static_cast<std::uint64_t>(tiles_x)
+            * ((plan.settings.height + tile_size - 1) / tile_size);
+        progress->start(total, count_finished(false));
+    }
+
+    for (int round=0; round<max_rounds && !queue.all_finished(); round++) {
+        if (round > 0) {
+            LOG("Retrying unfinished shards");
+            queue.release_unfinished();
+        }
+#ifdef _WIN32
+        /* No fork, so the shards are exported by this process */
+        (void)workers;
+        try {
+            queue.run_worker();
+        }
+        catch (std::runtime_error& e) {
+            LOG(e.what());
+        }
+        if (progress != NULL)
+            count_finished(true);
+#else
+        std::vector<pid_t> children;
+        for (int w=0; w<workers; w++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                execlp(program.c_str(), program.c_str(), "--worker",
+                    dir.c_str(), static_cast<char*>(NULL));
+                _exit(127);
+            }
+            if (pid < 0)
+                LOG("Failed to start worker " + std::to_string(w));
+            else
+                children.push_back(pid);
+        }
+        if (children.empty())
+            throw std::runtime_error("Failed to start any workers");
+
+        while (!children.empty()) {
+            for (auto it = children.begin(); it != children.end(); ) {
+                int status = 0;
+                pid_t result = waitpid(*it, &status, WNOHANG);
+                if (result == 0) {
+                    ++it;
+                    continue;
+                }
+                if (result < 0 || !WIFEXITED(status)
+                    || WEXITSTATUS(status) != 0)
+                    LOG("Worker " + std::to_string(*it) + " failed");
+                it = children.erase(it);
+            }
+            if (progress != NULL)
+                count_finished(true);
+            if (!children.empty())
+                std::this_thread::sleep_for(std::chrono::milliseconds{200});
+        }
+#endif
+        /* Workers that joined from elsewhere may still be exporting, their
+           shards are only retried once their claims go stale */
+        while (queue.working()) {
+            if (progress != NULL)
+                count_finished(true);
+            std::this_thread::sleep_for(std::chrono::seconds{1});
+        }
+    }
+
+    if (!queue.all_finished())
+        throw std::runtime_error("Shards of " + output + " failed, run "
+            "again to resume them");
+
+    LOG("Stitching " + std::to_string(queue.num_shards()) + " shards into "
+        + output);
+    queue.stitch(output);
+    queue.remove();
+}
@@ -0,0 +1,148 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Shard_queue.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Splits the export of a world between several processes.
+    A coordinator writes a plan into a queue directory, worker processes
+    claim bands of tile rows (shards) from it by creating claim files, and
+    the finished shards are stitched into one region file. Noise is
+    evaluated at each tile's place in the world, so shards join without
+    seams. Nothing but the filesystem is shared, so workers on other hosts
+    can join through a shared directory.
+*/
+#ifndef SHARD_QUEUE_H
+#define SHARD_QUEUE_H
+
+#include <string>
+#include "Perlin_noise_generator.h"
+#include "Progress.h"
+#include "Stream_export.h"
+
+struct Shard_plan {
+    Noise_settings noise;
+    Stream_settings settings;   /**< Of the whole world, the memory budget
+                                    and threads are per worker */
+    int num_shards = 1;
+};
+
+class Shard_queue {
+public:
+    /** Seconds a claim is kept without being refreshed */
+    static constexpr int claim_lease = 120;
+
+    /**
+     * Write a plan into a queue directory, creating it if needed. Claims
+     * of shards that are not finished are removed, finished shards of the
+     * same plan are kept.
+     */
+    static void create(const std::string& dir, const Shard_plan& plan);
+
+    /**
+     * Constructor, reads the plan of a queue. Throws if there is none.
+     */
+    explicit Shard_queue(const std::string& dir);
+
+    const Shard_plan& plan() const {return shard_plan;}
+    int num_shards() const {return shard_plan.num_shards;}
+
+    /**
+     * \return The settings to export shard k with.
+     */
+    Stream_settings shard_settings(int k) const;
+
+    std::string shard_file(int k) const;
+
+    /**
+     * Claim the first shard that is neither finished nor claimed. Safe
+     * between processes, a claim file is created exclusively. It holds the
+     * host and process of the worker, and is refreshed while it works.
+     * \return The shard claimed, or -1 if there are none left.
+     */
+    int claim();
+
+    /**
+     * Remove the stale claims of shards that are not finished, so they can
+     * be claimed again after their worker died. A claim is stale if its
+     * worker was a process on this host that has exited, or if it has not
+     * been refreshed for claim_lease seconds.
+     */
+    void release_unfinished();
+
+    /**
+     * \return true if a shard that is not finished has a claim that is not
+     * stale, so a worker is still exporting it.
+     */
+    bool working() const;
+
+    /**
+     * \return true if shard k has been completely written for this plan.
+     */
+    bool finished(int k) const;
+
+    bool all_finished() const;
+
+    /**
+     * Claim and export shards until none are left. Throws if an export
+     * fails, releasing its claim so a later worker can resume it.
+     */
+    void run_worker();
+
+    /**
+     * Copy every finished shard into one region file, tiles are copied
+     * without being decompressed.
+     */
+    void stitch(const std::string& output);
+
+    /**
+     * Delete the plan, claims and shards, then the directory.
+     */
+    void remove();
+
+private:
+    std::string directory;
+    Shard_plan shard_plan;
+
+    std::string path(const std::string& name) const;
+    std::string claim_file(int k) const;
+    /** \return true if shard k has a claim and it is stale. */
+    bool claim_stale(int k) const;
+
+    /** \return The first tile row of shard k, k may be num_shards. */
+    int first_row(int k) const;
+};
+
+/**
+ * Export a world to a region file with several worker processes. Each
+ * worker is this program run with "--worker <queue directory>". Shards
+ * whose worker fails are retried by new workers.
+ * \param plan The world to export and how to split it.
+ * \param output The region file to write.
+ * \param workers The number of worker processes to start.
+ * \param program The path of this program.
+ * \param progress If not NULL, counts tiles as each shard is finished.
+ */
+void run_sharded_export(const Shard_plan& plan, const std::string& output,
+    int workers, const std::string& program, Progress* progress = NULL);
+#endif
@@ -0,0 +1,115 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Simplex_noise.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: 2D simplex noise and its fractal sum. A 2D map sampled at
+    a fixed z only needs 2D noise: simplex noise sums 3 corners of a
+    triangle rather than interpolating the 8 corners of a cube, and its
+    triangles don't line up with the axes, so there are no axis aligned
+    creases. Gradients are picked by hashing the lattice point, as in
+    Gradient_noise.h.
+*/
+#ifndef SIMPLEX_NOISE_H
+#define SIMPLEX_NOISE_H
+
+#include <cmath>
+#include <cstdint>
+#include "Gradient_noise.h"
+
+/* Skew from the plane to the lattice of triangles and back */
+constexpr double simplex_skew = 0.36602540378443864676;     // (sqrt(3)-1)/2
+constexpr double simplex_unskew = 0.21132486540518711775;   // (3-sqrt(3))/6
+
+/**
+ * \return The dot product of (x, y) with one of 8 gradients, (+-1, +-2)
+ * and (+-2, +-1), picked by h.
+ */
+inline double simplex_gradient(std::uint32_t h, double x, double y)
+{
+    const double u = ((h & 4) ? y : x);
+    const double v = 2.0 * ((h & 4) ? x : y);
+    return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+/**
+ * \return The part of a corner at offset (x, y) from the sample, 0 once
+ * it is further than sqrt(0.5).
+ */
+inline double simplex_corner(std::uint32_t h, double x, double y)
+{
+    double t = 0.5 - x * x - y * y;
+    /* max(t, 0) exactly, as a select GCC moves the multiplies below into
+       a branch and the loops calling this stop vectorizing */
+    t = 0.5 * (t + std::fabs(t));
+    t *= t;
+    return t * t * simplex_gradient(h, x, y);
+}
+
+/**
+ * One octave of 2D simplex noise.
+ * \return A value in about [-1, 1], 0 at every lattice point.
+ */
+inline double simplex_noise(double x, double y, std::int32_t seed)
+{
+    /* The triangle holding the sample, from the cell of the skewed grid */
+    const double s = (x + y) * simplex_skew;
+    const std::int32_t i = noise_floor(x + s);
+    const std::int32_t j = noise_floor(y + s);
+    const double t = (i + j) * simplex_unskew;
+    const double x0 = x - (i - t);
+    const double y0 = y - (j - t);
+
+    /* The middle corner is along whichever axis the sample is further */
+    const std::int32_t i1 = (x0 > y0);
+    const std::int32_t j1 = 1 - i1;
+    const double x1 = x0 - i1 + simplex_unskew;
+    const double y1 = y0 - j1 + simplex_unskew;
+    const double x2 = x0 - 1.0 + 2.0 * simplex_unskew;
+    const double y2 = y0 - 1.0 + 2.0 * simplex_unskew;
+
+    const double n = simplex_corner(lattice_hash(i, j, 0, seed), x0, y0)
+        + simplex_corner(lattice_hash(i + i1, j + j1, 0, seed), x1, y1)
+        + simplex_corner(lattice_hash(i + 1, j + 1, 0, seed), x2, y2);
+    return 45.0 * n;       // The sum peaks at about 0.022
+}
+
+/**
+ * The sum of octaves of simplex noise, as fbm_noise() sums gradient noise.
+ * \return A value in about [-1, 1] for a persistence of 0.5.
+ */
+inline double simplex_fbm(double x, double y, std::int32_t seed, int octaves,
+    double persistence, double lacunarity)
+{
+    double value = 0.0;
+    double amplitude = 1.0;
+    for (int o=0; o<octaves; o++) {
+        value += simplex_noise(x, y, seed + o) * amplitude;
+        x *= lacunarity;
+        y *= lacunarity;
+        amplitude *= persistence;
+    }
+    return value;
+}
+#endif
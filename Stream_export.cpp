@@ -0,0 +1,488 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Stream_export.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Generates a map straight to a file, see Stream_export.h
+*/
+#include "Stream_export.h"
+#include "Biome.h"
+#include "Export_journal.h"
+#include "File_util.h"
+#include "Generation_job.h"
+#include "Heightfield.h"
+#include "Logger.h"
+#include "Region_file.h"
+#include "Thread_pool.h"
+#include "Tile_buffer_pool.h"
+#include "Tile_data.h"
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr std::uint32_t bmp_header_bytes = 14 + 40;
+
+void put_u16(std::uint8_t* p, std::uint16_t v)
+{
+    p[0] = static_cast<std::uint8_t>(v);
+    p[1] = static_cast<std::uint8_t>(v >> 8);
+}
+
+void put_u32(std::uint8_t* p, std::uint32_t v)
+{
+    for (int i=0; i<4; i++)
+        p[i] = static_cast<std::uint8_t>(v >> (8*i));
+}
+
+/**
+ * The tile buffers of one export, borrowed from s.buffers if it is set
+ */
+class Export_buffers {
+public:
+    Export_buffers(const Stream_settings& s, std::size_t n, HEIGHT_FORMAT f)
+        :pool{s.buffers}
+    {
+        if (pool != NULL) {
+            tiles = pool->borrow(n, f);
+            return;
+        }
+        for (std::size_t i=0; i<n; i++)
+            tiles.emplace_back(new Tile_data{f});
+    }
+
+    ~Export_buffers()
+    {
+        if (pool != NULL)
+            pool->give_back(tiles);
+    }
+
+    Export_buffers(const Export_buffers&) = delete;
+    Export_buffers& operator=(const Export_buffers&) = delete;
+
+    Tile_batch tiles;
+
+private:
+    Tile_buffer_pool* pool;
+};
+
+/**
+ * Generate tiles on a thread pool, then call fn(tile) on the worker that
+ * generated each one. Returns once every tile is done, throws the first
+ * error thrown by fn after cancelling the rest.
+ */
+template<typename F>
+void generate_batch(Thread_pool& pool, const Noise_settings& noise,
+    const std::vector<Tile_id>& ids, Tile_batch& buffers, F fn)
+{
+    Generation_job job{ids.size()};
+
+    std::vector<Thread_pool::Task> tasks;
+    tasks.reserve(ids.size());
+    for (std::size_t i=0; i<ids.size(); i++) {
+        Tile_data* tile = buffers[i].get();
+        const Tile_id t = ids[i];
+        tasks.push_back([&, tile, t] {
+            try {
+                if (generate_tile(noise, t, *tile, &job)) {
+                    fn(*tile);
+                    job.tile_done(t);
+                    return;
+                }
+            }
+            catch (std::exception& e) {
+                job.cancel();
+                job.tile_failed(e.what());
+                return;
+            }
+            catch (...) {
+                job.cancel();
+                job.tile_failed("Unknown error");
+                return;
+            }
+            job.tile_skipped();
+        });
+    }
+    pool.submit(tasks);
+    job.wait();
+    if (!job.error().empty())
+        throw std::runtime_error(job.error());
+}
+
+/**
+ * \return How many tiles fit in the budget after the fixed memory.
+ */
+std::size_t batch_size(const Stream_settings& s, EXPORT_FORMAT f,
+    HEIGHT_FORMAT tile_format)
+{
+    const std::size_t fixed = stream_fixed_memory(s, f);
+    /* A region tile is also encoded, into a buffer reserved for its
+       largest payload */
+    const std::size_t per_tile = Tile_data{tile_format}.bytes()
+        + sizeof(Tile_data)
+        + (f == EXPORT_FORMAT::region ? max_payload_size(tile_format) : 0);
+
+    if (s.memory_budget < fixed + per_tile) {
+        throw std::runtime_error("Memory budget of "
+            + std::to_string(s.memory_budget >> 20) + "MB is too small, "
+            + std::to_string(((fixed + per_tile) >> 20) + 1)
+            + "MB is needed");
+    }
+    return (s.memory_budget - fixed) / per_tile;
+}
+
+void log_progress(std::size_t done, std::size_t total, std::size_t& last)
+{
+    std::size_t percent = done * 100 / total;
+    if (percent / 10 > last / 10) {
+        LOG("Exported " + std::to_string(percent) + "%");
+        last = percent;
+    }
+}
+
+/**
+ * \return The signature of an export for its journal.
+ */
+std::string journal_signature(const char* kind, const Noise_settings& noise,
+    const Stream_settings& s, HEIGHT_FORMAT f)
+{
+    std::ostringstream sig;
+    sig << kind << ' ' << std::hex << tile_key(noise, f) << std::dec << ' '
+        << s.width << 'x' << s.height << '+' << s.first_tile_row;
+    return sig.str();
+}
+
+bool file_exists(const std::string& filename)
+{
+    FILE* f = std::fopen(filename.c_str(), "rb");
+    if (f != NULL)
+        std::fclose(f);
+    return f != NULL;
+}
+
+void export_region(Thread_pool& pool, const Noise_settings& noise,
+    const Stream_settings& s, const std::string& filename)
+{
+    const std::size_t batch = batch_size(s, EXPORT_FORMAT::region, s.format);
+    Export_journal journal{filename,
+        journal_signature("region", noise, s, s.format)};
+    if (!journal.completed().empty() && !file_exists(filename))
+        journal.restart();
+
+    const bool resume = !journal.completed().empty();
+    Region_writer region{filename, s.width, s.height, s.format,
+        tile_key(noise, s.format), resume};
+    const std::size_t total = static_cast<std::size_t>(region.tiles_x())
+        * region.tiles_y();
+
+    /* Tiles an earlier run finished are put back in the index, not
+       generated again */
+    std::vector<bool> done(total, false);
+    std::size_t num_done = 0;
+    for (const Region_tile& r : journal.completed()) {
+        if (region.restore_tile(r.id, r.entry)) {
+            std::size_t k = static_cast<std::size_t>(r.id.ty)
+                * region.tiles_x() + r.id.tx;
+            num_done += (done[k] ? 0 : 1);
+            done[k] = true;
+        }
+    }
+    if (resume) {
+        LOG("Resuming " + filename + ", " + std::to_string(num_done)
+            + " of " + std::to_string(total) + " tiles already done");
+    }
+    if (s.progress != NULL)
+        s.progress->start(total, num_done);
+
+    /* A shared pool may lend fewer buffers than the budget allows */
+    Export_buffers buffers{s, std::min(total - num_done, batch), s.format};
+    const std::size_t per_batch = std::max<std::size_t>(
+        buffers.tiles.size(), 1);
+
+    std::vector<Tile_id> ids;
+    std::size_t last_percent = num_done * 100 / total;
+    std::size_t k = 0;
+    while (num_done < total) {
+        ids.clear();
+        for (; k<total && ids.size()<per_batch; k++) {
+            if (!done[k]) {
+                ids.push_back(Tile_id{static_cast<int>(k % region.tiles_x()),
+                    static_cast<int>(k / region.tiles_x())
+                        + s.first_tile_row});
+            }
+        }
+        /* Compression happens on the workers too, only the write is
+           serialised */
+        generate_batch(pool, noise, ids, buffers.tiles, [&](Tile_data& t) {
+            t.id.ty -= s.first_tile_row;
+            region.write_tile(t);
+            if (s.progress != NULL) {
+                s.progress->add(1, static_cast<std::uint64_t>(
+                    std::min(tile_size, s.width - t.id.tx * tile_size))
+                    * std::min(tile_size, s.height - t.id.ty * tile_size));
+            }
+        });
+
+        /* Checkpoint, the tiles must reach the file before the journal */
+        region.flush();
+        journal.append(region.take_written());
+        num_done += ids.size();
+        log_progress(num_done, total, last_percent);
+    }
+    region.finish();
+    journal.remove();
+}
+
+void export_bmp(Thread_pool& pool, const Noise_settings& noise,
+    const Stream_settings& s, const std::string& filename)
+{
+    const int tiles_x = (s.width + tile_size - 1) / tile_size;
+    const int tiles_y = (s.height + tile_size - 1) / tile_size;
+    const int batch = static_cast<int>(std::min<std::size_t>(tiles_x,
+        batch_size(s, EXPORT_FORMAT::bmp, HEIGHT_FORMAT::float32)));
+    const std::size_t row_bytes = static_cast<std::size_t>(s.width) * 3;
+
+    /* A band is journaled once all its rows are on disk, bands are
+       written bottom first so the finished ones are the bottom bands in a
+       row */
+    Export_journal journal{filename,
+        journal_signature("bmp", noise, s, HEIGHT_FORMAT::float32)};
+    if (!journal.completed().empty() && !file_exists(filename))
+        journal.restart();
+    std::vector<bool> band_done(tiles_y, false);
+    for (int band : journal.completed_bands())
+        if (band >= 0 && band < tiles_y)
+            band_done[band] = true;
+
+    int first_band = tiles_y - 1;
+    int rows_done = 0;
+    while (first_band >= 0 && band_done[first_band]) {
+        rows_done += std::min(tile_size, s.height - first_band * tile_size);
+        first_band--;
+    }
+    if (rows_done > 0) {
+        LOG("Resuming " + filename + ", " + std::to_string(rows_done)
+            + " of " + std::to_string(s.height) + " rows already done");
+    }
+
+    Bmp_stream_writer bmp{filename, s.width, s.height, rows_done};
+    if (s.progress != NULL) {
+        s.progress->start(static_cast<std::uint64_t>(tiles_x) * tiles_y,
+            static_cast<std::uint64_t>(tiles_x) * (tiles_y - 1 - first_band));
+    }
+
+    std::uint8_t lut[256][3] = {};
+    for (int b=0; b<num_biomes; b++) {
+        Biome_color c = default_biome_color(static_cast<BIOME>(b));
+        lut[b][0] = c.b;
+        lut[b][1] = c.g;
+        lut[b][2] = c.r;
+    }
+
+    Export_buffers buffers{s, static_cast<std::size_t>(batch),
+        HEIGHT_FORMAT::float32};
+    const int per_batch = static_cast<int>(buffers.tiles.size());
+    std::vector<std::uint8_t> band(row_bytes * tile_size);
+
+    std::vector<Tile_id> ids;
+    std::size_t last_percent = (tiles_y - 1 - first_band) * 100 / tiles_y;
+    for (int ty=first_band; ty>=0; ty--) {
+        const int y0 = ty * tile_size;
+        const int rows = std::min(tile_size, s.height - y0);
+
+        for (int first=0; first<tiles_x; first+=per_batch) {
+            ids.clear();
+            for (int tx=first; tx<std::min(tiles_x, first + per_batch); tx++)
+                ids.push_back(Tile_id{tx, ty + s.first_tile_row});
+
+            /* Tiles colour disjoint columns of the band */
+            generate_batch(pool, noise, ids, buffers.tiles, [&](Tile_data& t) {
+                const int x0 = t.id.tx * tile_size;
+                const int cols = std::min(tile_size, s.width - x0);
+                for (int ly=0; ly<rows; ly++) {
+                    const std::uint8_t* src = &t.biomes[
+                        static_cast<std::size_t>(ly) * tile_size];
+                    std::uint8_t* dst = &band[ly * row_bytes + x0 * 3];
+                    for (int lx=0; lx<cols; lx++, dst+=3) {
+                        dst[0] = lut[src[lx]][0];
+                        dst[1] = lut[src[lx]][1];
+                        dst[2] = lut[src[lx]][2];
+                    }
+                }
+                if (s.progress != NULL)
+                    s.progress->add(1, static_cast<std::uint64_t>(cols) * rows);
+            });
+        }
+
+        for (int ly=rows-1; ly>=0; ly--)
+            bmp.write_row(&band[ly * row_bytes]);
+        bmp.flush();
+        journal.append_band(ty);
+        log_progress(tiles_y - ty, tiles_y, last_percent);
+    }
+    bmp.finish();
+    journal.remove();
+}
+
+}
+
+EXPORT_FORMAT export_format_for(const std::string& filename)
+{
+    std::string ext = filename.substr(filename.find_last_of('.') + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return (ext == "bmp" ? EXPORT_FORMAT::bmp : EXPORT_FORMAT::region);
+}
+
+Bmp_stream_writer::Bmp_stream_writer(const std::string& filename, int w,
+    int h, int resume_rows)
+    :name{filename}, file{NULL}, width{w}, height{h}, rows_written{0},
+    row_bytes{(static_cast<std::size_t>(w) * 3 + 3) / 4 * 4}
+{
+    if (w <= 0 || h <= 0)
+        throw std::runtime_error("Bitmap must not be empty: " + filename);
+    const std::uint64_t size = file_size(w, h);
+    if (size > 0xffffffffULL)
+        throw std::runtime_error("Map is too large for a bitmap, use a "
+            "region file instead: " + filename);
+
+    std::uint8_t header[bmp_header_bytes] = {};
+    header[0] = 'B';
+    header[1] = 'M';
+    put_u32(header + 2, static_cast<std::uint32_t>(size));
+    put_u32(header + 10, bmp_header_bytes);
+    put_u32(header + 14, 40);
+    put_u32(header + 18, static_cast<std::uint32_t>(w));
+    put_u32(header + 22, static_cast<std::uint32_t>(h));
+    put_u16(header + 26, 1);
+    put_u16(header + 28, 24);
+    put_u32(header + 34, static_cast<std::uint32_t>(size - bmp_header_bytes));
+    put_u32(header + 38, 2835);     // 72 DPI
+    put_u32(header + 42, 2835);
+
+    if (resume_rows > 0) {
+        /* Rows after the ones kept are overwritten */
+        const std::uint64_t kept = bmp_header_bytes
+            + static_cast<std::uint64_t>(resume_rows) * row_bytes;
+        file = std::fopen(filename.c_str(), "r+b");
+        if (file == NULL)
+            throw std::runtime_error("Failed to open bitmap: " + filename);
+        if (resume_rows > h || seek_to_end(file) < kept
+            || !seek_to(file, kept)) {
+            std::fclose(file);
+            file = NULL;
+            throw std::runtime_error("Bitmap is too short to resume: "
+                + filename);
+        }
+        rows_written = resume_rows;
+        return;
+    }
+
+    file = std::fopen(filename.c_str(), "wb");
+    if (file == NULL)
+        throw std::runtime_error("Failed to open bitmap: " + filename);
+    if (std::fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        std::fclose(file);
+        file = NULL;
+        throw std::runtime_error("Failed to write bitmap: " + filename);
+    }
+}
+
+Bmp_stream_writer::~Bmp_stream_writer()
+{
+    if (file != NULL)
+        std::fclose(file);
+}
+
+void Bmp_stream_writer::write_row(const std::uint8_t* bgr)
+{
+    static const std::uint8_t padding[3] = {};
+    const std::size_t bytes = static_cast<std::size_t>(width) * 3;
+    if (file == NULL || rows_written >= height)
+        throw std::runtime_error("Too many rows for bitmap: " + name);
+    if (std::fwrite(bgr, 1, bytes, file) != bytes
+        || std::fwrite(padding, 1, row_bytes - bytes, file)
+            != row_bytes - bytes)
+        throw std::runtime_error("Failed to write bitmap: " + name);
+    rows_written++;
+}
+
+void Bmp_stream_writer::flush()
+{
+    if (file != NULL && !sync_file(file))
+        throw std::runtime_error("Failed to write bitmap: " + name);
+}
+
+void Bmp_stream_writer::finish()
+{
+    if (file == NULL)
+        return;
+    bool ok = (std::fclose(file) == 0);
+    file = NULL;
+    if (!ok || rows_written != height)
+        throw std::runtime_error("Failed to finish bitmap: " + name);
+}
+
+std::uint64_t Bmp_stream_writer::file_size(int w, int h)
+{
+    return bmp_header_bytes + (static_cast<std::uint64_t>(w) * 3 + 3) / 4 * 4
+        * static_cast<std::uint64_t>(h);
+}
+
+std::size_t stream_fixed_memory(const Stream_settings& s, EXPORT_FORMAT f)
+{
+    const std::size_t tiles_x = (s.width + tile_size - 1) / tile_size;
+    const std::size_t tiles_y = (s.height + tile_size - 1) / tile_size;
+    if (f == EXPORT_FORMAT::bmp)
+        return tiles_x * tile_size * tile_size * 3;
+    return tiles_x * tiles_y * sizeof(Region_entry);
+}
+
+void stream_export(const Noise_settings& noise, const Stream_settings& s,
+    const std::string& filename)
+{
+    std::unique_ptr<Thread_pool> own_pool;
+    if (s.threads > 0)
+        own_pool.reset(new Thread_pool{s.threads});
+    Thread_pool& pool = (own_pool ? *own_pool : default_pool());
+
+    /* A whole map engine makes the whole field up front, outside the
+       budget, so a part of a map would not join the rest */
+    Noise_settings whole = noise;
+    if (whole_map_engine(noise.engine) && !noise.graph && !noise.field) {
+        if (s.first_tile_row != 0) {
+            throw std::runtime_error(std::string{"Can't export part of a "}
+                + noise_engine_name(noise.engine) + " map");
+        }
+        whole.field = make_heightfield(noise, s.width, s.height);
+    }
+
+    if (export_format_for(filename) == EXPORT_FORMAT::bmp)
+        export_bmp(pool, whole, s, filename);
+    else
+        export_region(pool, whole, s, filename);
+}
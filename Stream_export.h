@@ -0,0 +1,151 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Stream_export.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Generates a map straight to a file a few tiles at a time,
+    for maps far larger than memory. The tiles in flight are bounded by a
+    memory budget, not by the size of the map.
+*/
+#ifndef STREAM_EXPORT_H
+#define STREAM_EXPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "Height_layer.h"
+#include "Perlin_noise_generator.h"
+#include "Progress.h"
+
+class Tile_buffer_pool;
+
+enum class EXPORT_FORMAT {
+    region,     /**< A region file, see Region_file.h */
+    bmp         /**< A 24 bit bitmap of the biome colours */
+};
+
+/**
+ * \return bmp for files ending in .bmp, region otherwise.
+ */
+EXPORT_FORMAT export_format_for(const std::string& filename);
+
+struct Stream_settings {
+    int width = 2000;                       /**< Of the map in pixels */
+    int height = 2000;
+    HEIGHT_FORMAT format = HEIGHT_FORMAT::float32;  /**< Of region heights */
+    std::size_t memory_budget = 256u << 20; /**< Bytes of buffers to use */
+    int first_tile_row = 0;     /**< Row of tiles of the world the map starts
+                                    at, so parts of a world exported
+                                    separately join without seams */
+    unsigned threads = 0;       /**< Threads to generate with, 0 to use
+                                    default_pool() */
+    Progress* progress = NULL;  /**< If not NULL, started and counted in
+                                    tiles as the export runs */
+    Tile_buffer_pool* buffers = NULL;   /**< If not NULL, tile buffers are
+                                            borrowed from it instead of
+                                            allocated for the export */
+};
+
+/**
+ * Writes a 24 bit bitmap a row at a time. Rows are given bottom row first,
+ * the order they are stored in, so nothing is buffered.
+ */
+class Bmp_stream_writer {
+public:
+    /**
+     * Constructor, writes the headers. Throws if the file can not be opened
+     * or the image is too large for the format (4GB).
+     * \param resume_rows If not 0 the file is opened without truncating
+     * and writing carries on after this many rows.
+     */
+    Bmp_stream_writer(const std::string& filename, int w, int h,
+        int resume_rows = 0);
+
+    /**
+     * Closes the file, it is incomplete unless every row was written.
+     */
+    ~Bmp_stream_writer();
+
+    Bmp_stream_writer(const Bmp_stream_writer&) = delete;
+    Bmp_stream_writer& operator=(const Bmp_stream_writer&) = delete;
+
+    /**
+     * Write the next row up.
+     * \param bgr width pixels of blue, green, red bytes.
+     */
+    void write_row(const std::uint8_t* bgr);
+
+    /**
+     * Flush written rows to disk, throws on failure.
+     */
+    void flush();
+
+    /**
+     * Close the file, throws if rows are missing or it could not be written.
+     */
+    void finish();
+
+    /**
+     * \return The size of the file for an image of w by h pixels.
+     */
+    static std::uint64_t file_size(int w, int h);
+
+private:
+    std::string name;
+    FILE* file;
+    int width;
+    int height;
+    int rows_written;
+    std::size_t row_bytes;  /**< Padded to a multiple of 4 */
+};
+
+/**
+ * Generate a map into a file. Tiles are generated on the thread pool in
+ * batches as large as the budget allows, and written as each batch is
+ * done. Bitmaps are generated a band of 64 rows at a time, bottom band
+ * first.
+ *
+ * Each batch or band is recorded in a journal next to the file once it
+ * is flushed, see Export_journal.h. If an export with the same settings
+ * was interrupted it is resumed, skipping the tiles in its journal. The
+ * journal is deleted when the file is finished.
+ *
+ * A whole map engine (see Heightfield.h) first makes the heights of the
+ * whole map, 4 bytes a pixel on top of the budget.
+ * \param noise The noise to generate from.
+ * \param s The size of the map and the memory to use.
+ * \param filename The file to write, its type is chosen by
+ * export_format_for().
+ * Throws if the budget is too small for even one tile or on write errors.
+ */
+void stream_export(const Noise_settings& noise, const Stream_settings& s,
+    const std::string& filename);
+
+/**
+ * \return The bytes stream_export() needs that do not depend on the batch
+ * size: the index of a region file or one band of a bitmap.
+ */
+std::size_t stream_fixed_memory(const Stream_settings& s, EXPORT_FORMAT f);
+#endif
@@ -0,0 +1,207 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Thread_pool.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A work stealing thread pool, see Thread_pool.h
+*/
+#include "Thread_pool.h"
+#include "Logger.h"
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+Thread_pool::Thread_pool(unsigned threads)
+    :pending{0}, stopping{false}, next_queue{0}
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    for (unsigned i=0; i<threads; i++)
+        queues.emplace_back(new Queue{});
+    for (unsigned i=0; i<threads; i++)
+        workers.emplace_back(&Thread_pool::run, this, i);
+}
+
+Thread_pool::~Thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard{sleep_lock};
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers)
+        w.join();
+}
+
+void Thread_pool::push(Task task)
+{
+    unsigned id = next_queue++ % queues.size();
+    std::lock_guard<std::mutex> guard{queues[id]->lock};
+    queues[id]->tasks.push_back(std::move(task));
+}
+
+void Thread_pool::submit(Task task)
+{
+    push(std::move(task));
+    {
+        std::lock_guard<std::mutex> guard{sleep_lock};
+        pending++;
+    }
+    wake.notify_one();
+}
+
+void Thread_pool::submit(std::vector<Task>& tasks)
+{
+    for (auto& t : tasks)
+        push(std::move(t));
+    {
+        std::lock_guard<std::mutex> guard{sleep_lock};
+        pending += tasks.size();
+    }
+    tasks.clear();
+    wake.notify_all();
+}
+
+bool Thread_pool::take(unsigned id, Task& task)
+{
+    /* Own queue first, then every other queue starting with the next one.
+       Work is always taken from the front, which holds the most important
+       task of each queue. */
+    for (unsigned k=0; k<queues.size(); k++) {
+        Queue& q = *queues[(id + k) % queues.size()];
+        std::lock_guard<std::mutex> guard{q.lock};
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Thread_pool::run(unsigned id)
+{
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard{sleep_lock};
+            wake.wait(guard, [this] {return pending > 0 || stopping;});
+            if (stopping)
+                return;
+        }
+
+        Task task;
+        if (!take(id, task))
+            continue;
+        {
+            std::lock_guard<std::mutex> guard{sleep_lock};
+            pending--;
+        }
+
+        try {
+            task();
+        }
+        catch (std::exception& e) {
+            LOG("Task failed: " + std::string{e.what()});
+        }
+    }
+}
+
+Thread_pool& default_pool()
+{
+    static Thread_pool pool{};
+    return pool;
+}
+
+void pool_for(Thread_pool& pool, std::size_t begin, std::size_t end,
+    const std::function<void(std::size_t, std::size_t)>& fn,
+    std::size_t min_chunk)
+{
+    if (end <= begin)
+        return;
+
+    /* A few chunks a thread, so a slow one is made up by the others */
+    const std::size_t n = end - begin;
+    std::size_t chunks = (static_cast<std::size_t>(pool.size()) + 1) * 4;
+    if (min_chunk > 0 && n / min_chunk < chunks)
+        chunks = std::max<std::size_t>(n / min_chunk, 1);
+    if (chunks <= 1) {
+        fn(begin, end);
+        return;
+    }
+
+    /* Shared with the helpers, which can start after this has returned.
+       They only use fn while a chunk is left, and none are by then. */
+    struct Chunks {
+        const std::function<void(std::size_t, std::size_t)>* fn;
+        std::size_t begin, n, count;
+        std::atomic<std::size_t> next;
+        std::mutex lock;
+        std::condition_variable finished;
+        std::size_t done;               /**< Guarded by lock */
+        std::exception_ptr error;       /**< Guarded by lock */
+    };
+    auto shared = std::make_shared<Chunks>();
+    shared->fn = &fn;
+    shared->begin = begin;
+    shared->n = n;
+    shared->count = chunks;
+    shared->next = 0;
+    shared->done = 0;
+
+    auto run = [](Chunks& c) {
+        std::size_t k;
+        while ((k = c.next++) < c.count) {
+            std::exception_ptr error;
+            try {
+                (*c.fn)(c.begin + c.n * k / c.count,
+                    c.begin + c.n * (k + 1) / c.count);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> guard{c.lock};
+            if (error && !c.error)
+                c.error = error;
+            if (++c.done == c.count)
+                c.finished.notify_all();
+        }
+    };
+
+    std::vector<Thread_pool::Task> helpers;
+    const std::size_t num_helpers = std::min<std::size_t>(pool.size(),
+        chunks - 1);
+    for (std::size_t i=0; i<num_helpers; i++)
+        helpers.push_back([shared, run] {run(*shared);});
+    pool.submit(helpers);
+    run(*shared);
+
+    std::unique_lock<std::mutex> guard{shared->lock};
+    shared->finished.wait(guard,
+        [&shared] {return shared->done == shared->count;});
+    if (shared->error)
+        std::rethrow_exception(shared->error);
+}
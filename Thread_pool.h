@@ -0,0 +1,118 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Thread_pool.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A work stealing thread pool. Each worker has its own queue
+    and takes work from the other queues once its own is empty.
+*/
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Thread_pool {
+public:
+    typedef std::function<void()> Task;
+
+    /**
+     * Constructor, starts the workers.
+     * \param threads The number of workers, 0 for one per hardware thread.
+     */
+    explicit Thread_pool(unsigned threads = 0);
+
+    /**
+     * Stops the workers. Tasks still queued are discarded, tasks already
+     * running are finished first.
+     */
+    ~Thread_pool();
+
+    Thread_pool(const Thread_pool&) = delete;
+    Thread_pool& operator=(const Thread_pool&) = delete;
+
+    /**
+     * Queue a single task.
+     */
+    void submit(Task task);
+
+    /**
+     * Queue tasks in priority order, most important first. Tasks are dealt
+     * out across the workers' queues in turn, and workers always take from
+     * the front of a queue, so the most important tasks start first.
+     */
+    void submit(std::vector<Task>& tasks);
+
+    unsigned size() const {return static_cast<unsigned>(workers.size());}
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; /**< One per worker */
+    std::vector<std::thread> workers;
+
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    std::size_t pending;    /**< Tasks queued, guarded by sleep_lock */
+    bool stopping;          /**< Guarded by sleep_lock */
+    std::atomic<unsigned> next_queue;   /**< Where the next task goes */
+
+    void run(unsigned id);
+
+    /**
+     * Take a task from queue id, or steal one from another queue.
+     * \return false if every queue was empty.
+     */
+    bool take(unsigned id, Task& task);
+
+    void push(Task task);
+};
+
+/**
+ * \return The pool shared by everything that generates maps, with one
+ * worker per hardware thread.
+ */
+Thread_pool& default_pool();
+
+/**
+ * Call fn(chunk_begin, chunk_end) over [begin, end) split into chunks, as
+ * parallel_for() does but on a pool rather than new threads. The calling
+ * thread takes chunks too, so it finishes even if every worker is busy.
+ * Returns once every chunk is done, then rethrows the first exception
+ * thrown by any chunk.
+ * \param min_chunk Chunks are no smaller than this.
+ */
+void pool_for(Thread_pool& pool, std::size_t begin, std::size_t end,
+    const std::function<void(std::size_t, std::size_t)>& fn,
+    std::size_t min_chunk = 1);
+#endif
@@ -0,0 +1,69 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Tile_address.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Addressing of pixels relative to the square tiles a map is
+    divided into.
+*/
+#ifndef TILE_ADDRESS_H
+#define TILE_ADDRESS_H
+
+#include <cstddef>
+
+constexpr int tile_shift = 6;
+constexpr int tile_size = 1 << tile_shift;  /**< Side of a tile in pixels */
+constexpr int tile_mask = tile_size - 1;
+constexpr std::size_t tile_area =
+    static_cast<std::size_t>(tile_size) * tile_size;
+
+/**
+ * A pixel given as a tile and a location within that tile
+ */
+struct Tile_address {
+    int tx;     /**< Column of the tile */
+    int ty;     /**< Row of the tile */
+    int lx;     /**< Column within the tile in [0, tile_size) */
+    int ly;     /**< Row within the tile in [0, tile_size) */
+};
+
+/**
+ * \param x The column of a pixel in the map, >= 0.
+ * \param y The row of a pixel in the map, >= 0.
+ * \return The tile containing (x, y) and the location of (x, y) within it.
+ */
+inline Tile_address tile_address(int x, int y)
+{
+    return Tile_address{x >> tile_shift, y >> tile_shift,
+        x & tile_mask, y & tile_mask};
+}
+
+/**
+ * \return The offset of a pixel within its tile, row major.
+ */
+inline std::size_t tile_offset(const Tile_address& a)
+{
+    return (static_cast<std::size_t>(a.ly) << tile_shift) + a.lx;
+}
+#endif
@@ -0,0 +1,76 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Tile_buffer_pool.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Pool of tile buffers, see Tile_buffer_pool.h
+*/
+#include "Tile_buffer_pool.h"
+#include <algorithm>
+
+Tile_buffer_pool::Tile_buffer_pool(std::size_t capacity)
+    :max_out{std::max<std::size_t>(capacity, 1)}, out{0}
+{
+}
+
+Tile_batch Tile_buffer_pool::borrow(std::size_t n, HEIGHT_FORMAT f)
+{
+    n = std::min(n, max_out);
+    Tile_batch b;
+    {
+        std::unique_lock<std::mutex> guard{lock};
+        freed.wait(guard, [this, n] {return out + n <= max_out;});
+        out += n;
+        while (b.size() < n && !idle.empty()) {
+            b.push_back(std::move(idle.back()));
+            idle.pop_back();
+        }
+    }
+
+    /* Allocating and converting happen outside the lock */
+    for (auto& t : b)
+        if (t->heights.format() != f)
+            t->heights.set_format(f);
+    while (b.size() < n)
+        b.emplace_back(new Tile_data{f});
+    return b;
+}
+
+void Tile_buffer_pool::give_back(Tile_batch& b)
+{
+    {
+        std::lock_guard<std::mutex> guard{lock};
+        out -= b.size();
+        for (auto& t : b)
+            idle.push_back(std::move(t));
+    }
+    b.clear();
+    freed.notify_all();
+}
+
+std::size_t Tile_buffer_pool::allocated()
+{
+    std::lock_guard<std::mutex> guard{lock};
+    return idle.size() + out;
+}
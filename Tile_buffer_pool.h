@@ -0,0 +1,86 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Tile_buffer_pool.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A bounded pool of tile buffers shared by exports running
+    at the same time, so generating many maps reuses the same memory
+    rather than allocating buffers for each map.
+*/
+#ifndef TILE_BUFFER_POOL_H
+#define TILE_BUFFER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Tile_data.h"
+
+/**
+ * A batch of reusable tile buffers
+ */
+typedef std::vector<std::unique_ptr<Tile_data>> Tile_batch;
+
+class Tile_buffer_pool {
+public:
+    /**
+     * Constructor, buffers are only allocated once first borrowed.
+     * \param capacity The most buffers that can be lent out at once.
+     */
+    explicit Tile_buffer_pool(std::size_t capacity);
+
+    Tile_buffer_pool(const Tile_buffer_pool&) = delete;
+    Tile_buffer_pool& operator=(const Tile_buffer_pool&) = delete;
+
+    /**
+     * Borrow buffers, waiting until enough are free. All n are taken at
+     * once, so borrowers holding one batch each can't deadlock.
+     * \param n The number of buffers, more than the capacity gets the
+     * capacity.
+     * \param f The height format the buffers need, buffers last used with
+     * another format are converted.
+     */
+    Tile_batch borrow(std::size_t n, HEIGHT_FORMAT f);
+
+    /**
+     * Return buffers from borrow(), b is left empty.
+     */
+    void give_back(Tile_batch& b);
+
+    std::size_t capacity() const {return max_out;}
+
+    /**
+     * \return The number of buffers allocated so far.
+     */
+    std::size_t allocated();
+
+private:
+    std::mutex lock;
+    std::condition_variable freed;
+    Tile_batch idle;            /**< Allocated buffers not lent out */
+    std::size_t max_out;
+    std::size_t out;            /**< Buffers lent out */
+};
+#endif
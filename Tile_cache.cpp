@@ -0,0 +1,131 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Tile_cache.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A cache of generated tiles in memory, see Tile_cache.h
+*/
+#include "Tile_cache.h"
+
+Tile_cache::Tile_cache(std::uint64_t b, Tile_disk_cache* d)
+    :budget{b}, disk{d}, counters{0, 0, 0, 0, 0, 0}
+{
+}
+
+std::shared_ptr<const Tile_data> Tile_cache::get(const Noise_settings& s,
+    HEIGHT_FORMAT f, Tile_id t, const Generation_job* owner)
+{
+    const Key k{tile_key(s, f), t.tx, t.ty};
+    {
+        std::lock_guard<std::mutex> guard{lock};
+        auto it = entries.find(k);
+        if (it != entries.end()) {
+            counters.hits++;
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->tile;
+        }
+        counters.misses++;
+    }
+
+    /* Read or generate without holding the lock so other tiles can be
+       served meanwhile */
+    std::shared_ptr<Tile_data> tile = std::make_shared<Tile_data>(f);
+    bool from_disk = disk != NULL && disk->load(k.settings, t, *tile);
+    if (!from_disk) {
+        if (!generate_tile(s, t, *tile, owner))
+            return NULL;
+        if (disk != NULL)
+            disk->store(k.settings, *tile);
+    }
+
+    std::lock_guard<std::mutex> guard{lock};
+    if (from_disk)
+        counters.disk_hits++;
+    auto it = entries.find(k);
+    if (it != entries.end()) {
+        /* Another thread got there first, keep its copy */
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->tile;
+    }
+    insert(k, tile);
+    return tile;
+}
+
+std::shared_ptr<const Tile_data> Tile_cache::find(std::uint64_t key,
+    Tile_id t)
+{
+    std::lock_guard<std::mutex> guard{lock};
+    auto it = entries.find(Key{key, t.tx, t.ty});
+    if (it == entries.end())
+        return NULL;
+    return it->second->tile;
+}
+
+double Tile_cache::height_at(const Noise_settings& s, HEIGHT_FORMAT f,
+    int x, int y)
+{
+    Tile_address a = tile_address(x, y);
+    std::shared_ptr<const Tile_data> tile = get(s, f, Tile_id{a.tx, a.ty});
+    return tile->heights.get(tile_offset(a));
+}
+
+BIOME Tile_cache::biome_at(const Noise_settings& s, HEIGHT_FORMAT f,
+    int x, int y)
+{
+    Tile_address a = tile_address(x, y);
+    std::shared_ptr<const Tile_data> tile = get(s, f, Tile_id{a.tx, a.ty});
+    return static_cast<BIOME>(tile->biomes[tile_offset(a)]);
+}
+
+Tile_cache::Stats Tile_cache::stats()
+{
+    std::lock_guard<std::mutex> guard{lock};
+    Stats s = counters;
+    s.tiles = lru.size();
+    return s;
+}
+
+void Tile_cache::clear()
+{
+    std::lock_guard<std::mutex> guard{lock};
+    lru.clear();
+    entries.clear();
+    counters.bytes = 0;
+}
+
+void Tile_cache::insert(const Key& k, std::shared_ptr<const Tile_data> tile)
+{
+    counters.bytes += tile->bytes();
+    lru.push_front(Entry{k, tile});
+    entries[k] = lru.begin();
+
+    /* Always keep the tile just added, even if it alone is over budget */
+    while (counters.bytes > budget && lru.size() > 1) {
+        const Entry& oldest = lru.back();
+        counters.bytes -= oldest.tile->bytes();
+        counters.evictions++;
+        entries.erase(oldest.key);
+        lru.pop_back();
+    }
+}
@@ -0,0 +1,149 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Tile_cache.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A cache of generated tiles in memory, in front of the
+    disk cache and the noise. The least recently used tiles are dropped
+    once the cache grows past its byte budget, so memory stays flat however
+    much of a world is explored.
+*/
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "Biome.h"
+#include "Tile_data.h"
+#include "Tile_disk_cache.h"
+
+class Tile_cache {
+public:
+    /**
+     * Counters of how the cache has been used
+     */
+    struct Stats {
+        std::uint64_t hits;         /**< Tiles found in memory */
+        std::uint64_t misses;       /**< Tiles not found in memory */
+        std::uint64_t disk_hits;    /**< Misses read from the disk cache */
+        std::uint64_t evictions;    /**< Tiles dropped to stay in budget */
+        std::uint64_t bytes;        /**< Bytes of tiles held now */
+        std::uint64_t tiles;        /**< Tiles held now */
+    };
+
+    /**
+     * Constructor
+     * \param budget The most bytes of tiles to hold.
+     * \param disk Cache to check on a miss and to write new tiles to, or
+     * NULL. Not owned.
+     */
+    Tile_cache(std::uint64_t budget, Tile_disk_cache* disk = NULL);
+
+    Tile_cache(const Tile_cache&) = delete;
+    Tile_cache& operator=(const Tile_cache&) = delete;
+
+    /**
+     * Get a tile, generating it if it is in neither cache. Safe to call
+     * from several threads, two threads missing the same tile at once may
+     * both generate it.
+     * \param s The noise to generate from.
+     * \param f The height format of the tile.
+     * \param t The tile wanted.
+     * \param owner If not NULL generation stops when it is cancelled.
+     * \return The tile, or NULL if owner was cancelled.
+     */
+    std::shared_ptr<const Tile_data> get(const Noise_settings& s,
+        HEIGHT_FORMAT f, Tile_id t, const Generation_job* owner = NULL);
+
+    /**
+     * \return The tile if it is held in memory, NULL otherwise. Does not
+     * count as a hit or miss.
+     */
+    std::shared_ptr<const Tile_data> find(std::uint64_t key, Tile_id t);
+
+    /**
+     * \return The height at any pixel of the world, in [0, 1].
+     */
+    double height_at(const Noise_settings& s, HEIGHT_FORMAT f, int x, int y);
+
+    /**
+     * \return The biome at any pixel of the world.
+     */
+    BIOME biome_at(const Noise_settings& s, HEIGHT_FORMAT f, int x, int y);
+
+    Stats stats();
+
+    /**
+     * Drop every tile held in memory, counters are kept.
+     */
+    void clear();
+
+    std::uint64_t capacity() const {return budget;}
+
+private:
+    struct Key {
+        std::uint64_t settings;
+        int tx;
+        int ty;
+
+        bool operator==(const Key& o) const
+        {
+            return settings == o.settings && tx == o.tx && ty == o.ty;
+        }
+    };
+
+    struct Key_hash {
+        std::size_t operator()(const Key& k) const
+        {
+            std::uint64_t h = k.settings;
+            h ^= (static_cast<std::uint64_t>(static_cast<std::uint32_t>(k.tx))
+                << 32) | static_cast<std::uint32_t>(k.ty);
+            h *= 0x9e3779b97f4a7c15ULL;
+            return static_cast<std::size_t>(h ^ (h >> 29));
+        }
+    };
+
+    struct Entry {
+        Key key;
+        std::shared_ptr<const Tile_data> tile;
+    };
+
+    const std::uint64_t budget;
+    Tile_disk_cache* disk;
+
+    std::mutex lock;
+    std::list<Entry> lru;   /**< Most recently used first */
+    std::unordered_map<Key, std::list<Entry>::iterator, Key_hash> entries;
+    Stats counters;
+
+    /**
+     * Add a tile as the most recently used and evict down to the budget.
+     * Caller holds lock.
+     */
+    void insert(const Key& k, std::shared_ptr<const Tile_data> tile);
+};
+#endif
@@ -0,0 +1,263 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Tile_data.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: Generation of single tiles, see Tile_data.h
+*/
+#include "Tile_data.h"
+#include "Adaptive_sampling.h"
+#include "Heightfield.h"
+#include "Noise_graph.h"
+#include "Noise_kernels.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+/**
+ * Fold bytes into an FNV-1a hash
+ */
+static void hash_bytes(std::uint64_t& h, const void* p, std::size_t n)
+{
+    const unsigned char* b = static_cast<const unsigned char*>(p);
+    for (std::size_t i=0; i<n; i++) {
+        h ^= b[i];
+        h *= 0x100000001b3ULL;
+    }
+}
+
+template<typename T>
+static void hash_value(std::uint64_t& h, T v)
+{
+    hash_bytes(h, &v, sizeof(v));
+}
+
+std::uint64_t tile_key(const Noise_settings& s, HEIGHT_FORMAT f)
+{
+    std::uint64_t h = 0xcbf29ce484222325ULL;
+    hash_value(h, tile_engine_version);
+    hash_value(h, static_cast<std::int32_t>(s.seed));
+    hash_value(h, s.frequency);
+    hash_value(h, static_cast<std::int32_t>(s.octaves));
+    hash_value(h, s.persistence);
+    hash_value(h, s.lacunarity);
+    hash_value(h, static_cast<std::int32_t>(s.quality));
+    hash_value(h, static_cast<std::int32_t>(f));
+    for (int i=0; i<num_biome_thresholds; i++)
+        hash_value(h, biome_thresholds[i]);
+    if (s.graph)
+        hash_value(h, s.graph->hash());
+    /* Only hashed when not libnoise, so existing caches stay valid */
+    if (s.engine != NOISE_ENGINE::libnoise)
+        hash_value(h, static_cast<std::int32_t>(s.engine));
+    /* A whole map engine makes a different field for each size of map */
+    if (whole_map_engine(s.engine) && s.field) {
+        hash_value(h, static_cast<std::int32_t>(s.field->width));
+        hash_value(h, static_cast<std::int32_t>(s.field->height));
+    }
+    if (adaptive_spacing(s) > 0) {
+        hash_value(h, adaptive_sampling_version);
+        hash_value(h, s.adaptive_tolerance);
+    }
+    return h;
+}
+
+/**
+ * \return The octaves of s, scaled to heights of noise/2 + 0.5.
+ */
+static Octave_settings height_octaves(const Noise_settings& s)
+{
+    Octave_settings o;
+    o.seed = s.seed;
+    o.octaves = s.octaves;
+    o.persistence = s.persistence;
+    o.lacunarity = s.lacunarity;
+    o.scale = 0.5;
+    o.bias = 0.5;
+    return o;
+}
+
+/**
+ * \return A sampler giving the exact heights of the engine of s at any
+ * points, s must not have a graph or a whole map engine.
+ */
+static Height_sampler point_sampler(const Noise_settings& s)
+{
+    const double f = s.frequency;
+    if (s.engine == NOISE_ENGINE::gradient
+        || s.engine == NOISE_ENGINE::simplex) {
+        const Noise_run_kernel kernel = (s.engine == NOISE_ENGINE::simplex ?
+            simplex_kernel()
+            : fbm_kernel(static_cast<NOISE_QUALITY>(s.quality)));
+        const Octave_settings o = height_octaves(s);
+        return [kernel, o, f](const double* x, const double* y,
+            std::size_t n, double* out) {
+            std::vector<double> ys(n);
+            for (std::size_t i=0; i<n; i++) {
+                out[i] = f * x[i];
+                ys[i] = f * y[i];
+            }
+            kernel(out, ys.data(), 0.5, n, o, out);
+        };
+    }
+    if (s.engine == NOISE_ENGINE::gradient_f32) {
+        const Noise_row_kernel_f32 kernel = fbm_row_kernel_f32(
+            static_cast<NOISE_QUALITY>(s.quality));
+        const Octave_settings o = height_octaves(s);
+        return [kernel, o, f](const double* x, const double* y,
+            std::size_t n, double* out) {
+            for (std::size_t i=0; i<n; i++) {
+                float v;
+                kernel(f * x[i], f * y[i], f, 0.5, 1, o, &v);
+                out[i] = v;
+            }
+        };
+    }
+    /* Shared as libnoise modules can't be copied */
+    std::shared_ptr<Perlin_noise_generator> generator{
+        new Perlin_noise_generator{s}};
+    return [generator, f](const double* x, const double* y, std::size_t n,
+        double* out) {
+        for (std::size_t i=0; i<n; i++)
+            out[i] = generator->get_num(f * x[i], f * y[i]);
+    };
+}
+
+bool generate_tile(const Noise_settings& s, Tile_id t, Tile_data& out,
+    const Generation_job* owner)
+{
+    const int x0 = t.tx * tile_size;
+    const int y0 = t.ty * tile_size;
+
+    out.id = t;
+    if (s.graph) {
+        std::vector<double> values(tile_area);
+        if (!s.graph->evaluate(x0, y0, s.frequency, s.seed, 0.5,
+            values.data(), owner))
+            return false;
+        for (std::size_t i=0; i<tile_area; i++) {
+            out.heights.set(i, values[i] / 2.0 + 0.5);
+            out.biomes[i] = static_cast<std::uint8_t>(out.heights.biome(i));
+        }
+        return true;
+    }
+
+    if (whole_map_engine(s.engine)) {
+        if (!s.field)
+            throw std::runtime_error("No heightfield to cut tiles from");
+        const Heightfield& field = *s.field;
+        for (int ly=0; ly<tile_size; ly++) {
+            /* Pixels past the edge of the map repeat the edge */
+            const int y = std::min(std::max(y0 + ly, 0), field.height - 1);
+            std::size_t i = static_cast<std::size_t>(ly) * tile_size;
+            for (int lx=0; lx<tile_size; lx++, i++) {
+                const int x = std::min(std::max(x0 + lx, 0), field.width - 1);
+                out.heights.set(i, field.at(x, y));
+                out.biomes[i] = static_cast<std::uint8_t>(
+                    out.heights.biome(i));
+            }
+        }
+        return true;
+    }
+
+    const int spacing = adaptive_spacing(s);
+    if (spacing > 0) {
+        if (owner != NULL && owner->cancelled())
+            return false;
+
+        std::vector<double> values(tile_area);
+        sample_adaptive(point_sampler(s), x0, y0, spacing,
+            s.adaptive_tolerance, values.data());
+        for (std::size_t i=0; i<tile_area; i++) {
+            out.heights.set(i, values[i]);
+            out.biomes[i] = static_cast<std::uint8_t>(out.heights.biome(i));
+        }
+        return true;
+    }
+
+    if (s.engine == NOISE_ENGINE::gradient
+        || s.engine == NOISE_ENGINE::simplex) {
+        /* noise::NoiseQuality and NOISE_QUALITY are in the same order */
+        const Noise_run_kernel kernel = (s.engine == NOISE_ENGINE::simplex ?
+            simplex_kernel()
+            : fbm_kernel(static_cast<NOISE_QUALITY>(s.quality)));
+        const Octave_settings o = height_octaves(s);
+
+        double xs[tile_size], ys[tile_size], values[tile_size];
+        for (int lx=0; lx<tile_size; lx++)
+            xs[lx] = s.frequency * (x0 + lx);
+        for (int ly=0; ly<tile_size; ly++) {
+            if (owner != NULL && owner->cancelled())
+                return false;
+
+            std::fill(ys, ys + tile_size, s.frequency * (y0 + ly));
+            kernel(xs, ys, 0.5, tile_size, o, values);
+            std::size_t i = static_cast<std::size_t>(ly) * tile_size;
+            for (int lx=0; lx<tile_size; lx++, i++) {
+                out.heights.set(i, values[lx]);
+                out.biomes[i] = static_cast<std::uint8_t>(
+                    out.heights.biome(i));
+            }
+        }
+        return true;
+    }
+
+    if (s.engine == NOISE_ENGINE::gradient_f32) {
+        const Noise_row_kernel_f32 kernel = fbm_row_kernel_f32(
+            static_cast<NOISE_QUALITY>(s.quality));
+        const Octave_settings o = height_octaves(s);
+
+        float values[tile_size];
+        for (int ly=0; ly<tile_size; ly++) {
+            if (owner != NULL && owner->cancelled())
+                return false;
+
+            kernel(s.frequency * x0, s.frequency * (y0 + ly), s.frequency,
+                0.5, tile_size, o, values);
+            std::size_t i = static_cast<std::size_t>(ly) * tile_size;
+            for (int lx=0; lx<tile_size; lx++, i++) {
+                out.heights.set(i, values[lx]);
+                out.biomes[i] = static_cast<std::uint8_t>(
+                    out.heights.biome(i));
+            }
+        }
+        return true;
+    }
+
+    Perlin_noise_generator generator{s};
+    for (int ly=0; ly<tile_size; ly++) {
+        if (owner != NULL && owner->cancelled())
+            return false;
+
+        const double y = s.frequency * (y0 + ly);
+        std::size_t i = static_cast<std::size_t>(ly) * tile_size;
+        for (int lx=0; lx<tile_size; lx++, i++) {
+            /* Classify the stored height so the biome matches what is kept
+               at the precision of the height layer */
+            out.heights.set(i, generator.get_num(s.frequency * (x0 + lx), y));
+            out.biomes[i] = static_cast<std::uint8_t>(out.heights.biome(i));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Tile_data.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: The generated layers of one 64x64 tile of a map. Noise is
+    evaluated in global pixel coordinates, so a tile only depends on its
+    position and the generation settings, not on the size of the map it
+    ends up in.
+*/
+#ifndef TILE_DATA_H
+#define TILE_DATA_H
+
+#include <cstdint>
+#include <vector>
+#include "Biome.h"
+#include "Height_layer.h"
+#include "Tile_address.h"
+#include "Generation_job.h"
+#include "Perlin_noise_generator.h"
+
+/**
+ * Bump this whenever a change makes generate_tile() give different
+ * output, so tiles cached by older versions are never used.
+ */
+constexpr std::uint32_t tile_engine_version = 1;
+
+struct Tile_data {
+    Tile_id id;                 /**< Which tile this is */
+    Height_layer heights;       /**< tile_area heights, row major */
+    std::vector<std::uint8_t> biomes;   /**< tile_area BIOMEs, row major */
+
+    Tile_data(HEIGHT_FORMAT f = HEIGHT_FORMAT::float64)
+        :id{0, 0}, heights{tile_area, f}, biomes(tile_area, 0)
+    {
+    }
+
+    /**
+     * \return The number of bytes held by the tile.
+     */
+    std::size_t bytes() const {return heights.bytes() + biomes.size();}
+};
+
+/**
+ * \return A hash of every setting that changes what generate_tile()
+ * produces, including the thresholds in Biome.h and tile_engine_version.
+ */
+std::uint64_t tile_key(const Noise_settings& s, HEIGHT_FORMAT f);
+
+/**
+ * Generate the heights and biomes of a tile.
+ * \param s The noise to generate from.
+ * \param t The tile to generate.
+ * \param out Where to put the tile, its height format is kept.
+ * \param owner If not NULL the job is checked between rows.
+ * \return false if owner was cancelled before the tile was finished.
+ */
+bool generate_tile(const Noise_settings& s, Tile_id t, Tile_data& out,
+    const Generation_job* owner = NULL);
+#endif
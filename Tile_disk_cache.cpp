@@ -0,0 +1,277 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Tile_disk_cache.cpp
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A cache of generated tiles on disk, see Tile_disk_cache.h
+*/
+#include "Tile_disk_cache.h"
+#include "File_util.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+constexpr char tile_magic[4] = {'B', 'M', 'G', 'T'};
+constexpr char index_name[] = "index.txt";
+constexpr unsigned stores_per_save = 64;
+
+/**
+ * Fixed size header at the start of every tile file, stored in host byte
+ * order.
+ */
+struct Tile_header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t key;
+    std::int32_t tx;
+    std::int32_t ty;
+    std::uint32_t format;
+    std::uint32_t height_bytes;
+    std::uint32_t biome_bytes;
+    std::uint32_t checksum;     /**< FNV-1a of the heights and biomes */
+};
+
+std::uint32_t checksum(const void* a, std::size_t a_n, const void* b,
+    std::size_t b_n)
+{
+    std::uint32_t h = 2166136261u;
+    const unsigned char* p = static_cast<const unsigned char*>(a);
+    for (std::size_t i=0; i<a_n; i++)
+        h = (h ^ p[i]) * 16777619u;
+    p = static_cast<const unsigned char*>(b);
+    for (std::size_t i=0; i<b_n; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+void make_directory(const std::string& dir)
+{
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+}
+
+}
+
+Tile_disk_cache::Tile_disk_cache(const std::string& dir, std::uint64_t b)
+    :directory{dir}, budget{b}, used{0}, stores_since_save{0}
+{
+    make_directory(directory);
+
+    /* Each line is a file name and its size, most recently used first */
+    std::ifstream index{path(index_name)};
+    std::string name;
+    std::uint64_t bytes;
+    while (index >> name >> bytes) {
+        if (entries.count(name) == 0) {
+            lru.push_back(Entry{name, bytes});
+            entries[name] = std::prev(lru.end());
+            used += bytes;
+        }
+    }
+    evict();
+}
+
+Tile_disk_cache::~Tile_disk_cache()
+{
+    save_index();
+}
+
+std::string Tile_disk_cache::file_name(std::uint64_t key, Tile_id t) const
+{
+    std::ostringstream name;
+    name << std::hex << key << std::dec << '_' << t.tx << '_' << t.ty
+        << ".tile";
+    return name.str();
+}
+
+std::string Tile_disk_cache::path(const std::string& name) const
+{
+    return directory + "/" + name;
+}
+
+bool Tile_disk_cache::load(std::uint64_t key, Tile_id t, Tile_data& out)
+{
+    const std::string name = file_name(key, t);
+    {
+        std::lock_guard<std::mutex> guard{lock};
+        if (entries.count(name) == 0)
+            return false;
+    }
+
+    FILE* f = std::fopen(path(name).c_str(), "rb");
+    if (f == NULL)
+        return false;
+
+    Tile_header header;
+    const std::size_t height_bytes = out.heights.bytes();
+    bool ok = std::fread(&header, sizeof(header), 1, f) == 1
+        && std::equal(tile_magic, tile_magic + 4, header.magic)
+        && header.version == tile_engine_version
+        && header.key == key && header.tx == t.tx && header.ty == t.ty
+        && header.format == static_cast<std::uint32_t>(out.heights.format())
+        && header.height_bytes == height_bytes
+        && header.biome_bytes == out.biomes.size()
+        && std::fread(out.heights.raw(), 1, height_bytes, f) == height_bytes
+        && std::fread(out.biomes.data(), 1, out.biomes.size(), f)
+            == out.biomes.size()
+        && header.checksum == checksum(out.heights.raw(), height_bytes,
+            out.biomes.data(), out.biomes.size());
+    std::fclose(f);
+
+    std::lock_guard<std::mutex> guard{lock};
+    auto it = entries.find(name);
+    if (!ok) {
+        /* Damaged or from another version, forget it */
+        if (it != entries.end()) {
+            used -= it->second->bytes;
+            lru.erase(it->second);
+            entries.erase(it);
+        }
+        std::remove(path(name).c_str());
+        return false;
+    }
+
+    out.id = t;
+    if (it != entries.end())
+        lru.splice(lru.begin(), lru, it->second);
+    return true;
+}
+
+void Tile_disk_cache::store(std::uint64_t key, const Tile_data& tile)
+{
+    const std::string name = file_name(key, tile.id);
+    const std::string final_path = path(name);
+    const std::string temp_path = final_path + ".tmp";
+
+    Tile_header header;
+    std::copy(tile_magic, tile_magic + 4, header.magic);
+    header.version = tile_engine_version;
+    header.key = key;
+    header.tx = tile.id.tx;
+    header.ty = tile.id.ty;
+    header.format = static_cast<std::uint32_t>(tile.heights.format());
+    header.height_bytes = static_cast<std::uint32_t>(tile.heights.bytes());
+    header.biome_bytes = static_cast<std::uint32_t>(tile.biomes.size());
+    header.checksum = checksum(tile.heights.raw(), tile.heights.bytes(),
+        tile.biomes.data(), tile.biomes.size());
+
+    /* Write to a temporary file first so a reader never sees half a tile */
+    FILE* f = std::fopen(temp_path.c_str(), "wb");
+    if (f == NULL)
+        return;
+    bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1
+        && std::fwrite(tile.heights.raw(), 1, tile.heights.bytes(), f)
+            == tile.heights.bytes()
+        && std::fwrite(tile.biomes.data(), 1, tile.biomes.size(), f)
+            == tile.biomes.size();
+    ok = (std::fclose(f) == 0) && ok;
+
+    /* Replaced in one step, so the tile is never missing */
+    if (!ok || !replace_file(temp_path, final_path)) {
+        std::remove(temp_path.c_str());
+        return;
+    }
+
+    bool save = false;
+    {
+        std::lock_guard<std::mutex> guard{lock};
+        touch(name, sizeof(header) + tile.bytes());
+        evict();
+        if (++stores_since_save >= stores_per_save) {
+            stores_since_save = 0;
+            save = true;
+        }
+    }
+    if (save)
+        save_index();
+}
+
+bool Tile_disk_cache::save_index()
+{
+    /* One save at a time, they share the temporary file */
+    std::lock_guard<std::mutex> saving{save_lock};
+    std::vector<Entry> snapshot;
+    {
+        std::lock_guard<std::mutex> guard{lock};
+        snapshot.assign(lru.begin(), lru.end());
+        stores_since_save = 0;
+    }
+
+    const std::string temp_path = path(index_name) + ".tmp";
+    bool ok;
+    {
+        std::ofstream index{temp_path, std::ofstream::out|std::ofstream::trunc};
+        for (const Entry& e : snapshot)
+            index << e.name << ' ' << e.bytes << '\n';
+        index.close();
+        ok = !index.fail();
+    }
+    if (!ok || !replace_file(temp_path, path(index_name))) {
+        std::remove(temp_path.c_str());
+        LOG("Failed to write tile cache index in " + directory);
+        return false;
+    }
+    return true;
+}
+
+void Tile_disk_cache::touch(const std::string& name, std::uint64_t bytes)
+{
+    auto it = entries.find(name);
+    if (it != entries.end()) {
+        used -= it->second->bytes;
+        it->second->bytes = bytes;
+        lru.splice(lru.begin(), lru, it->second);
+    }
+    else {
+        lru.push_front(Entry{name, bytes});
+        entries[name] = lru.begin();
+    }
+    used += bytes;
+}
+
+void Tile_disk_cache::evict()
+{
+    while (used > budget && !lru.empty()) {
+        const Entry& oldest = lru.back();
+        std::remove(path(oldest.name).c_str());
+        used -= oldest.bytes;
+        entries.erase(oldest.name);
+        lru.pop_back();
+    }
+}
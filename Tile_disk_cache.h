@@ -0,0 +1,118 @@
+/*
+COPYRIGHT (c) 2016 Callum Wilson
+
+MIT License
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+    File: Tile_disk_cache.h
+    Author: Callum Wilson, callum.w@outlook.com
+    Description: A cache of generated tiles on disk. Tiles are keyed by a
+    hash of the settings they were generated with (see tile_key()) and
+    their position. The least recently used tiles are deleted once the
+    cache grows past its size budget.
+*/
+#ifndef TILE_DISK_CACHE_H
+#define TILE_DISK_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Tile_data.h"
+
+class Tile_disk_cache {
+public:
+    /**
+     * Constructor, creates the directory if needed and reads its index.
+     * \param dir The directory to keep tiles in.
+     * \param budget The most bytes of tiles to keep on disk.
+     */
+    Tile_disk_cache(const std::string& dir, std::uint64_t budget);
+
+    /**
+     * Writes the index so usage order survives a restart.
+     */
+    ~Tile_disk_cache();
+
+    Tile_disk_cache(const Tile_disk_cache&) = delete;
+    Tile_disk_cache& operator=(const Tile_disk_cache&) = delete;
+
+    /**
+     * Read a tile. Safe to call from several threads.
+     * \param key The tile_key() of the settings wanted.
+     * \param t The tile wanted.
+     * \param out Filled with the tile, must have the height format the key
+     * was made with.
+     * \return false if the tile is not cached or its file is damaged.
+     */
+    bool load(std::uint64_t key, Tile_id t, Tile_data& out);
+
+    /**
+     * Write a tile, evicting old tiles if the budget is exceeded. Safe to
+     * call from several threads. A tile that can not be written is left
+     * out of the cache, this never throws.
+     */
+    void store(std::uint64_t key, const Tile_data& tile);
+
+    /**
+     * Write the index file now, replacing the old one only once the new
+     * one is complete. Safe to call from several threads, saves are made
+     * one at a time.
+     * \return false if it could not be written, which is logged.
+     */
+    bool save_index();
+
+    std::uint64_t size() const {return used;}
+    std::uint64_t capacity() const {return budget;}
+
+private:
+    struct Entry {
+        std::string name;
+        std::uint64_t bytes;
+    };
+
+    const std::string directory;
+    const std::uint64_t budget;
+
+    std::mutex lock;
+    std::mutex save_lock;   /**< Held while the index file is written */
+    std::list<Entry> lru;   /**< Most recently used first */
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+    std::uint64_t used;     /**< Bytes of every tile in lru */
+    unsigned stores_since_save;
+
+    std::string file_name(std::uint64_t key, Tile_id t) const;
+    std::string path(const std::string& name) const;
+
+    /**
+     * Move an entry to the front of lru, adding it if needed. Caller holds
+     * lock.
+     */
+    void touch(const std::string& name, std::uint64_t bytes);
+
+    /**
+     * Delete tiles from the back of lru until used is within budget.
+     * Caller holds lock.
+     */
+    void evict();
+};
+#endif
@@ -27,6 +27,9 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <libnoise/module/perlin.h>
 
 #include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
 #include <stdio.h>
 #include <stdexcept>
 #include <cstdint>
@@ -34,10 +37,23 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <vector>
 #include <chrono>
 #include <random>
-
+#include <algorithm>
+#include <thread>
+#include <memory>
+
+#include "Adaptive_sampling.h"
+#include "Animated_noise.h"
+#include "Batch_export.h"
+#include "Flythrough.h"
 #include "Logger.h"
+#include "Noise_graph.h"
+#include "Progress.h"
 #include "EasyBMP.h"
 #include "Pixel_map.h"
+#include "Frame_timer.h"
+#include "Stream_export.h"
+#include "Seed_search.h"
+#include "Shard_queue.h"
 
 /** Screen Variables **/
 constexpr bool fullscreen = false;
@@ -45,6 +61,13 @@ constexpr int screen_width = 512;
 constexpr int screen_height = 512;
 constexpr int map_width = 2000;
 constexpr int map_height = 2000;
+constexpr char frame_report_file[] = "frame_times.txt";
+constexpr double perlin_frequency = 0.004;
+constexpr double animation_speed = 0.1;     /**< Noise z a second */
+constexpr char region_file[] = "Map.region";
+constexpr char tile_cache_dir[] = "tile_cache";
+constexpr std::uint64_t tile_cache_budget = 512ULL << 20;
+constexpr std::uint64_t tile_memory_budget = 128ULL << 20;
 
 SDL_Rect screen_rect{0, 0, screen_width, screen_height};
 Pixel_map* map;
@@ -57,6 +80,16 @@ bool perlin = false;
 bool perlin_color = false;
 bool perlin_map = true;
 bool screen_changed = true;
+bool show_overlay = false;
+bool recolor = false;
+bool rerender = false;
+bool write_file = false;
+bool write_region = false;
+bool read_region = false;
+bool next_height_format = false;
+bool toggle_layout = false;
+bool dump_frame_times = false;
+bool animate = false;
 
 int prev_mouse_x;
 int prev_mouse_y;
@@ -108,6 +141,20 @@ void clear(SDL_Renderer* r)
     SDL_RenderClear(r);
 }
 
+/*
+Draw how much of a fill is done as a bar along the top of area
+*/
+void draw_progress_bar(SDL_Renderer* r, const Progress_report& p,
+    const SDL_Rect& area)
+{
+    SDL_Rect bar{area.x, area.y - 4, area.w, 4};
+    SDL_SetRenderDrawColor(r, 40, 40, 40, 255);
+    SDL_RenderFillRect(r, &bar);
+    bar.w = static_cast<int>(area.w * p.fraction());
+    SDL_SetRenderDrawColor(r, 0, 200, 255, 255);
+    SDL_RenderFillRect(r, &bar);
+}
+
 /*
 Handle input from the user
 */
@@ -130,8 +177,81 @@ void handle_input()
             else if (e.key.keysym.sym == SDLK_m) {
                 perlin_map = true;
             }
-			else if (e.key.keysym.sym == SDLK_n) {
-				perlin = true;
+            else if (e.key.keysym.sym == SDLK_n) {
+                perlin = true;
+            }
+            else if (e.key.keysym.sym == SDLK_o) {
+                show_overlay = !show_overlay;
+            }
+            else if (e.key.keysym.sym == SDLK_t) {
+                dump_frame_times = true;
+            }
+            else if (e.key.keysym.sym == SDLK_i) {
+                map->set_render_mode(
+                    map->get_render_mode() == RENDER_MODE::indexed ?
+                    RENDER_MODE::per_pixel : RENDER_MODE::indexed);
+                rerender = true;
+            }
+            else if (e.key.keysym.sym == SDLK_c) {
+                recolor = true;
+            }
+            else if (e.key.keysym.sym == SDLK_w) {
+                write_file = true;
+            }
+            else if (e.key.keysym.sym == SDLK_e) {
+                write_region = true;
+            }
+            else if (e.key.keysym.sym == SDLK_p) {
+                read_region = true;
+            }
+            else if (e.key.keysym.sym == SDLK_h) {
+                next_height_format = true;
+            }
+            else if (e.key.keysym.sym == SDLK_l) {
+                toggle_layout = true;
+            }
+            else if (e.key.keysym.sym == SDLK_f) {
+                Noise_settings s = map->get_noise_settings();
+                if (s.graph)
+                    s.graph.reset();
+                else
+                    s.graph = std::make_shared<const Noise_kernel>(
+                        Noise_graph::terrain());
+                map->set_noise_settings(s);
+                LOG(s.graph ? "Noise: terrain graph" : "Noise: perlin");
+                perlin_map = true;
+            }
+            else if (e.key.keysym.sym == SDLK_k) {
+                Noise_settings s = map->get_noise_settings();
+                s.engine = static_cast<NOISE_ENGINE>(
+                    (static_cast<int>(s.engine) + 1) % num_noise_engines);
+                map->set_noise_settings(s);
+                LOG(std::string{"Noise engine: "} + noise_engine_name(s.engine));
+                perlin_map = true;
+            }
+            else if (e.key.keysym.sym == SDLK_a) {
+                Noise_settings s = map->get_noise_settings();
+                s.adaptive_tolerance = (s.adaptive_tolerance > 0.0 ?
+                    0.0 : default_adaptive_tolerance);
+                map->set_noise_settings(s);
+                LOG(s.adaptive_tolerance > 0.0 ? "Adaptive sampling: on"
+                    : "Adaptive sampling: off");
+                perlin_map = true;
+            }
+            else if (e.key.keysym.sym == SDLK_z) {
+                animate = !animate;
+                if (!animate)
+                    map->end_animation();
+                LOG(animate ? "Animation: on" : "Animation: off");
+            }
+            else if (e.key.keysym.sym == SDLK_LEFT ||
+                e.key.keysym.sym == SDLK_RIGHT) {
+                Noise_settings s = map->get_noise_settings();
+                s.seed += (e.key.keysym.sym == SDLK_LEFT ? -1 : 1);
+                map->set_noise_settings(s);
+                LOG("Seed: " + std::to_string(s.seed));
+                perlin_map = true;
+            }
         }
         else if (e.type == SDL_MOUSEBUTTONDOWN) {
             int x, y;
@@ -146,6 +266,7 @@ void handle_input()
             if ((SDL_GetMouseState(&x, &y) & SDL_BUTTON_LMASK) ==
                 SDL_BUTTON_LMASK) {
                     update_screen_location(x, y);
+                    screen_changed = true;
             }
             else {
                 prev_mouse_x = x;
@@ -154,88 +275,423 @@ void handle_input()
         }
         else if (e.type == SDL_MOUSEWHEEL) {
             zoom(e.wheel.y);
+            screen_changed = true;
+        }
+        else if (e.type == SDL_QUIT) {
+            running = false;
+            break;
+        }
+    }
+}
+void print_usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " --export <file.region|file.bmp>"
+        << " [--size WxH] [--seed N] [--frequency F]"
+        << " [--format float64|float32|unorm16|half] [--memory MB]"
+        << " [--workers N] [--progress text|json|none] [--graph file]"
+        << " [--engine libnoise|gradient|gradient_f32|simplex"
+        << "|diamond_square|spectral] [--adaptive tolerance]\n"
+        << "       " << program << " --worker <queue directory>\n"
+        << "       " << program << " --search <seeds> [--seed first]"
+        << " [--land min:max] [--landmass min] [--resolution N] [--top N]"
+        << " [--size WxH] [--frequency F] [--graph file] [--engine ...]\n"
+        << "       " << program << " --batch <job list> [--maps N]"
+        << " [--manifest file] [--memory MB] [--size WxH] [--seed N] ...\n"
+        << "       " << program << " --flythrough <camera path> [--frame WxH]"
+        << " [--fps N] [--lookahead seconds] [--memory MB] [--size WxH]"
+        << " [--seed N] ... > frames.rgba\n";
+}
+
+/**
+ * Generate every map of a job list and write a manifest of them.
+ * \return The exit code of the program, 1 if any map failed.
+ */
+int run_batch_export(const std::string& batch_file,
+    const Noise_settings& noise, const Stream_settings& settings,
+    Batch_settings batch, const std::string& manifest_file,
+    const std::string& progress_style)
+{
+    try {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Batch_job> jobs = read_batch_jobs(batch_file, noise,
+            settings);
+
+        Progress progress;
+        std::unique_ptr<Progress_reporter> reporter;
+        if (progress_style != "none") {
+            reporter.reset(new Progress_reporter{progress, std::cerr,
+                progress_style == "json"});
         }
+        batch.progress = &progress;
+        std::vector<Batch_result> results = run_batch(jobs, batch);
+        reporter.reset();
+
+        std::chrono::duration<double> taken =
+            std::chrono::steady_clock::now() - start;
+        write_manifest(manifest_file, jobs, results, taken.count());
+
+        std::size_t failed = 0;
+        for (const Batch_result& r : results)
+            failed += (r.error.empty() ? 0 : 1);
+        std::cerr << "Wrote " << jobs.size() - failed << " of "
+            << jobs.size() << " maps in " << taken.count() << "s, see "
+            << manifest_file << '\n';
+        return (failed > 0 ? 1 : 0);
     }
-    else if (e.type == SDL_QUIT) {
-        running = false;
-        break;
+    catch (std::runtime_error& e) {
+        LOG(e.what());
+        std::cerr << e.what() << '\n';
+        return 1;
     }
 }
-/*
-void write_to_file(Pixel* map, int width, int height)
+
+/**
+ * Write the frames of a flythrough to stdout as raw RGBA.
+ * \return The exit code of the program.
+ */
+int run_flythrough(const std::string& path_file, const Noise_settings& noise,
+    Flythrough_settings fly, std::size_t memory_budget,
+    const std::string& progress_style)
 {
-    LOG("Writing file");
-    BMP image, color_image;
-    image.SetSize(width, height);
-    color_image.SetSize(width*RESOLUTION_FACTOR/2, height*RESOLUTION_FACTOR/2);
-    color_image.SetBitDepth(32);
-    image.SetBitDepth(32);
-    for (int y=0; y<height; y++) {
-        for (int x=0; x<width; x++) {
-            image(x, y)->Red = map[y*width + x].height * 255;
-            image(x, y)->Green = map[y*width + x].height * 255;
-            image(x, y)->Blue = map[y*width + x].height * 255;
-            image(x, y)->Alpha = 255;
-
-            if (y<height-1 && x<width-1) {
-                if (x == 0 && y == 0) {
-                    color_image(x, y)->Red = map[y*width + x].r;
-                    color_image(x+1, y)->Red = map[y*width + x].r;
-                    color_image(x, y+1)->Red = map[y*width + x].r;
-                    color_image(x+1, y+1)->Red = map[y*width + x].r;
-
-                    color_image(x, y)->Green = map[y*width + x].g;
-                    color_image(x+1, y)->Green = map[y*width + x].g;
-                    color_image(x, y+1)->Green = map[y*width + x].g;
-                    color_image(x+1, y+1)->Green = map[y*width + x].g;
-
-                    color_image(x, y)->Blue = map[y*width + x].b;
-                    color_image(x+1, y)->Blue = map[y*width + x].b;
-                    color_image(x, y+1)->Blue = map[y*width + x].b;
-                    color_image(x+1, y+1)->Blue = map[y*width + x].b;
-
-                    color_image(x, y)->Alpha = 255;
-                    color_image(x+1, y)->Alpha = 255;
-                    color_image(x, y+1)->Alpha = 255;
-                    color_image(x+1, y+1)->Alpha = 255;
-                }
-                else {
-                    int off_x = x + (RESOLUTION_FACTOR/4);
-                    int off_y = y + (RESOLUTION_FACTOR/4);
-
-                    color_image(off_x, off_y)->Red = map[y*width + x].r;
-                    color_image(off_x+1, off_y)->Red = map[y*width + x].r;
-                    color_image(off_x, off_y+1)->Red = map[y*width + x].r;
-                    color_image(off_x+1, off_y+1)->Red = map[y*width + x].r;
-
-                    color_image(off_x, off_y)->Green = map[y*width + x].g;
-                    color_image(off_x+1, off_y)->Green = map[y*width + x].g;
-                    color_image(off_x, off_y+1)->Green = map[y*width + x].g;
-                    color_image(off_x+1, off_y+1)->Green = map[y*width + x].g;
-
-                    color_image(off_x, off_y)->Blue = map[y*width + x].b;
-                    color_image(off_x+1, off_y)->Blue = map[y*width + x].b;
-                    color_image(off_x, off_y+1)->Blue = map[y*width + x].b;
-                    color_image(off_x+1, off_y+1)->Blue = map[y*width + x].b;
-
-                    color_image(off_x, off_y)->Alpha = 255;
-                    color_image(off_x+1, off_y)->Alpha = 255;
-                    color_image(x, off_y+1)->Alpha = 255;
-                    color_image(off_x+1, off_y+1)->Alpha = 255;
+    try {
+        std::vector<Camera_key> path = read_camera_path(path_file);
+        Tile_cache cache{memory_budget};
+
+        /* Reported on stderr, stdout is the video */
+        Progress progress;
+        std::unique_ptr<Progress_reporter> reporter;
+        if (progress_style != "none") {
+            reporter.reset(new Progress_reporter{progress, std::cerr,
+                progress_style == "json"});
+        }
+        fly.progress = &progress;
+        Flythrough_stats stats = flythrough(noise, path, fly, cache, stdout);
+        reporter.reset();
+
+        std::cerr << "Wrote " << stats.frames << " frames of "
+            << fly.frame_width << "x" << fly.frame_height << " in "
+            << stats.seconds << "s, " << stats.frames / stats.seconds
+            << " fps, slowest frame " << stats.slowest_frame * 1000.0
+            << "ms, " << stats.tiles_waited << " tiles not prefetched\n";
+    }
+    catch (std::runtime_error& e) {
+        LOG(e.what());
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
 
-                }
+/**
+ * Search seeds and print the best of them on stdout, a seed per line.
+ * \param top The most seeds to print.
+ * \return The exit code of the program.
+ */
+int run_seed_search(const Seed_search_settings& search, std::size_t top,
+    const std::string& progress_style)
+{
+    try {
+        auto start = std::chrono::steady_clock::now();
+        Progress progress;
+        std::unique_ptr<Progress_reporter> reporter;
+        if (progress_style != "none") {
+            reporter.reset(new Progress_reporter{progress, std::cerr,
+                progress_style == "json"});
+        }
+        Seed_search_settings s = search;
+        s.progress = &progress;
+        std::vector<Seed_stats> ranked = search_seeds(s);
+        reporter.reset();
+
+        std::cout << std::fixed << std::setprecision(4)
+            << "seed land landmass";
+        for (int b=1; b<num_biomes; b++)
+            std::cout << ' ' << biome_name(static_cast<BIOME>(b));
+        std::cout << '\n';
+        for (std::size_t i=0; i<ranked.size() && i<top; i++) {
+            std::cout << ranked[i].seed << ' ' << ranked[i].land << ' '
+                << ranked[i].landmass;
+            for (int b=1; b<num_biomes; b++)
+                std::cout << ' ' << ranked[i].biomes[b];
+            std::cout << '\n';
+        }
+
+        std::chrono::duration<double> taken =
+            std::chrono::steady_clock::now() - start;
+        std::cerr << ranked.size() << " of " << search.count
+            << " seeds matched, searched in " << taken.count() << "s\n";
+    }
+    catch (std::runtime_error& e) {
+        LOG(e.what());
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
 
+/**
+ * Generate a map straight to a file without opening a window.
+ * \return The exit code of the program.
+ */
+int run_headless(int argc, char* argv[])
+{
+    std::string filename;
+    std::string queue_dir;
+    Noise_settings noise;
+    noise.frequency = perlin_frequency;
+    Stream_settings settings;
+    int workers = 0;
+    std::string progress_style{"text"};
+    Seed_search_settings search;
+    search.count = 0;
+    std::size_t top = 20;
+    std::string batch_file;
+    std::string manifest_file;
+    unsigned maps_at_once = 0;
+    std::string path_file;
+    Flythrough_settings fly;
+
+    try {
+        for (int i=1; i<argc; i++) {
+            const std::string arg{argv[i]};
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for " + arg);
+            const std::string value{argv[++i]};
+
+            if (arg == "--export") {
+                filename = value;
+            }
+            else if (arg == "--size") {
+                std::size_t x = value.find('x');
+                if (x == std::string::npos)
+                    throw std::invalid_argument("Size must be WxH: " + value);
+                settings.width = std::stoi(value.substr(0, x));
+                settings.height = std::stoi(value.substr(x + 1));
+            }
+            else if (arg == "--seed") {
+                noise.seed = std::stoi(value);
+            }
+            else if (arg == "--frequency") {
+                noise.frequency = std::stod(value);
+                if (!(noise.frequency > 0.0))
+                    throw std::invalid_argument("Frequency must be above 0: "
+                        + value);
+            }
+            else if (arg == "--format") {
+                bool found = false;
+                for (int f=0; f<4; f++) {
+                    if (value == height_format_name(
+                        static_cast<HEIGHT_FORMAT>(f))) {
+                        settings.format = static_cast<HEIGHT_FORMAT>(f);
+                        found = true;
+                    }
+                }
+                if (!found)
+                    throw std::invalid_argument("Unknown format: " + value);
+            }
+            else if (arg == "--memory") {
+                settings.memory_budget = static_cast<std::size_t>(
+                    std::stoull(value)) << 20;
+            }
+            else if (arg == "--workers") {
+                workers = std::stoi(value);
+            }
+            else if (arg == "--worker") {
+                queue_dir = value;
+            }
+            else if (arg == "--graph") {
+                std::ifstream in{value};
+                std::ostringstream text;
+                if (!(text << in.rdbuf()))
+                    throw std::invalid_argument("Can't read graph: " + value);
+                noise.graph = std::make_shared<const Noise_kernel>(
+                    Noise_graph::parse(text.str()));
+            }
+            else if (arg == "--engine") {
+                bool found = false;
+                for (int e=0; e<num_noise_engines; e++) {
+                    if (value == noise_engine_name(
+                        static_cast<NOISE_ENGINE>(e))) {
+                        noise.engine = static_cast<NOISE_ENGINE>(e);
+                        found = true;
+                    }
+                }
+                if (!found)
+                    throw std::invalid_argument("Unknown engine: " + value);
+            }
+            else if (arg == "--adaptive") {
+                noise.adaptive_tolerance = std::stod(value);
+                if (noise.adaptive_tolerance <= 0.0)
+                    throw std::invalid_argument("Tolerance must be above 0: "
+                        + value);
+            }
+            else if (arg == "--batch") {
+                batch_file = value;
             }
+            else if (arg == "--maps") {
+                maps_at_once = static_cast<unsigned>(std::stoul(value));
+            }
+            else if (arg == "--manifest") {
+                manifest_file = value;
+            }
+            else if (arg == "--flythrough") {
+                path_file = value;
+            }
+            else if (arg == "--frame") {
+                std::size_t x = value.find('x');
+                if (x == std::string::npos)
+                    throw std::invalid_argument("Frame must be WxH: "
+                        + value);
+                fly.frame_width = std::stoi(value.substr(0, x));
+                fly.frame_height = std::stoi(value.substr(x + 1));
+            }
+            else if (arg == "--fps") {
+                fly.fps = std::stod(value);
+            }
+            else if (arg == "--lookahead") {
+                fly.lookahead = std::stod(value);
+            }
+            else if (arg == "--search") {
+                search.count = std::stoi(value);
+                if (search.count <= 0)
+                    throw std::invalid_argument("Nothing to search: " + value);
+            }
+            else if (arg == "--land") {
+                std::size_t colon = value.find(':');
+                if (colon == std::string::npos)
+                    throw std::invalid_argument("Land must be min:max: "
+                        + value);
+                search.criteria.min_land = std::stod(value.substr(0, colon));
+                search.criteria.max_land = std::stod(value.substr(colon + 1));
+            }
+            else if (arg == "--landmass") {
+                search.criteria.min_landmass = std::stod(value);
+            }
+            else if (arg == "--resolution") {
+                search.resolution = std::stoi(value);
+                if (search.resolution <= 0)
+                    throw std::invalid_argument("Bad resolution: " + value);
+            }
+            else if (arg == "--top") {
+                top = std::stoul(value);
+            }
+            else if (arg == "--progress") {
+                if (value != "text" && value != "json" && value != "none")
+                    throw std::invalid_argument("Unknown progress: " + value);
+                progress_style = value;
+            }
+            else {
+                throw std::invalid_argument("Unknown option: " + arg);
+            }
+        }
+    }
+    catch (std::logic_error& e) {
+        std::cerr << e.what() << '\n';
+        print_usage(argv[0]);
+        return 1;
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    if (!path_file.empty()) {
+        if (!filename.empty() || !queue_dir.empty() || workers > 0
+            || search.count > 0 || !batch_file.empty()) {
+            print_usage(argv[0]);
+            return 1;
         }
+        fly.width = settings.width;
+        fly.height = settings.height;
+        fly.format = settings.format;
+        return run_flythrough(path_file, noise, fly, settings.memory_budget,
+            progress_style);
     }
+    if (!batch_file.empty()) {
+        if (!filename.empty() || !queue_dir.empty() || workers > 0
+            || search.count > 0) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        Batch_settings batch;
+        batch.memory_budget = settings.memory_budget;
+        batch.maps_at_once = maps_at_once;
+        return run_batch_export(batch_file, noise, settings, batch,
+            manifest_file.empty() ? batch_file + ".manifest" : manifest_file,
+            progress_style);
+    }
+    if (search.count > 0) {
+        if (!filename.empty() || !queue_dir.empty() || workers > 0) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        search.noise = noise;
+        search.first_seed = noise.seed;
+        search.width = settings.width;
+        search.height = settings.height;
+        return run_seed_search(search, top, progress_style);
+    }
+    if (filename.empty() == queue_dir.empty() || (workers > 0
+        && export_format_for(filename) != EXPORT_FORMAT::region)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (workers > 0 && whole_map_engine(noise.engine) && !noise.graph) {
+        std::cerr << noise_engine_name(noise.engine)
+            << " maps are made whole and can't be split between workers\n";
+        return 1;
+    }
+
+    try {
+        auto start = std::chrono::steady_clock::now();
+        if (!queue_dir.empty()) {
+            append_to_default_log();
+            Shard_queue queue{queue_dir};
+            queue.run_worker();
+            return 0;
+        }
+
+        /* Reported on stderr, stdout is left alone for the caller */
+        Progress progress;
+        std::unique_ptr<Progress_reporter> reporter;
+        if (progress_style != "none") {
+            reporter.reset(new Progress_reporter{progress, std::cerr,
+                progress_style == "json"});
+        }
 
-    image.WriteToFile("Map.bmp");
-    color_image.WriteToFile("Color_Map.bmp");
-    LOG("Finished writing to file");*/
+        if (workers > 0) {
+            /* Split the threads of this machine between the workers */
+            Shard_plan plan;
+            plan.noise = noise;
+            plan.settings = settings;
+            plan.settings.threads = std::max(1u,
+                std::thread::hardware_concurrency() / workers);
+            plan.num_shards = workers * 4;
+            run_sharded_export(plan, filename, workers, argv[0], &progress);
+        }
+        else {
+            settings.progress = &progress;
+            stream_export(noise, settings, filename);
+        }
+        reporter.reset();
+        std::chrono::duration<double> taken =
+            std::chrono::steady_clock::now() - start;
+        std::cerr << "Wrote " << filename << " in " << taken.count()
+            << "s\n";
+    }
+    catch (std::runtime_error& e) {
+        LOG(e.what());
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
 }
 
 int main(int argc, char* argv[])
 {
+    if (argc > 1)
+        return run_headless(argc, argv);
+
     /* Initliase SDL subsystems */
     if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER|SDL_INIT_EVENTS) != 0) {
         LOG("Could not initialise SDL");
@@ -273,23 +729,44 @@ int main(int argc, char* argv[])
 
     map = new Pixel_map(renderer, map_width, map_height);
 
+    /* Tiles of seeds seen before are read back instead of regenerated */
+    Tile_disk_cache disk_cache{tile_cache_dir, tile_cache_budget};
+    Tile_cache tile_cache{tile_memory_budget, &disk_cache};
+    map->set_tile_cache(&tile_cache);
+
     Uint32 current_time = 0;
     Uint32 frame_check_time = 0;
     long frames = 0;
+    Frame_timer frame_timer{};
+    SDL_Rect overlay_rect{0, screen_height - 96, screen_width, 96};
+    Animated_noise animation{};
+    double animation_depth = 0.5;   /**< The map as filled */
+    Uint32 animation_time = 0;
 
     frame_check_time = SDL_GetTicks();
     LOG("Entering main loop");
     while (running) {
         /** Handle Time stuff **/
         current_time = SDL_GetTicks();
+        frame_timer.begin_frame();
 
-        //Update FPS counter every second
-        if (current_time - frame_check_time > 1000) {
+        //Update FPS counter every second, faster while generating
+        Uint32 title_interval = (map->generating() ? 250 : 1000);
+        if (current_time - frame_check_time > title_interval) {
+            Tile_cache::Stats tiles = tile_cache.stats();
+            std::uint64_t lookups = tiles.hits + tiles.misses;
             std::string msg{"Bad Map Generator! FPS: "
                 + std::to_string(frames * 1000.0 / (current_time -
                 frame_check_time))
+                + " | " + frame_timer.summary()
+                + " | Tile hits: " + std::to_string(lookups ?
+                    tiles.hits * 100 / lookups : 0)
+                + "% " + std::to_string(tiles.bytes >> 20) + "MB"
                 + " | Runtime: " + std::to_string(current_time / 1000)
                 + "s"};
+            if (map->generating())
+                msg += " | Generating: "
+                    + format_progress(map->generation_progress());
 
             SDL_SetWindowTitle(window, msg.c_str());
 
@@ -299,41 +776,167 @@ int main(int argc, char* argv[])
         /** End of time stuff **/
 
         handle_input();
+        frame_timer.mark(FRAME_PHASE::input);
+
+        if (dump_frame_times) {
+            dump_frame_times = false;
+            try {
+                frame_timer.write_report(frame_report_file);
+                LOG("Wrote frame times to " + std::string{frame_report_file});
+            }
+            catch (std::runtime_error& e) {
+                LOG(e.what());
+            }
+        }
 
         if (reload) {
             //Generate a new map
             reload = false;
             map->fill_color_static();
+            frame_timer.mark(FRAME_PHASE::generation);
             map->render();
+            frame_timer.mark(FRAME_PHASE::render);
         }
         else if (greyscale_reload) {
             greyscale_reload = false;
             map->fill_static();
+            frame_timer.mark(FRAME_PHASE::generation);
+            map->render();
+            frame_timer.mark(FRAME_PHASE::render);
+        }
+        else if (perlin) {
+            perlin = false;
+            map->start_perlin_noise(perlin_frequency);
+            frame_timer.mark(FRAME_PHASE::generation);
+        }
+        else if (perlin_map) {
+            perlin_map = false;
+            map->start_perlin_map(perlin_frequency);
+            frame_timer.mark(FRAME_PHASE::generation);
+        }
+        else if (recolor) {
+            /* Only the palette changes, the map itself is untouched */
+            recolor = false;
+            Random_color_generator random_color{SDL_GetTicks()};
+            for (int i=1; i<num_biomes; i++) {
+                map->set_biome_color(static_cast<BIOME>(i), SDL_Color{
+                    random_color(), random_color(), random_color(),
+                    SDL_ALPHA_OPAQUE});
+            }
             map->render();
+            frame_timer.mark(FRAME_PHASE::render);
         }
-		else if (perlin) {
-			perlin = false;
-            map->fill_perlin_noise();
+        else if (next_height_format) {
+            next_height_format = false;
+            HEIGHT_FORMAT f = static_cast<HEIGHT_FORMAT>(
+                (static_cast<int>(map->get_height_format()) + 1) % 4);
+            map->set_height_format(f);
+            LOG("Height format: " + std::string{height_format_name(f)});
+            perlin_map = true;
+        }
+        else if (toggle_layout) {
+            toggle_layout = false;
+            bool tiled = map->get_layout() == MAP_LAYOUT::tiled;
+            map->set_layout(tiled ? MAP_LAYOUT::row_major : MAP_LAYOUT::tiled);
+            LOG(tiled ? "Layout: row major" : "Layout: tiled");
+            perlin_map = true;
+        }
+        else if (write_file) {
+            write_file = false;
+            LOG("Writing file");
+            if (!map->export_bmp("Map.bmp", "Color_Map.bmp"))
+                LOG("Failed to write map to file");
+            else
+                LOG("Finished writing to file");
+            frame_timer.mark(FRAME_PHASE::generation);
+        }
+        else if (write_region) {
+            write_region = false;
+            try {
+                map->export_region(region_file);
+                LOG("Wrote map to " + std::string{region_file});
+            }
+            catch (std::runtime_error& e) {
+                LOG(e.what());
+            }
+            frame_timer.mark(FRAME_PHASE::generation);
+        }
+        else if (read_region) {
+            read_region = false;
+            try {
+                Region_reader region{region_file};
+                map->load_region(region, 0, 0);
+                map->render();
+                screen_changed = true;
+                LOG("Read map from " + std::string{region_file});
+            }
+            catch (std::runtime_error& e) {
+                LOG(e.what());
+            }
+            frame_timer.mark(FRAME_PHASE::generation);
+        }
+        else if (rerender) {
+            rerender = false;
             map->render();
-		}
+            frame_timer.mark(FRAME_PHASE::render);
+        }
         //else if () {}
-        else {
+        else if (!show_overlay && !map->generating() && !animate) {
             SDL_Delay(50);
+            frame_timer.mark(FRAME_PHASE::idle);
+        }
+
+        /* Move through the third dimension of the noise, only the part of
+           the map on screen is evaluated, a sample per screen pixel */
+        if (animate) {
+            animation.set_noise(map->get_noise_settings());
+            animation.set_view(map->source_location.x,
+                map->source_location.y,
+                static_cast<double>(map->source_location.w) / screen_width,
+                static_cast<double>(map->source_location.h) / screen_height,
+                screen_width, screen_height);
+            if (map->showing_animation())
+                animation_depth += animation_speed
+                    * (current_time - animation_time) / 1000.0;
+            animation_time = current_time;
+            animation.advance(animation_depth);
+            frame_timer.mark(FRAME_PHASE::generation);
+            map->upload_animation(animation);
+            frame_timer.mark(FRAME_PHASE::render);
+            screen_changed = true;
         }
 
-        if (screen_changed) {
+        /* Draw tiles of a threaded fill as they finish, visible ones are
+           generated first */
+        if (map->upload_finished_tiles() > 0)
+            screen_changed = true;
+        frame_timer.mark(FRAME_PHASE::render);
+
+        /* The overlay changes every frame, so keep redrawing while shown */
+        if (screen_changed || show_overlay) {
             screen_changed = false;
             if (!map->show(&screen_rect)) {
                 LOG("Failed to render!");
                 LOG(SDL_GetError());
+                frame_timer.mark(FRAME_PHASE::show);
             }
             else {
+                if (show_overlay) {
+                    frame_timer.draw_overlay(renderer, overlay_rect);
+                    if (map->generating())
+                        draw_progress_bar(renderer,
+                            map->generation_progress(), overlay_rect);
+                }
+                frame_timer.mark(FRAME_PHASE::show);
                 SDL_RenderPresent(renderer);
+                frame_timer.mark(FRAME_PHASE::present);
             }
         }
 
+        frame_timer.end_frame();
         frames++;
     }
+    map->set_tile_cache(NULL);
     LOG("Program exiting successfully");
     return 0;
 }